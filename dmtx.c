@@ -24,13 +24,18 @@
 #include <errno.h>
 #include <assert.h>
 #include <math.h>
-#include "dmtx.h"
-#include "dmtxstatic.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "dmtx.h"
+#include "dmtxstatic.h"
+
 #ifndef CALLBACK_POINT_PLOT
 #define CALLBACK_POINT_PLOT(a,b,c,d)
 #endif
@@ -51,6 +56,13 @@
 #define CALLBACK_FINAL(a,b)
 #endif
 
+/* Decoder statistics are collected unless DMTX_NO_DECODE_STATS is defined */
+#ifdef DMTX_NO_DECODE_STATS
+#define STATS_ADD(s,f,n)
+#else
+#define STATS_ADD(s,f,n)       do { if((s) != NULL) (s)->f += (n); } while(0)
+#endif
+
 /**
  * Use #include to merge the individual .c source files into a single combined
  * file during preprocessing. This allows the project to be organized in files
@@ -73,6 +85,9 @@
 
 #include "dmtxmessage.c"
 #include "dmtxregion.c"
+#include "dmtxhough.c"
+#include "dmtxruns.c"
+#include "dmtxtiming.c"
 #include "dmtxsymbol.c"
 #include "dmtxplacemod.c"
 #include "dmtxreedsol.c"
@@ -81,6 +96,7 @@
 #include "dmtximage.c"
 #include "dmtxbytelist.c"
 #include "dmtxtime.c"
+#include "dmtxtrace.c"
 #include "dmtxvector2.c"
 #include "dmtxmatrix3.c"
 
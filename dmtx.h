@@ -171,6 +171,10 @@ typedef enum {
    DmtxPropSquareDevn,
    DmtxPropSymbolSize,
    DmtxPropEdgeThresh,
+   DmtxPropPreprocess,
+   DmtxPropColorReduce,
+   DmtxPropDetector,
+   DmtxPropHoughThreads,
    /* Image properties */
    DmtxPropWidth             = 300,
    DmtxPropHeight,
@@ -204,6 +208,10 @@ typedef enum {
    DmtxPack16bppBGRX,
    DmtxPack16bppXBGR,
    DmtxPack16bppYCbCr,
+   DmtxPack16bppRGB565,       /* 5-6-5 bit channels, most significant byte first */
+   DmtxPack16bppBGR565,
+   DmtxPack16bppRGB565LE,     /* 5-6-5 bit channels, least significant byte first */
+   DmtxPack16bppBGR565LE,
    /* 24 bpp formats */
    DmtxPack24bppRGB          = 500,
    DmtxPack24bppBGR,
@@ -216,6 +224,47 @@ typedef enum {
    DmtxPack32bppCMYK
 } DmtxPackOrder;
 
+typedef enum {
+   DmtxPreprocessNone        = 0x00,
+   DmtxPreprocessDenoise     = 0x01 << 0,  /* 3x3 binomial smoothing */
+   DmtxPreprocessNormalize   = 0x01 << 1,  /* Stretch 1st..99th percentile to full range */
+   DmtxPreprocessSharpen     = 0x01 << 2,  /* 3x3 unsharp mask */
+   DmtxPreprocessAll         = 0x07
+} DmtxPreprocess;
+
+typedef enum {
+   DmtxColorReduceNone       = 0,  /* Decode every image channel */
+   DmtxColorReduceLuma,            /* Decode 8-bit luma only */
+   DmtxColorReduceMaxContrast      /* Decode the channel with the widest range in each tile */
+} DmtxColorReduce;
+
+typedef enum {
+   DmtxDetectorTrail         = 0,  /* Follow edges from scan grid locations (default) */
+   DmtxDetectorHough,              /* Fit regions to the dominant line directions of image tiles */
+   DmtxDetectorRuns                /* Fit regions to connected runs of a thresholded image */
+} DmtxDetector;
+
+/* Decoder stages timed by DmtxDecodeStats and marked in DmtxTrace */
+typedef enum {
+   DmtxStatsStageFind        = 0,  /* All of dmtxRegionFindNext(), including the stages below */
+   DmtxStatsStageOrient,           /* Trail blazing and edge search for a candidate */
+   DmtxStatsStageFit,              /* Aligning the top and right calibration edges */
+   DmtxStatsStageSize,             /* Choosing and verifying the symbol size */
+   DmtxStatsStageDecode,           /* All of dmtxDecodeMatrixRegion() */
+   DmtxStatsStageCount
+} DmtxStatsStage;
+
+/* Why a trail detector candidate was dropped, counted by DmtxDecodeStats */
+typedef enum {
+   DmtxRejectTrailLength     = 0,  /* Trail too short, or outside the DmtxPropEdgeMin/Max extent */
+   DmtxRejectFinderSide,           /* No straight finder side through or beyond the trail start */
+   DmtxRejectCorners,              /* Fitted corners fail the dmtxRegionUpdateCorners() checks */
+   DmtxRejectCalibEdge,            /* Top or right calibration edge could not be aligned */
+   DmtxRejectTimingPattern,        /* Expected timing edges do not alternate */
+   DmtxRejectSize,                 /* No symbol size fits the calibration bars */
+   DmtxRejectCount
+} DmtxReject;
+
 typedef enum {
   DmtxFlipNone               = 0x00,
   DmtxFlipX                  = 0x01 << 0,
@@ -333,6 +382,28 @@ typedef struct DmtxBestLine_struct {
    DmtxPixelLoc    locNeg; /* if left, left_down; if bottom, right_down*/
 } DmtxBestLine;
 
+/**
+ * @struct DmtxSymbolInfo
+ * @brief DmtxSymbolInfo
+ */
+typedef struct DmtxSymbolInfo_struct {
+   int             sizeIdx;              /* Index of this entry in the symbol table */
+   int             symbolRows;           /* Total rows including alignment patterns */
+   int             symbolCols;           /* Total columns including alignment patterns */
+   int             dataRegionRows;       /* Rows per data region */
+   int             dataRegionCols;       /* Columns per data region */
+   int             horizDataRegions;     /* Data regions per symbol row */
+   int             vertDataRegions;      /* Data regions per symbol column */
+   int             mappingRows;          /* Rows in mapping matrix */
+   int             mappingCols;          /* Columns in mapping matrix */
+   int             interleavedBlocks;    /* Number of interleaved Reed-Solomon blocks */
+   int             blockErrorWords;      /* Error words per block */
+   int             blockMaxCorrectable;  /* Correctable errors per block */
+   int             symbolDataWords;      /* Data words per symbol */
+   int             symbolErrorWords;     /* Error words per symbol */
+   int             symbolMaxCorrectable; /* Correctable errors per symbol */
+} DmtxSymbolInfo;
+
 /**
  * @struct DmtxRegion
  * @brief DmtxRegion
@@ -348,6 +419,7 @@ typedef struct DmtxRegion_struct {
    DmtxPixelLoc    boundMin;      /* */
    DmtxPixelLoc    boundMax;      /* */
    DmtxPointFlow   flowBegin;     /* */
+   DmtxPixelLoc   *trail;         /* Trail points by step, see FollowSeek(), owned by the decoder */
 
    /* Orientation values */
    int             polarity;      /* */
@@ -384,6 +456,9 @@ typedef struct DmtxRegion_struct {
    /* Transform values */
    DmtxMatrix3     raw2fit;       /* 3x3 transformation from raw image to fitted barcode grid */
    DmtxMatrix3     fit2raw;       /* 3x3 transformation from fitted barcode grid to raw image */
+
+   /* Trace values */
+   int             traceId;       /* Candidate number within its decoder, see DmtxTraceEvent */
 } DmtxRegion;
 
 /**
@@ -439,6 +514,54 @@ typedef struct DmtxTime_struct {
    unsigned long   usec;
 } DmtxTime;
 
+/**
+ * @struct DmtxDecodeStats
+ * @brief Work counters accumulated by a decoder, see dmtxDecodeGetStats()
+ */
+typedef struct DmtxDecodeStats_struct {
+   long            gridPopped;         /* Scan grid locations tested */
+   long            gridSkipped;        /* Locations already covered by a trail or found region */
+   long            edgeHits;           /* MatrixRegionSeekEdge() results over edge threshold */
+   long            orientationFails;   /* Candidates rejected while finding orientation */
+   long            trailSteps;         /* Pixels walked by continuous and gapped trail blazing */
+   long            houghLines;         /* Hough searches for a best solid line */
+   long            sizeCandidates;     /* Symbol sizes tested against calibration bars */
+   long            rsBlocksCorrected;  /* Reed-Solomon blocks that needed repair */
+   long            rsWordsFixed;       /* Codewords repaired */
+   long            stageUsec[DmtxStatsStageCount]; /* Time per DmtxStatsStage, microseconds */
+   long            rejects[DmtxRejectCount]; /* Trail detector candidates dropped per DmtxReject */
+} DmtxDecodeStats;
+
+/**
+ * @struct DmtxTraceEvent
+ * @brief Begin or end mark of one decoder stage
+ */
+typedef struct DmtxTraceEvent_struct {
+   DmtxTime        time;
+   int             stage;         /* DmtxStatsStage */
+   int             phase;         /* 'B' at stage begin, 'E' at stage end */
+   int             regionId;      /* DmtxRegion traceId, or DmtxUndefined outside a candidate */
+   int             x;             /* Candidate trail start, scaled pixels */
+   int             y;
+} DmtxTraceEvent;
+
+/**
+ * @struct DmtxTrace
+ * @brief Event ring filled by the decoders of a single thread
+ */
+typedef struct DmtxTrace_struct {
+   int             tid;           /* Thread id written to exported traces */
+   int             capacity;      /* Events kept, older events are overwritten */
+   long            count;         /* Events recorded since creation */
+   DmtxTraceEvent *events;
+} DmtxTrace;
+
+/* Hough detector state, private to the library */
+typedef struct DmtxHoughGrid_struct DmtxHoughGrid;
+
+/* Run-length detector state, private to the library */
+typedef struct DmtxRunList_struct DmtxRunList;
+
 /**
  * @struct DmtxDecode
  * @brief DmtxDecode
@@ -452,6 +575,10 @@ typedef struct DmtxDecode_struct {
    double          squareDevn;
    int             sizeIdxExpected;
    int             edgeThresh;
+   int             preprocess;
+   int             colorReduce;
+   int             detector;
+   int             houghThreads;  /* Threads building the Hough grid, used when built with pthreads */
 
    /* Image modifiers */
    int             xMin;
@@ -463,8 +590,25 @@ typedef struct DmtxDecode_struct {
    /* Internals */
 /* int             cacheComplete; */
    unsigned char  *cache;
+   int             cacheSize;   /* Bytes allocated for cache */
+   int             channelCount; /* Channels seen by the decoder, 1 with color reduction */
+   unsigned char  *ppTiles;     /* Preprocessed pixels, one contiguous block per tile */
+   unsigned char  *ppTileDone;  /* Nonzero once a tile has been preprocessed */
+   int             ppWidth;     /* Scaled image size covered by the tiles */
+   int             ppHeight;
+   int             ppTileCols;
+   int             ppLevels[4][2]; /* Normalization low/high per channel */
+   int             ppLevelsDone;
    DmtxImage      *image;
    DmtxScanGrid    grid;
+   DmtxDecodeStats stats;
+   DmtxTime        statsBegin[DmtxStatsStageCount];
+   DmtxPixelLoc   *trail;         /* Points of the candidate being traced, continuous then gapped */
+   int             trailCapacity;
+   DmtxTrace      *trace;         /* Receives stage events when not NULL */
+   int             traceRegions;  /* Candidates numbered so far */
+   DmtxHoughGrid  *houghGrid;     /* Edges and candidate tiles, built on first use */
+   DmtxRunList    *runList;       /* Finder candidates from connected runs, built on first use */
 } DmtxDecode;
 
 /**
@@ -528,6 +672,11 @@ typedef struct DmtxQuadruplet_struct {
    unsigned char   value[4];
 } DmtxQuadruplet;
 
+/* dmtxtrace.c */
+extern DmtxTrace *dmtxTraceCreate(int capacity, int tid);
+extern DmtxPassFail dmtxTraceDestroy(DmtxTrace **trace);
+extern char *dmtxTraceCreateJson(DmtxTrace **traces, int traceCount, int *jsonBytes);
+
 /* dmtxtime.c */
 extern DmtxTime dmtxTimeNow(void);
 extern DmtxTime dmtxTimeAdd(DmtxTime t, long msec);
@@ -543,9 +692,12 @@ extern DmtxPassFail dmtxEncodeDataMosaic(DmtxEncode *enc, int n, unsigned char *
 
 /* dmtxdecode.c */
 extern DmtxDecode *dmtxDecodeCreate(DmtxImage *img, int scale);
+extern DmtxPassFail dmtxDecodeSetImage(DmtxDecode *dec, DmtxImage *img);
 extern DmtxPassFail dmtxDecodeDestroy(DmtxDecode **dec);
 extern DmtxPassFail dmtxDecodeSetProp(DmtxDecode *dec, int prop, int value);
 extern int dmtxDecodeGetProp(DmtxDecode *dec, int prop);
+extern DmtxPassFail dmtxDecodeGetStats(DmtxDecode *dec, DmtxDecodeStats *stats);
+extern DmtxPassFail dmtxDecodeSetTrace(DmtxDecode *dec, DmtxTrace *trace);
 extern /*@exposed@*/ unsigned char *dmtxDecodeGetCache(DmtxDecode *dec, int x, int y);
 extern DmtxPassFail dmtxDecodeGetPixelValue(DmtxDecode *dec, int x, int y, int channel, /*@out@*/ int *value);
 extern DmtxMessage *dmtxDecodeMatrixRegion(DmtxDecode *dec, DmtxRegion *reg, int fix);
@@ -568,6 +720,7 @@ extern DmtxPassFail dmtxMessageDestroy(DmtxMessage **msg);
 
 /* dmtximage.c */
 extern DmtxImage *dmtxImageCreate(unsigned char *pxl, int width, int height, int pack);
+extern DmtxImage *dmtxImageCreateView(DmtxImage *parent, int x, int y, int width, int height);
 extern DmtxPassFail dmtxImageDestroy(DmtxImage **img);
 extern DmtxPassFail dmtxImageSetChannel(DmtxImage *img, int channelStart, int bitsPerChannel);
 extern DmtxPassFail dmtxImageSetProp(DmtxImage *img, int prop, int value);
@@ -609,10 +762,12 @@ extern void dmtxMatrix3Multiply(/*@out@*/ DmtxMatrix3 mOut, DmtxMatrix3 m0, Dmtx
 extern void dmtxMatrix3MultiplyBy(DmtxMatrix3 m0, DmtxMatrix3 m1);
 extern int dmtxMatrix3VMultiply(/*@out@*/ DmtxVector2 *vOut, DmtxVector2 *vIn, DmtxMatrix3 m);
 extern int dmtxMatrix3VMultiplyBy(DmtxVector2 *v, DmtxMatrix3 m);
+extern int dmtxMatrix3VMultiplyN(DmtxVector2 *vOut, const DmtxVector2 *vIn, int count, DmtxMatrix3 m);
 extern void dmtxMatrix3Print(DmtxMatrix3 m);
 
 /* dmtxsymbol.c */
 extern int dmtxSymbolModuleStatus(DmtxMessage *mapping, int sizeIdx, int row, int col);
+extern const DmtxSymbolInfo *dmtxGetSymbolInfo(int sizeIdx);
 extern int dmtxGetSymbolAttribute(int attribute, int sizeIdx);
 extern int dmtxGetBlockDataSize(int sizeIdx, int blockIdx);
 extern int getSizeIdxFromSymbolDimension(int rows, int cols);
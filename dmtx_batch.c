@@ -0,0 +1,337 @@
+/*
+ * dmtx_batch - decode many image files in parallel and print one JSON line per file
+ *
+ * usage: dmtx_batch [-j workers] [-m max-symbols] [-t timeout-ms] [-s scale] [-H | -R] file|pattern ...
+ *
+ * Patterns are expanded with glob(3), so they can be quoted to avoid the shell's argument limit.
+ * Every worker keeps one DmtxDecode and points it at each new image with dmtxDecodeSetImage().
+ * -H finds regions with the Hough detector, which copes better with perspective.
+ * -R finds regions with the run-length detector, which is quickest on flat scans.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <glob.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "./dmtx.h"
+#include "./image_io.h"
+
+typedef struct
+{
+    char **files;          // 展开后的文件列表
+    int file_count;
+    int next_file;         // 下一个待处理的文件
+    int max_symbols;       // 每幅图像最多解码的DM码数量
+    int timeout_ms;        // 每幅图像的搜索超时, 0 表示不限
+    int scale;
+    int detector;          // DmtxDetectorTrail、DmtxDetectorHough 或 DmtxDetectorRuns
+    DmtxTrace **traces;    // 每个工作线程一个事件环, 未指定 -T 时为 NULL
+    int next_worker;       // 下一个启动的工作线程编号
+    pthread_mutex_t lock;  // 保护 next_file, next_worker 和标准输出
+} batch_job;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1.0e6;
+}
+
+/* append a JSON string literal, bytes above 0x7f are taken as Latin-1 */
+static void json_append_string(char **buf, size_t *len, size_t *cap, const unsigned char *str, size_t str_len)
+{
+    size_t i;
+    if (*len + str_len * 6 + 3 > *cap)
+    {
+        *cap = (*len + str_len * 6 + 3) * 2;
+        *buf = (char *)realloc(*buf, *cap);
+    }
+    (*buf)[(*len)++] = '"';
+    for (i = 0; i < str_len; i++)
+    {
+        unsigned char c = str[i];
+        if (c == '"' || c == '\\')
+        {
+            (*buf)[(*len)++] = '\\';
+            (*buf)[(*len)++] = (char)c;
+        }
+        else if (c < 0x20 || c > 0x7e)
+        {
+            *len += sprintf(*buf + *len, "\\u%04x", c);
+        }
+        else
+        {
+            (*buf)[(*len)++] = (char)c;
+        }
+    }
+    (*buf)[(*len)++] = '"';
+    (*buf)[*len] = '\0';
+}
+
+/* append printf-style text */
+static void json_append(char **buf, size_t *len, size_t *cap, const char *fmt, ...)
+{
+    va_list args;
+    int n;
+    for (;;)
+    {
+        va_start(args, fmt);
+        n = vsnprintf(*buf + *len, *cap - *len, fmt, args);
+        va_end(args);
+        if (n >= 0 && (size_t)n < *cap - *len)
+        {
+            *len += (size_t)n;
+            return;
+        }
+        *cap = (*cap + (size_t)n + 1) * 2;
+        *buf = (char *)realloc(*buf, *cap);
+    }
+}
+
+/* decode one file, reusing the worker's decoder, and build its JSON line */
+static void decode_file(batch_job *job, const char *file_name, DmtxDecode **dec, DmtxTrace *trace, char **buf,
+                        size_t *cap)
+{
+    size_t len = 0;
+    int i, count = 0;
+    double t_start = now_ms(), t_load, t_find, t_decode;
+    DmtxTime timeout;
+
+    json_append(buf, &len, cap, "{\"file\":");
+    json_append_string(buf, &len, cap, (const unsigned char *)file_name, strlen(file_name));
+
+    mapped_image *src = mapped_image_load(file_name, 1);
+    t_load = now_ms() - t_start;
+    if (src == NULL)
+    {
+        json_append(buf, &len, cap, ",\"error\":\"load failed\",\"load_ms\":%.3f}", t_load);
+        return;
+    }
+    json_append(buf, &len, cap, ",\"width\":%d,\"height\":%d,\"load_ms\":%.3f,\"symbols\":[",
+                dmtxImageGetProp(src->image, DmtxPropWidth), dmtxImageGetProp(src->image, DmtxPropHeight),
+                t_load);
+
+    if (*dec == NULL)
+    {
+        *dec = dmtxDecodeCreate(src->image, job->scale);
+    }
+    else if (dmtxDecodeSetImage(*dec, src->image) == DmtxFail)
+    {
+        dmtxDecodeDestroy(dec);
+        *dec = dmtxDecodeCreate(src->image, job->scale);
+    }
+    if (*dec != NULL && trace != NULL)
+    {
+        dmtxDecodeSetTrace(*dec, trace);
+    }
+    if (*dec != NULL && job->detector != DmtxDetectorTrail)
+    {
+        dmtxDecodeSetProp(*dec, DmtxPropDetector, job->detector);
+    }
+
+    if (job->timeout_ms > 0)
+    {
+        timeout = dmtxTimeAdd(dmtxTimeNow(), job->timeout_ms);
+    }
+
+    while (*dec != NULL && count < job->max_symbols)
+    {
+        double t0 = now_ms();
+        DmtxRegion *reg = dmtxRegionFindNext(*dec, (job->timeout_ms > 0) ? &timeout : NULL);
+        t_find = now_ms() - t0;
+        if (reg == NULL)
+        {
+            break;
+        }
+
+        t0 = now_ms();
+        DmtxMessage *msg = dmtxDecodeMatrixRegion(*dec, reg, DmtxUndefined);
+        t_decode = now_ms() - t0;
+        if (msg != NULL)
+        {
+            // 符号四个角点在原始图像中的坐标, 顺序为左下, 右下, 右上, 左上
+            static const double corner_fit[4][2] = {{0.0, 0.0}, {1.0, 0.0}, {1.0, 1.0}, {0.0, 1.0}};
+            json_append(buf, &len, cap, "%s{\"text\":", (count > 0) ? "," : "");
+            json_append_string(buf, &len, cap, msg->output, (size_t)msg->outputIdx);
+            json_append(buf, &len, cap, ",\"sizeIdx\":%d,\"rows\":%d,\"cols\":%d,\"corners\":[", reg->sizeIdx,
+                        dmtxGetSymbolAttribute(DmtxSymAttribSymbolRows, reg->sizeIdx),
+                        dmtxGetSymbolAttribute(DmtxSymAttribSymbolCols, reg->sizeIdx));
+            for (i = 0; i < 4; i++)
+            {
+                DmtxVector2 p = {corner_fit[i][0], corner_fit[i][1]};
+                dmtxMatrix3VMultiplyBy(&p, reg->fit2raw);
+                json_append(buf, &len, cap, "%s[%.1f,%.1f]", (i > 0) ? "," : "", p.X * job->scale,
+                            p.Y * job->scale);
+            }
+            json_append(buf, &len, cap, "],\"find_ms\":%.3f,\"decode_ms\":%.3f}", t_find, t_decode);
+            dmtxMessageDestroy(&msg);
+            count++;
+        }
+        dmtxRegionDestroy(&reg);
+    }
+
+    json_append(buf, &len, cap, "],\"total_ms\":%.3f}", now_ms() - t_start);
+    mapped_image_delete(src);
+}
+
+/* worker thread: take files until none are left */
+static void *batch_worker(void *arg)
+{
+    batch_job *job = (batch_job *)arg;
+    DmtxDecode *dec = NULL;
+    DmtxTrace *trace = NULL;
+    size_t cap = 4096;
+    char *line = (char *)malloc(cap);
+
+    pthread_mutex_lock(&job->lock);
+    if (job->traces != NULL)
+    {
+        trace = job->traces[job->next_worker];
+    }
+    job->next_worker++;
+    pthread_mutex_unlock(&job->lock);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&job->lock);
+        int idx = job->next_file++;
+        pthread_mutex_unlock(&job->lock);
+        if (idx >= job->file_count)
+        {
+            break;
+        }
+
+        decode_file(job, job->files[idx], &dec, trace, &line, &cap);
+
+        pthread_mutex_lock(&job->lock);
+        fputs(line, stdout);
+        fputc('\n', stdout);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    if (dec != NULL)
+    {
+        dmtxDecodeDestroy(&dec);
+    }
+    free(line);
+    return NULL;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-j workers] [-m max-symbols] [-t timeout-ms] [-s scale] [-T trace.json] [-H | -R] file|pattern ...\n", program);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt, i, workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    batch_job job;
+    glob_t matches;
+    pthread_t *threads;
+    double t_start = now_ms();
+    const char *trace_name = NULL;
+
+    memset(&job, 0, sizeof(job));
+    job.max_symbols = 1;
+    job.scale = 1;
+
+    while ((opt = getopt(argc, argv, "j:m:t:s:T:HR")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            workers = atoi(optarg);
+            break;
+        case 'm':
+            job.max_symbols = atoi(optarg);
+            break;
+        case 't':
+            job.timeout_ms = atoi(optarg);
+            break;
+        case 's':
+            job.scale = atoi(optarg);
+            break;
+        case 'T':
+            trace_name = optarg;
+            break;
+        case 'H':
+            job.detector = DmtxDetectorHough;
+            break;
+        case 'R':
+            job.detector = DmtxDetectorRuns;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc || workers < 1 || job.max_symbols < 1 || job.scale < 1)
+    {
+        usage(argv[0]);
+    }
+
+    // 展开所有参数, 没有匹配的参数按普通文件名处理, 之后加载时报错
+    memset(&matches, 0, sizeof(matches));
+    for (i = optind; i < argc; i++)
+    {
+        glob(argv[i], GLOB_NOCHECK | ((i > optind) ? GLOB_APPEND : 0), NULL, &matches);
+    }
+    job.files = matches.gl_pathv;
+    job.file_count = (int)matches.gl_pathc;
+    pthread_mutex_init(&job.lock, NULL);
+
+    if (workers > job.file_count)
+    {
+        workers = job.file_count;
+    }
+    threads = (pthread_t *)malloc(workers * sizeof(pthread_t));
+    if (trace_name != NULL)
+    {
+        // 每个线程只写自己的事件环, 无需加锁, 保留最近的 65536 个事件
+        job.traces = (DmtxTrace **)calloc(workers, sizeof(DmtxTrace *));
+        for (i = 0; i < workers; i++)
+        {
+            job.traces[i] = dmtxTraceCreate(1 << 16, i + 1);
+        }
+    }
+    for (i = 0; i < workers; i++)
+    {
+        pthread_create(&threads[i], NULL, batch_worker, &job);
+    }
+    for (i = 0; i < workers; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    fprintf(stderr, "%d files, %d workers, %.1f ms\n", job.file_count, workers, now_ms() - t_start);
+
+    if (job.traces != NULL)
+    {
+        int json_bytes = 0;
+        char *json = dmtxTraceCreateJson(job.traces, workers, &json_bytes);
+        FILE *fp = fopen(trace_name, "wb");
+        if (json == NULL || fp == NULL || fwrite(json, 1, json_bytes, fp) != (size_t)json_bytes)
+        {
+            fprintf(stderr, "can't write trace %s\n", trace_name);
+        }
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+        free(json);
+        for (i = 0; i < workers; i++)
+        {
+            dmtxTraceDestroy(&job.traces[i]);
+        }
+        free(job.traces);
+    }
+
+    free(threads);
+    pthread_mutex_destroy(&job.lock);
+    globfree(&matches);
+    return 0;
+}
@@ -45,6 +45,7 @@ dmtxDecodeCreate(DmtxImage *img, int scale)
    dec->squareDevn = cos(50 * (M_PI/180));
    dec->sizeIdxExpected = DmtxSymbolShapeAuto;
    dec->edgeThresh = 10;
+   dec->houghThreads = 1;
 
    dec->xMin = 0;
    dec->xMax = width - 1;
@@ -57,8 +58,10 @@ dmtxDecodeCreate(DmtxImage *img, int scale)
       free(dec);
       return NULL;
    }
+   dec->cacheSize = width * height;
 
    dec->image = img;
+   dec->channelCount = img->channelCount;
    // 生成的grid尺寸大于img尺寸，以2^n取整
    // 生成grid后，将grid中心以img为大小的区域置为有效区域
    dec->grid = InitScanGrid(dec);
@@ -66,6 +69,60 @@ dmtxDecodeCreate(DmtxImage *img, int scale)
    return dec;
 }
 
+/**
+ * \brief  Point an existing decoder at a new image, keeping its options
+ * \param  dec
+ * \param  img
+ * \return DmtxPass | DmtxFail
+ *
+ * The cache is only reallocated when the new image is larger than the last
+ * one, so one decoder can be reused across a batch of images. The region of
+ * interest is reset to the whole image.
+ */
+extern DmtxPassFail
+dmtxDecodeSetImage(DmtxDecode *dec, DmtxImage *img)
+{
+   int width, height;
+
+   if(dec == NULL || img == NULL)
+      return DmtxFail;
+
+   /* The previous image may already be freed, so size against the cache */
+   width = dmtxImageGetProp(img, DmtxPropWidth) / dec->scale;
+   height = dmtxImageGetProp(img, DmtxPropHeight) / dec->scale;
+
+   if(width * height > dec->cacheSize) {
+      free(dec->cache);
+      dec->cacheSize = 0;
+      dec->cache = (unsigned char *)calloc(width * height, sizeof(unsigned char));
+      if(dec->cache == NULL)
+         return DmtxFail;
+      dec->cacheSize = width * height;
+   }
+   else {
+      memset(dec->cache, 0x00, width * height);
+   }
+
+   dec->image = img;
+   dec->channelCount = img->channelCount;
+   memset(&dec->stats, 0x00, sizeof(DmtxDecodeStats));
+
+   dec->xMin = 0;
+   dec->xMax = width - 1;
+   dec->yMin = 0;
+   dec->yMax = height - 1;
+
+   /* Rebuild the tile cache for the new size with the same settings */
+   if(PreprocessInit(dec, dec->preprocess, dec->colorReduce) == DmtxFail)
+      return DmtxFail;
+
+   dec->grid = InitScanGrid(dec);
+   HoughGridDestroy(&dec->houghGrid);
+   RunListDestroy(&dec->runList);
+
+   return DmtxPass;
+}
+
 /**
  * \brief  Deinitialize decode struct
  * \param  dec
@@ -80,6 +137,19 @@ dmtxDecodeDestroy(DmtxDecode **dec)
    if((*dec)->cache != NULL)
       free((*dec)->cache);
 
+   if((*dec)->trail != NULL)
+      free((*dec)->trail);
+
+   HoughGridDestroy(&(*dec)->houghGrid);
+   RunListDestroy(&(*dec)->runList);
+
+   /* Free the tiles directly, the image may already be gone */
+   if((*dec)->ppTiles != NULL)
+      free((*dec)->ppTiles);
+
+   if((*dec)->ppTileDone != NULL)
+      free((*dec)->ppTileDone);
+
    free(*dec);
 
    *dec = NULL;
@@ -119,6 +189,25 @@ dmtxDecodeSetProp(DmtxDecode *dec, int prop, int value)
       case DmtxPropEdgeThresh:
          dec->edgeThresh = value;
          break;
+      case DmtxPropPreprocess:
+         if(PreprocessInit(dec, value, dec->colorReduce) == DmtxFail)
+            return DmtxFail;
+         break;
+      case DmtxPropColorReduce:
+         if(PreprocessInit(dec, dec->preprocess, value) == DmtxFail)
+            return DmtxFail;
+         break;
+      case DmtxPropDetector:
+         if(value != DmtxDetectorTrail && value != DmtxDetectorHough &&
+               value != DmtxDetectorRuns)
+            return DmtxFail;
+         dec->detector = value;
+         break;
+      case DmtxPropHoughThreads:
+         if(value < 1 || value > DmtxHoughThreadsMax)
+            return DmtxFail;
+         dec->houghThreads = value;
+         break;
       /* Min and Max values arrive unscaled */
       case DmtxPropXmin:
          dec->xMin = value / dec->scale;
@@ -147,6 +236,8 @@ dmtxDecodeSetProp(DmtxDecode *dec, int prop, int value)
 
    /* Reinitialize scangrid in case any inputs changed */
    dec->grid = InitScanGrid(dec);
+   HoughGridDestroy(&dec->houghGrid);
+   RunListDestroy(&dec->runList);
 
    return DmtxPass;
 }
@@ -175,6 +266,16 @@ dmtxDecodeGetProp(DmtxDecode *dec, int prop)
          return dec->sizeIdxExpected;
       case DmtxPropEdgeThresh:
          return dec->edgeThresh;
+      case DmtxPropPreprocess:
+         return dec->preprocess;
+      case DmtxPropColorReduce:
+         return dec->colorReduce;
+      case DmtxPropDetector:
+         return dec->detector;
+      case DmtxPropHoughThreads:
+         return dec->houghThreads;
+      case DmtxPropChannelCount:
+         return dec->channelCount;
       case DmtxPropXmin:
          return dec->xMin;
       case DmtxPropXmax:
@@ -196,6 +297,100 @@ dmtxDecodeGetProp(DmtxDecode *dec, int prop)
    return DmtxUndefined;
 }
 
+/**
+ * \brief  Copy the work counters accumulated since the decoder was created
+ *         or last given a new image
+ * \param  dec
+ * \param  stats Receives the counters
+ * \return DmtxPass | DmtxFail, fail when built with DMTX_NO_DECODE_STATS
+ */
+extern DmtxPassFail
+dmtxDecodeGetStats(DmtxDecode *dec, DmtxDecodeStats *stats)
+{
+   if(dec == NULL || stats == NULL)
+      return DmtxFail;
+
+   *stats = dec->stats;
+
+#ifdef DMTX_NO_DECODE_STATS
+   return DmtxFail;
+#else
+   return DmtxPass;
+#endif
+}
+
+/**
+ * \brief  Send stage events to trace, or stop tracing with NULL
+ * \param  dec
+ * \param  trace Event ring owned by the caller, used only from this thread
+ * \return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+dmtxDecodeSetTrace(DmtxDecode *dec, DmtxTrace *trace)
+{
+   if(dec == NULL)
+      return DmtxFail;
+
+   dec->trace = trace;
+
+   return DmtxPass;
+}
+
+/**
+ * \brief  Mark the start of a decoder stage for statistics and tracing
+ * \param  dec
+ * \param  stage DmtxStatsStage
+ * \param  reg Candidate region, or NULL
+ * \return void
+ */
+static void
+StageBegin(DmtxDecode *dec, int stage, DmtxRegion *reg)
+{
+   DmtxTime now;
+
+#ifdef DMTX_NO_DECODE_STATS
+   if(dec->trace == NULL)
+      return;
+#endif
+
+   now = dmtxTimeNow();
+
+#ifndef DMTX_NO_DECODE_STATS
+   dec->statsBegin[stage] = now;
+#endif
+
+   if(dec->trace != NULL)
+      TraceRecord(dec->trace, now, stage, 'B', reg);
+}
+
+/**
+ * \brief  Mark the end of a decoder stage, adding its time to the stage total
+ * \param  dec
+ * \param  stage DmtxStatsStage
+ * \param  reg Candidate region, or NULL
+ * \return void
+ */
+static void
+StageEnd(DmtxDecode *dec, int stage, DmtxRegion *reg)
+{
+   DmtxTime now;
+
+#ifdef DMTX_NO_DECODE_STATS
+   if(dec->trace == NULL)
+      return;
+#endif
+
+   now = dmtxTimeNow();
+
+#ifndef DMTX_NO_DECODE_STATS
+   dec->stats.stageUsec[stage] += (long)(now.sec - dec->statsBegin[stage].sec) * 1000000L +
+         ((long)now.usec - (long)dec->statsBegin[stage].usec);
+#endif
+
+   if(dec->trace != NULL)
+      TraceRecord(dec->trace, now, stage, 'E', reg);
+}
+
 /**
  * \brief  Returns xxx
  * \param  img
@@ -258,11 +453,412 @@ dmtxDecodeGetPixelValue(DmtxDecode *dec, int x, int y, int channel, int *value)
 
    return correctedPoint; */
 
+   if(dec->ppTiles != NULL) {
+      int tileIdx, tileOffset;
+
+      if(x < 0 || x >= dec->ppWidth || y < 0 || y >= dec->ppHeight ||
+            channel < 0 || channel >= dec->channelCount)
+         return DmtxFail;
+
+      tileIdx = (y / DmtxPreprocessTileSize) * dec->ppTileCols + (x / DmtxPreprocessTileSize);
+
+      /* Tiles are only processed once the scan actually reaches them */
+      if(dec->ppTileDone[tileIdx] == 0)
+         PreprocessTile(dec, x / DmtxPreprocessTileSize, y / DmtxPreprocessTileSize);
+
+      tileOffset = (y % DmtxPreprocessTileSize) * DmtxPreprocessTileSize + (x % DmtxPreprocessTileSize);
+      *value = dec->ppTiles[(tileIdx * DmtxPreprocessTileSize * DmtxPreprocessTileSize + tileOffset) *
+            dec->channelCount + channel];
+
+      return DmtxPass;
+   }
+
    err = dmtxImageGetPixelValue(dec->image, xUnscaled, yUnscaled, channel, value);
 
    return err;
 }
 
+/**
+ * \brief  Select preprocessing steps and color reduction, then (re)allocate the tile cache
+ * \param  dec
+ * \param  preprocess Combination of DmtxPreprocess flags
+ * \param  colorReduce DmtxColorReduce value
+ * \return DmtxPass | DmtxFail
+ *
+ * The processed image is kept in tiles of DmtxPreprocessTileSize square
+ * (scaled) pixels, stored one tile after another so each tile is contiguous.
+ * No tile is computed here; see dmtxDecodeGetPixelValue().
+ */
+static DmtxPassFail
+PreprocessInit(DmtxDecode *dec, int preprocess, int colorReduce)
+{
+   int width, height, tileCount;
+   size_t tileBytes;
+
+   if((preprocess & ~DmtxPreprocessAll) != 0)
+      return DmtxFail;
+
+   if(colorReduce != DmtxColorReduceNone && colorReduce != DmtxColorReduceLuma &&
+         colorReduce != DmtxColorReduceMaxContrast)
+      return DmtxFail;
+
+   if(dec->ppTiles != NULL) {
+      free(dec->ppTiles);
+      dec->ppTiles = NULL;
+   }
+
+   if(dec->ppTileDone != NULL) {
+      free(dec->ppTileDone);
+      dec->ppTileDone = NULL;
+   }
+
+   dec->preprocess = DmtxPreprocessNone;
+   dec->colorReduce = DmtxColorReduceNone;
+   dec->channelCount = dec->image->channelCount;
+   dec->ppLevelsDone = DmtxFalse;
+
+   if(preprocess == DmtxPreprocessNone && colorReduce == DmtxColorReduceNone)
+      return DmtxPass;
+
+   width = dmtxDecodeGetProp(dec, DmtxPropWidth);
+   height = dmtxDecodeGetProp(dec, DmtxPropHeight);
+   dec->ppWidth = width;
+   dec->ppHeight = height;
+   dec->ppTileCols = (width + DmtxPreprocessTileSize - 1) / DmtxPreprocessTileSize;
+   tileCount = dec->ppTileCols * ((height + DmtxPreprocessTileSize - 1) / DmtxPreprocessTileSize);
+   tileBytes = DmtxPreprocessTileSize * DmtxPreprocessTileSize *
+         ((colorReduce == DmtxColorReduceNone) ? dec->image->channelCount : 1);
+
+   dec->ppTiles = (unsigned char *)malloc(tileCount * tileBytes);
+   dec->ppTileDone = (unsigned char *)calloc(tileCount, sizeof(unsigned char));
+   if(dec->ppTiles == NULL || dec->ppTileDone == NULL) {
+      PreprocessInit(dec, DmtxPreprocessNone, DmtxColorReduceNone);
+      return DmtxFail;
+   }
+
+   dec->preprocess = preprocess;
+   dec->colorReduce = colorReduce;
+   if(colorReduce != DmtxColorReduceNone)
+      dec->channelCount = 1;
+
+   return DmtxPass;
+}
+
+/**
+ * \brief  Luma weights for the channels of an image, summing to 256
+ * \param  img
+ * \param  weights Four weights, unused channels get 0
+ * \return DmtxTrue if channels are subtractive (CMYK) and luma must be inverted
+ */
+static DmtxBoolean
+PreprocessLumaWeights(DmtxImage *img, int *weights)
+{
+   int i;
+
+   weights[0] = weights[1] = weights[2] = weights[3] = 0;
+
+   switch(img->pixelPacking) {
+      case DmtxPack16bppRGB:
+      case DmtxPack16bppRGBX:
+      case DmtxPack16bppXRGB:
+      case DmtxPack16bppRGB565:
+      case DmtxPack16bppRGB565LE:
+      case DmtxPack24bppRGB:
+      case DmtxPack32bppRGBX:
+      case DmtxPack32bppXRGB:
+         weights[0] = 77; weights[1] = 150; weights[2] = 29;
+         break;
+      case DmtxPack16bppBGR:
+      case DmtxPack16bppBGRX:
+      case DmtxPack16bppXBGR:
+      case DmtxPack16bppBGR565:
+      case DmtxPack16bppBGR565LE:
+      case DmtxPack24bppBGR:
+      case DmtxPack32bppBGRX:
+      case DmtxPack32bppXBGR:
+         weights[0] = 29; weights[1] = 150; weights[2] = 77;
+         break;
+      case DmtxPack16bppYCbCr:
+      case DmtxPack24bppYCbCr:
+         weights[0] = 256;
+         break;
+      case DmtxPack32bppCMYK:
+         weights[0] = 77; weights[1] = 150; weights[2] = 29; weights[3] = 256;
+         return DmtxTrue;
+      default:
+         for(i = 0; i < img->channelCount; i++)
+            weights[i] = 256 / img->channelCount;
+         weights[0] += 256 - (256 / img->channelCount) * img->channelCount;
+         break;
+   }
+
+   return DmtxFalse;
+}
+
+/**
+ * \brief  Read a block of source pixels, one plane per image channel
+ * \param  dec
+ * \param  x0 Scaled x of the block's first column
+ * \param  y0 Scaled y of the block's first row
+ * \param  size Block width and height
+ * \param  planes Output planes of size * size bytes
+ * \return void
+ *
+ * Coordinates outside the image repeat the nearest edge pixel. Images with
+ * byte-aligned 8-bit channels are read straight from the pixel buffer.
+ */
+static void
+PreprocessGather(DmtxDecode *dec, int x0, int y0, int size, unsigned char planes[][DmtxPreprocessBlockSize])
+{
+   int width, height, channelCount, channel;
+   int i, j, x, y, v, rowOffset;
+   int byteAligned, channelOffset[4];
+   int colOffset[DmtxPreprocessTileSize + 4];
+   DmtxImage *img;
+
+   img = dec->image;
+   width = dmtxDecodeGetProp(dec, DmtxPropWidth);
+   height = dmtxDecodeGetProp(dec, DmtxPropHeight);
+   channelCount = img->channelCount;
+
+   byteAligned = (img->bitsPerPixel % 8 == 0);
+   for(channel = 0; channel < channelCount; channel++) {
+      channelOffset[channel] = img->channelStart[channel] / 8;
+      if(img->bitsPerChannel[channel] != 8 || img->channelStart[channel] % 8 != 0)
+         byteAligned = DmtxFalse;
+   }
+
+   if(byteAligned) {
+      for(i = 0; i < size; i++) {
+         x = max(0, min(width - 1, x0 + i));
+         colOffset[i] = (x * dec->scale) * img->bytesPerPixel;
+      }
+      for(j = 0; j < size; j++) {
+         y = max(0, min(height - 1, y0 + j));
+         rowOffset = dmtxImageGetByteOffset(img, 0, y * dec->scale);
+         for(channel = 0; channel < channelCount; channel++) {
+            const unsigned char *row = img->pxl + rowOffset + channelOffset[channel];
+            unsigned char *plane = planes[channel] + j * size;
+            for(i = 0; i < size; i++)
+               plane[i] = row[colOffset[i]];
+         }
+      }
+      return;
+   }
+
+   for(j = 0; j < size; j++) {
+      y = max(0, min(height - 1, y0 + j));
+      for(i = 0; i < size; i++) {
+         x = max(0, min(width - 1, x0 + i));
+         for(channel = 0; channel < channelCount; channel++) {
+            if(dmtxImageGetPixelValue(img, x * dec->scale, y * dec->scale, channel, &v) == DmtxFail)
+               v = 0;
+            planes[channel][j * size + i] = (unsigned char)v;
+         }
+      }
+   }
+}
+
+/**
+ * \brief  Collapse the gathered channel planes into one
+ * \param  dec
+ * \param  planes Gathered planes, one per image channel
+ * \param  count Pixels per plane
+ * \param  out Reduced plane
+ * \return void
+ *
+ * Both loops run over whole planes with unit stride so the compiler can
+ * vectorize them. DmtxColorReduceMaxContrast keeps the channel with the
+ * widest range over the block.
+ */
+static void
+PreprocessReduce(DmtxDecode *dec, unsigned char planes[][DmtxPreprocessBlockSize], int count, int *out)
+{
+   int i, channel, best, range, bestRange, lo, hi;
+   int w[4];
+   const unsigned char *p0, *p1, *p2, *p3;
+
+   if(dec->colorReduce == DmtxColorReduceMaxContrast) {
+      best = 0;
+      bestRange = -1;
+      for(channel = 0; channel < dec->image->channelCount; channel++) {
+         lo = hi = planes[channel][0];
+         for(i = 1; i < count; i++) {
+            lo = min(lo, planes[channel][i]);
+            hi = max(hi, planes[channel][i]);
+         }
+         range = hi - lo;
+         if(range > bestRange) {
+            bestRange = range;
+            best = channel;
+         }
+      }
+      for(i = 0; i < count; i++)
+         out[i] = planes[best][i];
+      return;
+   }
+
+   /* Unused planes carry zero weight but must still be readable */
+   for(channel = dec->image->channelCount; channel < 4; channel++)
+      memset(planes[channel], 0x00, count);
+
+   p0 = planes[0]; p1 = planes[1]; p2 = planes[2]; p3 = planes[3];
+
+   if(PreprocessLumaWeights(dec->image, w) == DmtxTrue) {
+      for(i = 0; i < count; i++)
+         out[i] = 255 - min(255, (w[0] * p0[i] + w[1] * p1[i] + w[2] * p2[i] + w[3] * p3[i] + 128) >> 8);
+   }
+   else {
+      for(i = 0; i < count; i++)
+         out[i] = (w[0] * p0[i] + w[1] * p1[i] + w[2] * p2[i] + w[3] * p3[i] + 128) >> 8;
+   }
+}
+
+/**
+ * \brief  Find the normalization range of each channel from a sparse sample
+ * \param  dec
+ * \return void
+ *
+ * Levels are taken from the 1st and 99th percentile of every 4th pixel in
+ * both directions. Nearly flat images are left alone rather than stretching
+ * noise across the full range. With color reduction all image channels feed
+ * a single histogram.
+ */
+static void
+PreprocessLevels(DmtxDecode *dec)
+{
+   int width, height, channel, x, y, v, i;
+   int count, target, seen;
+   int histogram[4][256];
+
+   width = dmtxDecodeGetProp(dec, DmtxPropWidth);
+   height = dmtxDecodeGetProp(dec, DmtxPropHeight);
+
+   memset(histogram, 0x00, sizeof(histogram));
+   count = 0;
+
+   for(y = 0; y < height; y += 4) {
+      for(x = 0; x < width; x += 4) {
+         for(channel = 0; channel < dec->image->channelCount; channel++) {
+            if(dmtxImageGetPixelValue(dec->image, x * dec->scale, y * dec->scale, channel, &v) == DmtxPass)
+               histogram[(dec->channelCount == 1) ? 0 : channel][max(0, min(255, v))]++;
+         }
+         count++;
+      }
+   }
+
+   if(dec->channelCount == 1)
+      count *= dec->image->channelCount;
+
+   for(channel = 0; channel < dec->channelCount; channel++) {
+      dec->ppLevels[channel][0] = 0;
+      dec->ppLevels[channel][1] = 255;
+
+      target = count / 100;
+      for(i = 0, seen = 0; i < 256; i++) {
+         seen += histogram[channel][i];
+         if(seen > target) {
+            dec->ppLevels[channel][0] = i;
+            break;
+         }
+      }
+      for(i = 255, seen = 0; i >= 0; i--) {
+         seen += histogram[channel][i];
+         if(seen > target) {
+            dec->ppLevels[channel][1] = i;
+            break;
+         }
+      }
+
+      if(dec->ppLevels[channel][1] - dec->ppLevels[channel][0] < 4) {
+         dec->ppLevels[channel][0] = 0;
+         dec->ppLevels[channel][1] = 255;
+      }
+   }
+
+   dec->ppLevelsDone = DmtxTrue;
+}
+
+/**
+ * \brief  Build one tile: color reduction and enabled preprocessing steps
+ * \param  dec
+ * \param  tileCol
+ * \param  tileRow
+ * \return void
+ *
+ * All steps are fused: a tile plus a 2-pixel border is read from the source
+ * image once, reduced to one channel if requested, smoothed into a small
+ * local buffer, then sharpened and normalized straight into the tile cache.
+ */
+static void
+PreprocessTile(DmtxDecode *dec, int tileCol, int tileRow)
+{
+   enum { T = DmtxPreprocessTileSize, S = DmtxPreprocessTileSize + 4, M = DmtxPreprocessTileSize + 2 };
+   int channelCount, tileIdx;
+   int i, j, channel, v, low, range;
+   int src[S * S], smooth[M * M];
+   unsigned char planes[4][S * S];
+   const int *p;
+   unsigned char *out;
+
+   channelCount = dec->channelCount;
+   tileIdx = tileRow * dec->ppTileCols + tileCol;
+   out = dec->ppTiles + tileIdx * T * T * channelCount;
+
+   if((dec->preprocess & DmtxPreprocessNormalize) && !dec->ppLevelsDone)
+      PreprocessLevels(dec);
+
+   PreprocessGather(dec, tileCol * T - 2, tileRow * T - 2, S, planes);
+
+   for(channel = 0; channel < channelCount; channel++) {
+
+      if(dec->colorReduce != DmtxColorReduceNone) {
+         PreprocessReduce(dec, planes, S * S, src);
+      }
+      else {
+         for(i = 0; i < S * S; i++)
+            src[i] = planes[channel][i];
+      }
+
+      /* 1-2-1 x 1-2-1 binomial, or a plain copy of the inner region */
+      for(j = 0; j < M; j++) {
+         for(i = 0; i < M; i++) {
+            p = &src[(j + 1) * S + (i + 1)];
+            if(dec->preprocess & DmtxPreprocessDenoise)
+               smooth[j * M + i] = (p[-S - 1] + 2 * p[-S] + p[-S + 1] +
+                     2 * p[-1] + 4 * p[0] + 2 * p[1] +
+                     p[S - 1] + 2 * p[S] + p[S + 1] + 8) >> 4;
+            else
+               smooth[j * M + i] = p[0];
+         }
+      }
+
+      if(dec->preprocess & DmtxPreprocessNormalize) {
+         low = dec->ppLevels[channel][0];
+         range = dec->ppLevels[channel][1] - low;
+      }
+      else {
+         low = 0;
+         range = 255;
+      }
+
+      for(j = 0; j < T; j++) {
+         for(i = 0; i < T; i++) {
+            p = &smooth[(j + 1) * M + (i + 1)];
+            v = p[0];
+            /* Unsharp mask: add back the difference from the 3x3 mean */
+            if(dec->preprocess & DmtxPreprocessSharpen)
+               v += (8 * p[0] - (p[-M - 1] + p[-M] + p[-M + 1] + p[-1] +
+                     p[1] + p[M - 1] + p[M] + p[M + 1])) / 8;
+            v = ((v - low) * 255) / range;
+            out[(j * T + i) * channelCount + channel] = (unsigned char)max(0, min(255, v));
+         }
+      }
+   }
+
+   dec->ppTileDone[tileIdx] = 1;
+}
+
 /**
  * \brief  Fill the region covered by the quadrilateral given by (p0,p1,p2,p3) in the cache.
  */
@@ -337,12 +933,17 @@ dmtxDecodeMatrixRegion(DmtxDecode *dec, DmtxRegion *reg, int fix)
    DmtxVector2 topLeft, topRight, bottomLeft, bottomRight;
    DmtxPixelLoc pxTopLeft, pxTopRight, pxBottomLeft, pxBottomRight;
 
+   StageBegin(dec, DmtxStatsStageDecode, reg);
+
    msg = dmtxMessageCreate(reg->sizeIdx, DmtxFormatMatrix);
-   if(msg == NULL)
+   if(msg == NULL) {
+      StageEnd(dec, DmtxStatsStageDecode, reg);
       return NULL;
+   }
 
    if(PopulateArrayFromMatrix(dec, reg, msg) != DmtxPass) {
       dmtxMessageDestroy(&msg);
+      StageEnd(dec, DmtxStatsStageDecode, reg);
       return NULL;
    }
 
@@ -367,7 +968,11 @@ dmtxDecodeMatrixRegion(DmtxDecode *dec, DmtxRegion *reg, int fix)
 
    CacheFillQuad(dec, pxTopLeft, pxTopRight, pxBottomRight, pxBottomLeft);
 
-   return dmtxDecodePopulatedArray(reg->sizeIdx, msg, fix);
+   msg = DecodePopulatedArray(reg->sizeIdx, msg, fix, &dec->stats);
+
+   StageEnd(dec, DmtxStatsStageDecode, reg);
+
+   return msg;
 }
 
 /**
@@ -383,6 +988,22 @@ dmtxDecodeMatrixRegion(DmtxDecode *dec, DmtxRegion *reg, int fix)
 DmtxMessage *
 dmtxDecodePopulatedArray(int sizeIdx, DmtxMessage *msg, int fix)
 {
+   return DecodePopulatedArray(sizeIdx, msg, fix, NULL);
+}
+
+/**
+ * \brief  dmtxDecodePopulatedArray() body, counting Reed-Solomon repairs
+ * \param  sizeIdx
+ * \param  msg
+ * \param  fix
+ * \param  stats Counters to update, or NULL
+ * \return Decoded message (msg pointer) or NULL in case of failure.
+ */
+static DmtxMessage *
+DecodePopulatedArray(int sizeIdx, DmtxMessage *msg, int fix, DmtxDecodeStats *stats)
+{
+   const DmtxSymbolInfo *symbolInfo;
+
    /*
     * Example msg->array indices for a 12x12 datamatrix.
     *  also, the 'L' color (usually black) is defined as 'DmtxModuleOnRGB'
@@ -401,10 +1022,16 @@ dmtxDecodePopulatedArray(int sizeIdx, DmtxMessage *msg, int fix)
     * XX XX XX XX XX XX XX XX XX XX XX XX
     *
     */
-    
-   ModulePlacementEcc200(msg->array, msg->code, sizeIdx, DmtxModuleOnRed | DmtxModuleOnGreen | DmtxModuleOnBlue);
 
-   if(RsDecode(msg->code, sizeIdx, fix) == DmtxFail){
+   symbolInfo = dmtxGetSymbolInfo(sizeIdx);
+   if(symbolInfo == NULL) {
+      dmtxMessageDestroy(&msg);
+      return NULL;
+   }
+
+   ModulePlacementEcc200(msg->array, msg->code, symbolInfo, DmtxModuleOnRed | DmtxModuleOnGreen | DmtxModuleOnBlue);
+
+   if(RsDecode(msg->code, symbolInfo, fix, stats) == DmtxFail){
       dmtxMessageDestroy(&msg);
       msg = NULL;
       return NULL;
@@ -503,7 +1130,7 @@ dmtxDecodeCreateDiagnostic(DmtxDecode *dec, int *totalBytes, int *headerBytes, i
 
    width = dmtxDecodeGetProp(dec, DmtxPropWidth);
    height = dmtxDecodeGetProp(dec, DmtxPropHeight);
-   channelCount = dmtxImageGetProp(dec->image, DmtxPropChannelCount);
+   channelCount = dmtxDecodeGetProp(dec, DmtxPropChannelCount);
 
    style = 1; /* this doesn't mean anything yet */
 
@@ -542,11 +1169,6 @@ dmtxDecodeCreateDiagnostic(DmtxDecode *dec, int *totalBytes, int *headerBytes, i
             rgb[1] = 0;
             rgb[2] = 128;
          }
-         else if(*cache & 0x40) {
-            rgb[0] = 255;
-            rgb[1] = 0;
-            rgb[2] = 0;
-         }
          else {
             shade = (*cache & 0x80) ? 0.0 : 0.7;
             for(i = 0; i < 3; i++) {
@@ -574,6 +1196,7 @@ dmtxDecodeCreateDiagnostic(DmtxDecode *dec, int *totalBytes, int *headerBytes, i
  * \brief  Increment counters used to determine module values
  * \param  img
  * \param  reg
+ * \param  symbolInfo
  * \param  tally
  * \param  xOrigin
  * \param  yOrigin
@@ -583,7 +1206,7 @@ dmtxDecodeCreateDiagnostic(DmtxDecode *dec, int *totalBytes, int *headerBytes, i
  * \return void
  */
 static void
-TallyModuleJumps(DmtxDecode *dec, DmtxRegion *reg, int tally[][24], int xOrigin, int yOrigin, int mapWidth, int mapHeight, DmtxDirection dir)
+TallyModuleJumps(DmtxDecode *dec, DmtxRegion *reg, const DmtxSymbolInfo *symbolInfo, int tally[][24], int xOrigin, int yOrigin, int mapWidth, int mapHeight, DmtxDirection dir)
 {
    int extent, weight;
    int travelStep;
@@ -639,7 +1262,7 @@ TallyModuleJumps(DmtxDecode *dec, DmtxRegion *reg, int tally[][24], int xOrigin,
 
 
       *travel = travelStart;
-      color = ReadModuleColor(dec, reg, symbolRow, symbolCol, reg->sizeIdx, reg->flowBegin.plane);
+      color = ReadModuleColor(dec, reg, symbolRow, symbolCol, symbolInfo, reg->flowBegin.plane);
       tModule = (darkOnLight) ? reg->offColor - color : color - reg->offColor;
 
       statusModule = (travelStep == 1 || (*line & 0x01) == 0) ? DmtxModuleOnRGB : DmtxModuleOff;
@@ -654,7 +1277,7 @@ TallyModuleJumps(DmtxDecode *dec, DmtxRegion *reg, int tally[][24], int xOrigin,
          /* For normal data-bearing modules capture color and decide
             module status based on comparison to previous "known" module */
 
-         color = ReadModuleColor(dec, reg, symbolRow, symbolCol, reg->sizeIdx, reg->flowBegin.plane);
+         color = ReadModuleColor(dec, reg, symbolRow, symbolCol, symbolInfo, reg->flowBegin.plane);
          tModule = (darkOnLight) ? reg->offColor - color : color - reg->offColor;
 
          if(statusPrev == DmtxModuleOnRGB) {
@@ -706,16 +1329,21 @@ PopulateArrayFromMatrix(DmtxDecode *dec, DmtxRegion *reg, DmtxMessage *msg)
    int mapCol, mapRow;
    int colTmp, rowTmp, idx;
    int tally[24][24]; /* Large enough to map largest single region */
+   const DmtxSymbolInfo *symbolInfo;
 
 /* memset(msg->array, 0x00, msg->arraySize); */
 
+   symbolInfo = dmtxGetSymbolInfo(reg->sizeIdx);
+   if(symbolInfo == NULL)
+      return DmtxFail;
+
    /* Capture number of regions present in barcode */
-   xRegionTotal = dmtxGetSymbolAttribute(DmtxSymAttribHorizDataRegions, reg->sizeIdx);
-   yRegionTotal = dmtxGetSymbolAttribute(DmtxSymAttribVertDataRegions, reg->sizeIdx);
+   xRegionTotal = symbolInfo->horizDataRegions;
+   yRegionTotal = symbolInfo->vertDataRegions;
 
    /* Capture region dimensions (not including border modules) */
-   mapWidth = dmtxGetSymbolAttribute(DmtxSymAttribDataRegionCols, reg->sizeIdx);
-   mapHeight = dmtxGetSymbolAttribute(DmtxSymAttribDataRegionRows, reg->sizeIdx);
+   mapWidth = symbolInfo->dataRegionCols;
+   mapHeight = symbolInfo->dataRegionRows;
 
    weightFactor = 2 * (mapHeight + mapWidth + 2);
    assert(weightFactor > 0);
@@ -754,10 +1382,10 @@ PopulateArrayFromMatrix(DmtxDecode *dec, DmtxRegion *reg, DmtxMessage *msg)
          //fprintf(stdout, "libdmtx::PopulateArrayFromMatrix::xOrigin: %d\n", xOrigin);
 
          memset(tally, 0x00, 24 * 24 * sizeof(int));
-         TallyModuleJumps(dec, reg, tally, xOrigin, yOrigin, mapWidth, mapHeight, DmtxDirUp);
-         TallyModuleJumps(dec, reg, tally, xOrigin, yOrigin, mapWidth, mapHeight, DmtxDirLeft);
-         TallyModuleJumps(dec, reg, tally, xOrigin, yOrigin, mapWidth, mapHeight, DmtxDirDown);
-         TallyModuleJumps(dec, reg, tally, xOrigin, yOrigin, mapWidth, mapHeight, DmtxDirRight);
+         TallyModuleJumps(dec, reg, symbolInfo, tally, xOrigin, yOrigin, mapWidth, mapHeight, DmtxDirUp);
+         TallyModuleJumps(dec, reg, symbolInfo, tally, xOrigin, yOrigin, mapWidth, mapHeight, DmtxDirLeft);
+         TallyModuleJumps(dec, reg, symbolInfo, tally, xOrigin, yOrigin, mapWidth, mapHeight, DmtxDirDown);
+         TallyModuleJumps(dec, reg, symbolInfo, tally, xOrigin, yOrigin, mapWidth, mapHeight, DmtxDirRight);
 
          /* Decide module status based on final tallies */
          for(mapRow = 0; mapRow < mapHeight; mapRow++) {
@@ -169,6 +169,7 @@ dmtxEncodeDataMatrix(DmtxEncode *enc, int inputSize, unsigned char *inputString)
    int sizeIdx;
    int width, height, bitsPerPixel;
    unsigned char *pxl;
+   const DmtxSymbolInfo *symbolInfo;
    DmtxByte outputStorage[4096];
    DmtxByteList output = dmtxByteListBuild(outputStorage, sizeof(outputStorage));
    DmtxByteList input = dmtxByteListBuild(inputString, inputSize);
@@ -187,11 +188,12 @@ dmtxEncodeDataMatrix(DmtxEncode *enc, int inputSize, unsigned char *inputString)
    assert(sizeIdx != DmtxSymbolSquareAuto && sizeIdx != DmtxSymbolRectAuto);
 
    /* XXX we can remove a lot of this redundant data */
+   symbolInfo = dmtxGetSymbolInfo(sizeIdx);
    enc->region.sizeIdx = sizeIdx;
-   enc->region.symbolRows = dmtxGetSymbolAttribute(DmtxSymAttribSymbolRows, sizeIdx);
-   enc->region.symbolCols = dmtxGetSymbolAttribute(DmtxSymAttribSymbolCols, sizeIdx);
-   enc->region.mappingRows = dmtxGetSymbolAttribute(DmtxSymAttribMappingMatrixRows, sizeIdx);
-   enc->region.mappingCols = dmtxGetSymbolAttribute(DmtxSymAttribMappingMatrixCols, sizeIdx);
+   enc->region.symbolRows = symbolInfo->symbolRows;
+   enc->region.symbolCols = symbolInfo->symbolCols;
+   enc->region.mappingRows = symbolInfo->mappingRows;
+   enc->region.mappingCols = symbolInfo->mappingCols;
 
    /* Allocate memory for message and array */
    enc->message = dmtxMessageCreate(sizeIdx, DmtxFormatMatrix);
@@ -199,21 +201,20 @@ dmtxEncodeDataMatrix(DmtxEncode *enc, int inputSize, unsigned char *inputString)
    memcpy(enc->message->code, output.b, output.length);
 
    /* Generate error correction codewords */
-   RsEncode(enc->message, enc->region.sizeIdx);
+   RsEncode(enc->message, symbolInfo);
 
    /* Module placement in region */
    ModulePlacementEcc200(enc->message->array, enc->message->code,
-         enc->region.sizeIdx, DmtxModuleOnRGB);
+         symbolInfo, DmtxModuleOnRGB);
 
    width = 2 * enc->marginSize + (enc->region.symbolCols * enc->moduleSize);
    height = 2 * enc->marginSize + (enc->region.symbolRows * enc->moduleSize);
    bitsPerPixel = GetBitsPerPixel(enc->pixelPacking);
    if(bitsPerPixel == DmtxUndefined)
       return DmtxFail;
-   assert(bitsPerPixel % 8 == 0);
 
-   /* Allocate memory for the image to be generated */
-   pxl = (unsigned char *)malloc((width * bitsPerPixel / 8 + enc->rowPadBytes) * height);
+   /* Allocate memory for the image to be generated (1-bpp rows are packed) */
+   pxl = (unsigned char *)malloc(((width * bitsPerPixel + 7) / 8 + enc->rowPadBytes) * height);
    if(pxl == NULL) {
       perror("pixel malloc error");
       return DmtxFail;
@@ -237,142 +238,220 @@ dmtxEncodeDataMatrix(DmtxEncode *enc, int inputSize, unsigned char *inputString)
 /**
  * \brief  Convert message into Data Mosaic image
  *
- *  1) count how many codewords it would take to encode the whole thing
- *  2) take ceiling N of codeword count divided by 3
- *  3) using minimum symbol size that can accomodate N codewords:
- *  4) create several barcodes over iterations of increasing numbers of
- *     input codewords until you go one too far
- *  5) if codewords remain after filling R, G, and B barcodes then go back
- *     to 3 and try with next larger size
- *  6) take the 3 different images you created and write out a new barcode
+ *  1) find the smallest symbol size whose three planes can hold the input,
+ *     using a binary search over candidate sizes
+ *  2) for a candidate size, binary search the longest input prefix that fits
+ *     the red plane, then the longest that fits the green plane, and check
+ *     that the remainder fits the blue plane
+ *  3) encode and error correct the three planes with the chosen split
+ *  4) place the three codeword streams into one module array and write out
+ *     the new barcode
+ *
+ * Fit tests only generate data codewords, never images, so a size is checked
+ * with O(log inputSize) trial encodes rather than one per prefix length.
  *
  * \param  enc
  * \param  inputSize
  * \param  inputString
- * \param  sizeIdxRequest
  * \return DmtxPass | DmtxFail
  */
 extern DmtxPassFail
 dmtxEncodeDataMosaic(DmtxEncode *enc, int inputSize, unsigned char *inputString)
 {
-   unsigned char *inputStringR, *inputStringG, *inputStringB;
-   int tmpInputSize;
-   int inputSizeR, inputSizeG, inputSizeB;
-   int sizeIdxAttempt, sizeIdxFirst, sizeIdxLast;
+   int plane, split[4];
+   int sizeIdx, sizeIdxFirst, sizeIdxLast, sizeIdxLo, sizeIdxHi;
    int row, col, mappingRows, mappingCols;
-   DmtxEncode *encR, *encG, *encB;
-
-   /* Use 1/3 (ceiling) of inputSize establish input size target */
-   tmpInputSize = (inputSize + 2) / 3;
-   inputSizeR = tmpInputSize;
-   inputSizeG = tmpInputSize;
-   inputSizeB = inputSize - (inputSizeR + inputSizeG);
+   int planeColor[3] = { DmtxModuleOnRed, DmtxModuleOnGreen, DmtxModuleOnBlue };
+   DmtxMessage *planeMessage[3];
+   const DmtxSymbolInfo *symbolInfo;
 
-   inputStringR = inputString;
-   inputStringG = inputStringR + inputSizeR;
-   inputStringB = inputStringG + inputSizeG;
-
-   /* Use 1/3 (floor) of dataWordCount establish first symbol size attempt */
-   sizeIdxFirst = FindSymbolSize(tmpInputSize, enc->sizeIdxRequest);
-   if(sizeIdxFirst == DmtxUndefined)
+   /* Every plane must carry at least one input value */
+   if(inputSize < 3)
       return DmtxFail;
 
-   /* Set the last possible symbol size for this symbol shape or specific size request */
+   /* Set the range of symbol sizes for this symbol shape or specific size request */
    if(enc->sizeIdxRequest == DmtxSymbolSquareAuto)
+   {
+      sizeIdxFirst = 0;
       sizeIdxLast = DmtxSymbolSquareCount - 1;
+   }
    else if(enc->sizeIdxRequest == DmtxSymbolRectAuto)
+   {
+      sizeIdxFirst = DmtxSymbolSquareCount;
       sizeIdxLast = DmtxSymbolSquareCount + DmtxSymbolRectCount - 1;
+   }
    else
-      sizeIdxLast = sizeIdxFirst;
-
-   encR = encG = encB = NULL;
-
-   /* Try increasing symbol sizes until 3 of them can hold all input values */
-   for(sizeIdxAttempt = sizeIdxFirst; sizeIdxAttempt <= sizeIdxLast; sizeIdxAttempt++)
    {
-      dmtxEncodeDestroy(&encR);
-      dmtxEncodeDestroy(&encG);
-      dmtxEncodeDestroy(&encB);
-
-      encR = dmtxEncodeCreate();
-      encG = dmtxEncodeCreate();
-      encB = dmtxEncodeCreate();
+      sizeIdxFirst = sizeIdxLast = enc->sizeIdxRequest;
+   }
 
-      /* Copy all settings from master DmtxEncode, including pointer to image
-         and message, which is initially null */
-      *encR = *encG = *encB = *enc;
+   if(dmtxGetSymbolInfo(sizeIdxFirst) == NULL || dmtxGetSymbolInfo(sizeIdxLast) == NULL)
+      return DmtxFail;
 
-      dmtxEncodeSetProp(encR, DmtxPropSizeRequest, sizeIdxAttempt);
-      dmtxEncodeSetProp(encG, DmtxPropSizeRequest, sizeIdxAttempt);
-      dmtxEncodeSetProp(encB, DmtxPropSizeRequest, sizeIdxAttempt);
+   /* Capacity grows with sizeIdx within a shape, so binary search the smallest fit */
+   sizeIdxLo = sizeIdxFirst;
+   sizeIdxHi = sizeIdxLast + 1;
+   while(sizeIdxLo < sizeIdxHi)
+   {
+      sizeIdx = (sizeIdxLo + sizeIdxHi) / 2;
+      if(MosaicFindSplit(enc, inputSize, inputString, sizeIdx, split) == DmtxPass)
+         sizeIdxHi = sizeIdx;
+      else
+         sizeIdxLo = sizeIdx + 1;
+   }
 
-      /* RED LAYER - Holds temporary copy */
-      dmtxEncodeDataMatrix(encR, inputSizeR, inputStringR);
-      if(encR->region.sizeIdx != sizeIdxAttempt)
+   /* Confirm with the real plane encodes, stepping up if a split fell short */
+   for(sizeIdx = sizeIdxLo; sizeIdx <= sizeIdxLast; sizeIdx++)
+   {
+      if(MosaicFindSplit(enc, inputSize, inputString, sizeIdx, split) == DmtxFail)
          continue;
 
-      /* GREEN LAYER - Holds temporary copy */
-      dmtxEncodeDataMatrix(encG, inputSizeG, inputStringG);
-      if(encG->region.sizeIdx != sizeIdxAttempt)
-         continue;
+      for(plane = 0; plane < 3; plane++)
+         planeMessage[plane] = MosaicEncodePlane(enc, split[plane + 1] - split[plane],
+               inputString + split[plane], sizeIdx);
 
-      /* BLUE LAYER - Holds temporary copy */
-      dmtxEncodeDataMatrix(encB, inputSizeB, inputStringB);
-      if(encB->region.sizeIdx != sizeIdxAttempt)
-         continue;
+      if(planeMessage[0] != NULL && planeMessage[1] != NULL && planeMessage[2] != NULL)
+         break;
 
-      /* If we get this far we found a fit */
-      break;
+      for(plane = 0; plane < 3; plane++)
+         dmtxMessageDestroy(&planeMessage[plane]);
    }
 
-   if(encR == NULL || encG == NULL || encB == NULL)
+   if(sizeIdx > sizeIdxLast)
+      return DmtxFail;
+
+   /* Perform the red portion of the final encode to set internals correctly */
+   dmtxEncodeSetProp(enc, DmtxPropSizeRequest, sizeIdx);
+   if(dmtxEncodeDataMatrix(enc, split[1], inputString) == DmtxFail)
    {
-      dmtxEncodeDestroy(&encR);
-      dmtxEncodeDestroy(&encG);
-      dmtxEncodeDestroy(&encB);
+      for(plane = 0; plane < 3; plane++)
+         dmtxMessageDestroy(&planeMessage[plane]);
       return DmtxFail;
    }
 
-   /* Now we have the correct sizeIdxAttempt, and they all fit into the desired size */
+   /* Zero out the array and overwrite the bits one plane at a time */
+   symbolInfo = dmtxGetSymbolInfo(sizeIdx);
+   mappingRows = symbolInfo->mappingRows;
+   mappingCols = symbolInfo->mappingCols;
+   memset(enc->message->array, 0x00, sizeof(unsigned char) * mappingRows * mappingCols);
 
-   /* Perform the red portion of the final encode to set internals correctly */
-   dmtxEncodeSetProp(enc, DmtxPropSizeRequest, sizeIdxAttempt);
-   dmtxEncodeDataMatrix(enc, inputSizeR, inputStringR);
+   for(plane = 0; plane < 3; plane++)
+   {
+      ModulePlacementEcc200(enc->message->array, planeMessage[plane]->code,
+            symbolInfo, planeColor[plane]);
+
+      /* Reset DmtxModuleAssigned and DMX_MODULE_VISITED bits */
+      for(row = 0; row < mappingRows; row++) {
+         for(col = 0; col < mappingCols; col++) {
+            enc->message->array[row*mappingCols+col] &= (0xff ^ (DmtxModuleAssigned | DmtxModuleVisited));
+         }
+      }
 
-   /* Zero out the array and overwrite the bits in 3 passes */
-   mappingRows = dmtxGetSymbolAttribute(DmtxSymAttribMappingMatrixRows, sizeIdxAttempt);
-   mappingCols = dmtxGetSymbolAttribute(DmtxSymAttribMappingMatrixCols, sizeIdxAttempt);
-   memset(enc->message->array, 0x00, sizeof(unsigned char) *
-         enc->region.mappingRows * enc->region.mappingCols);
+      dmtxMessageDestroy(&planeMessage[plane]);
+   }
 
-   ModulePlacementEcc200(enc->message->array, encR->message->code, sizeIdxAttempt, DmtxModuleOnRed);
+   PrintPattern(enc);
 
-   /* Reset DmtxModuleAssigned and DMX_MODULE_VISITED bits */
-   for(row = 0; row < mappingRows; row++) {
-      for(col = 0; col < mappingCols; col++) {
-         enc->message->array[row*mappingCols+col] &= (0xff ^ (DmtxModuleAssigned | DmtxModuleVisited));
-      }
-   }
+   return DmtxPass;
+}
 
-   ModulePlacementEcc200(enc->message->array, encG->message->code, sizeIdxAttempt, DmtxModuleOnGreen);
+/**
+ * \brief  Test whether input fits a single plane of a given symbol size
+ * \param  enc
+ * \param  inputSize
+ * \param  inputString
+ * \param  sizeIdx
+ * \return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+MosaicPlaneFits(DmtxEncode *enc, int inputSize, unsigned char *inputString, int sizeIdx)
+{
+   DmtxByte outputStorage[4096];
+   DmtxByteList output = dmtxByteListBuild(outputStorage, sizeof(outputStorage));
+   DmtxByteList input = dmtxByteListBuild(inputString, inputSize);
+
+   input.length = inputSize;
+
+   return (EncodeDataCodewords(&input, &output, sizeIdx, enc->scheme,
+         enc->fnc1) == sizeIdx) ? DmtxPass : DmtxFail;
+}
+
+/**
+ * \brief  Split input into red, green, and blue planes for a given symbol size
+ * \param  enc
+ * \param  inputSize
+ * \param  inputString
+ * \param  sizeIdx
+ * \param  split Receives plane boundaries: plane N holds [split[N],split[N+1])
+ * \return DmtxPass | DmtxFail
+ *
+ * Red and green are filled greedily with the longest prefix that fits, found
+ * by binary search, and whatever remains must fit blue.
+ */
+static DmtxPassFail
+MosaicFindSplit(DmtxEncode *enc, int inputSize, unsigned char *inputString, int sizeIdx, int *split)
+{
+   int plane, lo, hi, mid;
 
-   /* Reset DmtxModuleAssigned and DMX_MODULE_VISITED bits */
-   for(row = 0; row < mappingRows; row++) {
-      for(col = 0; col < mappingCols; col++) {
-         enc->message->array[row*mappingCols+col] &= (0xff ^ (DmtxModuleAssigned | DmtxModuleVisited));
+   split[0] = 0;
+
+   for(plane = 0; plane < 2; plane++)
+   {
+      /* Leave at least one input value for each remaining plane */
+      lo = 0;
+      hi = inputSize - split[plane] - (2 - plane);
+
+      while(lo < hi)
+      {
+         mid = (lo + hi + 1) / 2;
+         if(MosaicPlaneFits(enc, mid, inputString + split[plane], sizeIdx) == DmtxPass)
+            lo = mid;
+         else
+            hi = mid - 1;
       }
+
+      if(lo == 0)
+         return DmtxFail;
+
+      split[plane + 1] = split[plane] + lo;
    }
 
-   ModulePlacementEcc200(enc->message->array, encB->message->code, sizeIdxAttempt, DmtxModuleOnBlue);
+   split[3] = inputSize;
+
+   return MosaicPlaneFits(enc, split[3] - split[2], inputString + split[2], sizeIdx);
+}
+
+/**
+ * \brief  Generate data and error codewords for one Data Mosaic plane
+ * \param  enc
+ * \param  inputSize
+ * \param  inputString
+ * \param  sizeIdx
+ * \return Message holding plane codewords (or NULL if input does not fit)
+ */
+static DmtxMessage *
+MosaicEncodePlane(DmtxEncode *enc, int inputSize, unsigned char *inputString, int sizeIdx)
+{
+   DmtxMessage *message;
+   DmtxByte outputStorage[4096];
+   DmtxByteList output = dmtxByteListBuild(outputStorage, sizeof(outputStorage));
+   DmtxByteList input = dmtxByteListBuild(inputString, inputSize);
 
-   /* Destroy encR, encG, and encB */
-   dmtxEncodeDestroy(&encR);
-   dmtxEncodeDestroy(&encG);
-   dmtxEncodeDestroy(&encB);
+   input.length = inputSize;
 
-   PrintPattern(enc);
+   if(EncodeDataCodewords(&input, &output, sizeIdx, enc->scheme, enc->fnc1) != sizeIdx)
+      return NULL;
 
-   return DmtxPass;
+   message = dmtxMessageCreate(sizeIdx, DmtxFormatMatrix);
+   if(message == NULL)
+      return NULL;
+
+   memcpy(message->code, output.b, output.length);
+
+   if(RsEncode(message, dmtxGetSymbolInfo(sizeIdx)) == DmtxFail)
+      dmtxMessageDestroy(&message);
+
+   return message;
 }
 
 /**
@@ -399,7 +478,7 @@ EncodeDataCodewords(DmtxByteList *input, DmtxByteList *output, int sizeIdxReques
          sizeIdx = EncodeOptimizeBest(input, output, sizeIdxRequest, fnc1);
          break;
       case DmtxSchemeAutoFast:
-         sizeIdx = DmtxUndefined; /* EncodeAutoFast(input, output, sizeIdxRequest, passFail); */
+         sizeIdx = EncodeAutoFast(input, output, sizeIdxRequest, fnc1);
          break;
       default:
          sizeIdx = EncodeSingleScheme(input, output, sizeIdxRequest, scheme, fnc1);
@@ -457,7 +536,7 @@ PrintPattern(DmtxEncode *enc)
          moduleStatus = dmtxSymbolModuleStatus(enc->message,
                enc->region.sizeIdx, symbolRow, symbolCol);
 
-		 if (enc->image->bytesPerPixel == 1)
+		 if (enc->image->channelCount == 1)
 		 {
 			 for(i = pixelRow; i < pixelRow + enc->moduleSize; i++) {
 				for(j = pixelCol; j < pixelCol + enc->moduleSize; j++) {
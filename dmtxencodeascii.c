@@ -188,9 +188,17 @@ EncodeTmpRemainingInAscii(DmtxEncodeStream *stream, DmtxByte *storage,
     * We stopped encoding before attempting to write beyond output boundary so
     * any stream errors are truly unexpected. The passFail status indicates
     * whether output.length can be trusted by the calling function.
+    *
+    * The exception is an extended value (Upper Shift + value) whose second
+    * codeword lands beyond the boundary. The storage is full in that case,
+    * which correctly tells the caller that the remainder does not fit.
     */
 
-   if(streamAscii.status == DmtxStatusInvalid || streamAscii.status == DmtxStatusFatal)
+   if(streamAscii.status == DmtxStatusFatal &&
+         streamAscii.reason == dmtxErrorMessage[DmtxErrorOutOfBounds] &&
+         output.length == output.capacity)
+      *passFail = DmtxPass;
+   else if(streamAscii.status == DmtxStatusInvalid || streamAscii.status == DmtxStatusFatal)
       *passFail = DmtxFail;
    else
       *passFail = DmtxPass;
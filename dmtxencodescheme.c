@@ -110,6 +110,312 @@ EncodeSingleScheme(DmtxByteList *input, DmtxByteList *output, int sizeIdxRequest
    return stream.sizeIdx;
 }
 
+/**
+ * \brief  Encode input in a single pass using the ISO 16022 look-ahead rules
+ * \param  input
+ * \param  output
+ * \param  sizeIdxRequest
+ * \param  fnc1
+ * \return Symbol size index (or DmtxUndefined if encoding failed)
+ *
+ * Unlike EncodeOptimizeBest(), which carries a stream for every possible
+ * scheme state through the whole input, this keeps only the current stream
+ * and asks LookAheadScheme() which scheme to use before each chunk. Results
+ * are not always as compact as the exhaustive search, but are within a few
+ * codewords for typical inputs and cost a fraction of the time.
+ */
+static int
+EncodeAutoFast(DmtxByteList *input, DmtxByteList *output, int sizeIdxRequest, int fnc1)
+{
+   DmtxScheme targetScheme;
+   DmtxEncodeStream stream;
+
+   stream = StreamInit(input, output);
+   stream.fnc1 = fnc1;
+
+   /* 1st FNC1 special case, encode before scheme switch */
+   if (fnc1 != DmtxUndefined && (int)(input->b[0]) == fnc1)
+   {
+      StreamInputAdvanceNext(&stream);
+      AppendValueAscii(&stream, DmtxValueFNC1);
+   }
+
+   /* Continue encoding until complete */
+   while(stream.status == DmtxStatusEncoding)
+   {
+      targetScheme = stream.currentScheme;
+
+      if(StreamInputHasNext(&stream))
+      {
+         targetScheme = LookAheadScheme(input, stream.inputNext, stream.currentScheme, fnc1);
+
+         /* Schemes that reject some values fall back to ASCII for this chunk */
+         if(AutoFastChunkFits(&stream, targetScheme) == DmtxFalse)
+            targetScheme = DmtxSchemeAscii;
+      }
+
+      EncodeNextChunk(&stream, targetScheme, DmtxEncodeNormal, sizeIdxRequest);
+   }
+
+   /* Verify encoding completed and all inputs were consumed */
+   if(stream.status != DmtxStatusComplete || StreamInputHasNext(&stream))
+      return DmtxUndefined;
+
+   return stream.sizeIdx;
+}
+
+/**
+ * Look-ahead costs are tracked in 12ths of a codeword so that C40/Text/X12
+ * (2/3 per value) and EDIFACT (3/4 per value) accumulate exactly.
+ */
+#define DmtxLookAheadUnit     12
+#define LookAheadCeil(c)      (((c) + DmtxLookAheadUnit - 1) / DmtxLookAheadUnit)
+
+/**
+ * \brief  Choose next encodation scheme per ISO 16022 Annex P look-ahead test
+ * \param  input
+ * \param  inputNext Index of first input value not yet encoded
+ * \param  currentScheme
+ * \param  fnc1
+ * \return Scheme that should encode the next chunk
+ *
+ * Only six running counters are kept and the scan stops as soon as one scheme
+ * is ahead by a clear margin, which for typical input happens within a few
+ * values of inputNext.
+ */
+static DmtxScheme
+LookAheadScheme(DmtxByteList *input, int inputNext, DmtxScheme currentScheme, int fnc1)
+{
+   int i, idx, processed;
+   int value;
+   int cost[DmtxSchemeBase256 + 1];
+   int count[DmtxSchemeBase256 + 1];
+   DmtxBoolean isFnc1, isExtended;
+
+   /* Initial costs account for the latch needed to reach each scheme */
+   if(currentScheme == DmtxSchemeAscii)
+   {
+      cost[DmtxSchemeAscii] = 0;
+      cost[DmtxSchemeC40] = cost[DmtxSchemeText] = cost[DmtxSchemeX12] = 12;
+      cost[DmtxSchemeEdifact] = cost[DmtxSchemeBase256] = 15;
+   }
+   else
+   {
+      cost[DmtxSchemeAscii] = 12;
+      cost[DmtxSchemeC40] = cost[DmtxSchemeText] = cost[DmtxSchemeX12] = 24;
+      cost[DmtxSchemeEdifact] = cost[DmtxSchemeBase256] = 27;
+      cost[currentScheme] = 0;
+   }
+
+   for(idx = inputNext; ; idx++)
+   {
+      for(i = DmtxSchemeAscii; i <= DmtxSchemeBase256; i++)
+         count[i] = LookAheadCeil(cost[i]);
+
+      /* End of data: pick the cheapest scheme, ties resolved in spec order */
+      if(idx == input->length)
+      {
+         if(count[DmtxSchemeAscii] <= min(min(count[DmtxSchemeC40], count[DmtxSchemeText]),
+               min(count[DmtxSchemeX12], min(count[DmtxSchemeEdifact], count[DmtxSchemeBase256]))))
+            return DmtxSchemeAscii;
+         if(LookAheadLeads(count, DmtxSchemeBase256, 0))
+            return DmtxSchemeBase256;
+         if(LookAheadLeads(count, DmtxSchemeEdifact, 0))
+            return DmtxSchemeEdifact;
+         if(LookAheadLeads(count, DmtxSchemeText, 0))
+            return DmtxSchemeText;
+         if(LookAheadLeads(count, DmtxSchemeX12, 0))
+            return DmtxSchemeX12;
+         return DmtxSchemeC40;
+      }
+
+      processed = idx - inputNext;
+
+      /* After at least 4 values, stop as soon as one scheme is clearly ahead */
+      if(processed >= 4)
+      {
+         if(LookAheadLeads(count, DmtxSchemeAscii, 1))
+            return DmtxSchemeAscii;
+         if(count[DmtxSchemeBase256] < count[DmtxSchemeAscii] ||
+               LookAheadLeads(count, DmtxSchemeBase256, 1))
+            return DmtxSchemeBase256;
+         if(LookAheadLeads(count, DmtxSchemeEdifact, 1))
+            return DmtxSchemeEdifact;
+         if(LookAheadLeads(count, DmtxSchemeText, 1))
+            return DmtxSchemeText;
+         if(LookAheadLeads(count, DmtxSchemeX12, 1))
+            return DmtxSchemeX12;
+         if(count[DmtxSchemeC40] + 1 < min(min(count[DmtxSchemeAscii], count[DmtxSchemeBase256]),
+               min(count[DmtxSchemeEdifact], count[DmtxSchemeText])))
+         {
+            if(count[DmtxSchemeC40] < count[DmtxSchemeX12])
+               return DmtxSchemeC40;
+
+            if(count[DmtxSchemeC40] == count[DmtxSchemeX12])
+            {
+               /* Prefer X12 only if an X12 terminator follows the native run */
+               for(i = idx; i < input->length; i++)
+               {
+                  value = input->b[i];
+                  if(value == 13 || value == '*' || value == '>')
+                     return DmtxSchemeX12;
+                  if(!IsNativeX12(value))
+                     break;
+               }
+               return DmtxSchemeC40;
+            }
+         }
+      }
+
+      value = input->b[idx];
+      isFnc1 = (fnc1 != DmtxUndefined && value == fnc1) ? DmtxTrue : DmtxFalse;
+      isExtended = (value > 127 && isFnc1 == DmtxFalse) ? DmtxTrue : DmtxFalse;
+
+      /* ASCII: digit pairs share a codeword, extended values need Upper Shift */
+      if(isFnc1 == DmtxFalse && value >= '0' && value <= '9')
+      {
+         cost[DmtxSchemeAscii] += 6;
+      }
+      else
+      {
+         cost[DmtxSchemeAscii] = LookAheadCeil(cost[DmtxSchemeAscii]) * DmtxLookAheadUnit;
+         cost[DmtxSchemeAscii] += (isExtended == DmtxTrue) ? 24 : 12;
+      }
+
+      /* C40 and Text: 1 value if native, 2 if shifted, 4 if extended */
+      if(isExtended == DmtxTrue)
+      {
+         cost[DmtxSchemeC40] += 32;
+         cost[DmtxSchemeText] += 32;
+      }
+      else
+      {
+         cost[DmtxSchemeC40] += (isFnc1 == DmtxFalse && IsNativeC40(value)) ? 8 : 16;
+         cost[DmtxSchemeText] += (isFnc1 == DmtxFalse && IsNativeText(value)) ? 8 : 16;
+      }
+
+      /* X12 and EDIFACT: anything non-native forces a round trip to ASCII */
+      if(isFnc1 == DmtxFalse && IsNativeX12(value))
+         cost[DmtxSchemeX12] += 8;
+      else
+         cost[DmtxSchemeX12] += (isExtended == DmtxTrue) ? 52 : 40;
+
+      if(isFnc1 == DmtxFalse && IsNativeEdifact(value))
+         cost[DmtxSchemeEdifact] += 9;
+      else
+         cost[DmtxSchemeEdifact] += (isExtended == DmtxTrue) ? 51 : 39;
+
+      /* Base 256: one codeword per value, FNC1 requires unlatch and relatch */
+      cost[DmtxSchemeBase256] += (isFnc1 == DmtxTrue) ? 48 : 12;
+   }
+}
+
+/**
+ * \brief  Test whether one scheme's rounded cost beats every other scheme
+ * \param  count Rounded codeword counts indexed by scheme
+ * \param  scheme
+ * \param  margin Extra codewords the scheme must win by
+ * \return DmtxTrue | DmtxFalse
+ */
+static DmtxBoolean
+LookAheadLeads(int *count, DmtxScheme scheme, int margin)
+{
+   int i;
+
+   for(i = DmtxSchemeAscii; i <= DmtxSchemeBase256; i++)
+   {
+      if(i != (int)scheme && count[scheme] + margin >= count[i])
+         return DmtxFalse;
+   }
+
+   return DmtxTrue;
+}
+
+/**
+ * \brief  Verify scheme can encode the next chunk without invalidating stream
+ * \param  stream
+ * \param  scheme
+ * \return DmtxTrue | DmtxFalse
+ */
+static DmtxBoolean
+AutoFastChunkFits(DmtxEncodeStream *stream, DmtxScheme scheme)
+{
+   int i, value, chunkEnd;
+
+   switch(scheme)
+   {
+      case DmtxSchemeX12:
+         /* X12 only writes full triplets, so all 3 values must be native */
+         chunkEnd = min(stream->inputNext + 3, stream->input->length);
+         for(i = stream->inputNext; i < chunkEnd; i++)
+         {
+            value = stream->input->b[i];
+            if(!IsNativeX12(value) || (stream->fnc1 != DmtxUndefined && value == stream->fnc1))
+               return DmtxFalse;
+         }
+         break;
+      case DmtxSchemeEdifact:
+         value = stream->input->b[stream->inputNext];
+         if(!IsNativeEdifact(value) || (stream->fnc1 != DmtxUndefined && value == stream->fnc1))
+            return DmtxFalse;
+         break;
+      case DmtxSchemeBase256:
+         /* FNC1 is only representable in ASCII */
+         value = stream->input->b[stream->inputNext];
+         if(stream->fnc1 != DmtxUndefined && value == stream->fnc1)
+            return DmtxFalse;
+         break;
+      default:
+         /* ASCII, C40, and Text can represent any value */
+         break;
+   }
+
+   return DmtxTrue;
+}
+
+/**
+ *
+ *
+ */
+static DmtxBoolean
+IsNativeC40(int value)
+{
+   return (value == ' ' || (value >= '0' && value <= '9') ||
+         (value >= 'A' && value <= 'Z')) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ *
+ *
+ */
+static DmtxBoolean
+IsNativeText(int value)
+{
+   return (value == ' ' || (value >= '0' && value <= '9') ||
+         (value >= 'a' && value <= 'z')) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ *
+ *
+ */
+static DmtxBoolean
+IsNativeX12(int value)
+{
+   return (value == 13 || value == '*' || value == '>' ||
+         IsNativeC40(value) == DmtxTrue) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ *
+ *
+ */
+static DmtxBoolean
+IsNativeEdifact(int value)
+{
+   return (value >= 32 && value <= 94) ? DmtxTrue : DmtxFalse;
+}
+
 /**
  * This function distributes work to the equivalent scheme-specific
  * implementation.
@@ -0,0 +1,1375 @@
+/**
+ * libdmtx - Data Matrix Encoding/Decoding Library
+ * Copyright 2010 Mike Laughton. All rights reserved.
+ *
+ * See LICENSE file in the main project directory for full
+ * terms of use and distribution.
+ *
+ * Contact: Mike Laughton <mike@dragonflylogic.com>
+ *
+ * \file dmtxhough.c
+ * \brief Detect barcode regions from tile Hough transforms
+ *
+ * Selected with DmtxPropDetector = DmtxDetectorHough. Thinned Sobel edges
+ * of the whole image vote into a line transform per tile, and tiles whose
+ * lines run along two crossing directions become candidates. Each candidate
+ * is grown along those directions until its edges stop, every side is then
+ * fitted on its own so perspective is kept, and the corners go through the
+ * same size and calibration checks as trail blazed regions. Modules need to
+ * be well under a third of a tile wide, so very large symbols should be
+ * searched with DmtxPropScale.
+ */
+
+/**
+ * \brief  Find next barcode region with the Hough detector
+ * \param  dec Pointer to DmtxDecode information struct
+ * \param  timeout Pointer to timeout time (NULL if none)
+ * \return Detected region (if found)
+ */
+static DmtxRegion *
+HoughRegionFindNext(DmtxDecode *dec, DmtxTime *timeout)
+{
+   DmtxHoughGrid *grid;
+   DmtxRegion *reg;
+
+   if(dec->houghGrid == NULL) {
+      dec->houghGrid = HoughGridCreate(dec);
+      if(dec->houghGrid == NULL)
+         return NULL;
+   }
+   grid = dec->houghGrid;
+
+   while(grid->tileNext < grid->tileCount) {
+      STATS_ADD(&dec->stats, gridPopped, 1);
+
+      reg = HoughRegionScanTile(dec, grid, &(grid->tiles[grid->tileNext++]));
+      if(reg != NULL)
+         return reg;
+
+      /* Ran out of time? */
+      if(timeout != NULL && dmtxTimeExceeded(*timeout))
+         break;
+   }
+
+   return NULL;
+}
+
+/**
+ * \brief  Compute edges and candidate tiles for the decoder's image
+ * \param  dec
+ * \return Populated grid, or NULL if out of memory
+ */
+static DmtxHoughGrid *
+HoughGridCreate(DmtxDecode *dec)
+{
+   int i, col, row, cols, rows;
+   int xExtent, yExtent, stride;
+   DmtxHoughGrid *grid;
+   DmtxHoughTile *tile;
+
+   grid = (DmtxHoughGrid *)calloc(1, sizeof(DmtxHoughGrid));
+   if(grid == NULL)
+      return NULL;
+
+   grid->width = dmtxDecodeGetProp(dec, DmtxPropWidth);
+   grid->height = dmtxDecodeGetProp(dec, DmtxPropHeight);
+
+   for(i = 0; i < DmtxHoughPhiExtent; i++) {
+      grid->cosPhi[i] = cos(i * (M_PI/DmtxHoughPhiExtent));
+      grid->sinPhi[i] = sin(i * (M_PI/DmtxHoughPhiExtent));
+   }
+
+   /* Tiles overlap by half so a small symbol always lands inside one */
+   stride = DmtxHoughLocalSize/2;
+   xExtent = dec->xMax - dec->xMin + 1;
+   yExtent = dec->yMax - dec->yMin + 1;
+   cols = (xExtent <= DmtxHoughLocalSize) ? 1 : (xExtent - DmtxHoughLocalSize + stride - 1)/stride + 1;
+   rows = (yExtent <= DmtxHoughLocalSize) ? 1 : (yExtent - DmtxHoughLocalSize + stride - 1)/stride + 1;
+
+   grid->tiles = (DmtxHoughTile *)calloc(cols * rows, sizeof(DmtxHoughTile));
+   grid->edgePhi = (unsigned char *)malloc(grid->width * grid->height);
+   if(dec->channelCount > 1)
+      grid->edgePlane = (unsigned char *)calloc(grid->width * grid->height, 1);
+   if(grid->tiles == NULL || grid->edgePhi == NULL ||
+         (dec->channelCount > 1 && grid->edgePlane == NULL)) {
+      HoughGridDestroy(&grid);
+      return NULL;
+   }
+   memset(grid->edgePhi, DmtxHoughNoEdge, grid->width * grid->height);
+
+   for(row = 0; row < rows; row++) {
+      for(col = 0; col < cols; col++) {
+         tile = &(grid->tiles[grid->tileCount]);
+         tile->order = grid->tileCount++;
+         tile->xOrigin = min(dec->xMin + col * stride, dec->xMax + 1 - DmtxHoughLocalSize);
+         tile->yOrigin = min(dec->yMin + row * stride, dec->yMax + 1 - DmtxHoughLocalSize);
+         tile->xOrigin = max(tile->xOrigin, dec->xMin);
+         tile->yOrigin = max(tile->yOrigin, dec->yMin);
+      }
+   }
+
+   if(HoughGridBuild(dec, grid) == DmtxFail) {
+      HoughGridDestroy(&grid);
+      return NULL;
+   }
+
+   HoughMerge(grid);
+
+   return grid;
+}
+
+/**
+ * \brief  Release Hough detector state
+ * \param  grid
+ * \return void
+ */
+static void
+HoughGridDestroy(DmtxHoughGrid **grid)
+{
+   if(grid == NULL || *grid == NULL)
+      return;
+
+   free((*grid)->edgePhi);
+   free((*grid)->edgePlane);
+   free((*grid)->tiles);
+   free(*grid);
+
+   *grid = NULL;
+}
+
+/**
+ * \brief  Run the edge and tile passes, on several threads if allowed
+ * \param  dec
+ * \param  grid Grid with its tiles laid out
+ * \return DmtxPass | DmtxFail
+ *
+ * Row bands and tiles are independent within a pass, so they are handed out
+ * one at a time to whichever thread asks next. Without pthreads, or with
+ * DmtxPropHoughThreads at 1, the calling thread does every chunk itself.
+ */
+static DmtxPassFail
+HoughGridBuild(DmtxDecode *dec, DmtxHoughGrid *grid)
+{
+   int i, size, bands, workerCount;
+   int tileCol, tileRow;
+   DmtxHoughBuild build;
+   DmtxHoughWorker *workers;
+   DmtxPassFail passFail;
+#ifdef HAVE_PTHREAD
+   int started;
+   pthread_t threads[DmtxHoughThreadsMax];
+
+   workerCount = dec->houghThreads;
+#else
+   workerCount = 1;
+#endif
+
+   memset(&build, 0x00, sizeof(DmtxHoughBuild));
+   build.dec = dec;
+   build.grid = grid;
+
+   /* Same scale as the flow magnitude tested by dmtxRegionScanPixel() */
+   build.thresh = (int)(dec->edgeThresh * 7.65 + 0.5);
+   build.thresh *= build.thresh;
+
+   /* Narrowest corner angle that dmtxRegionUpdateCorners() would accept */
+   build.phiDiffMin = (int)((90.0 - acos(dec->squareDevn) * (180.0/M_PI)) *
+         (DmtxHoughPhiExtent/180.0));
+   build.phiDiffMin = max(build.phiDiffMin, 10);
+
+   bands = (dec->yMax - dec->yMin + DmtxHoughBandRows) / DmtxHoughBandRows;
+   build.chunkCount[DmtxHoughPassRead] = bands;
+   build.chunkCount[DmtxHoughPassSobel] = bands;
+   build.chunkCount[DmtxHoughPassThin] = bands;
+   build.chunkCount[DmtxHoughPassScore] = grid->tileCount;
+
+   size = grid->width * grid->height;
+   build.pixels = (unsigned char *)calloc(size * dec->channelCount, 1);
+   build.gx = (int *)calloc(size, sizeof(int));
+   build.gy = (int *)calloc(size, sizeof(int));
+   build.mag = (int *)calloc(size, sizeof(int));
+   workers = (DmtxHoughWorker *)calloc(workerCount, sizeof(DmtxHoughWorker));
+
+   passFail = (build.pixels == NULL || build.gx == NULL || build.gy == NULL ||
+         build.mag == NULL || workers == NULL) ? DmtxFail : DmtxPass;
+
+   for(i = 0; passFail == DmtxPass && i < workerCount; i++) {
+      workers[i].build = &build;
+      workers[i].rowGx = (int *)malloc(grid->width * sizeof(int));
+      workers[i].rowGy = (int *)malloc(grid->width * sizeof(int));
+      workers[i].rowMag = (int *)malloc(grid->width * sizeof(int));
+      if(workers[i].rowGx == NULL || workers[i].rowGy == NULL || workers[i].rowMag == NULL)
+         passFail = DmtxFail;
+   }
+
+   if(passFail == DmtxPass) {
+      /* Lazy preprocessing writes to the decoder, so finish it up front */
+      if(dec->ppTiles != NULL && workerCount > 1) {
+         for(tileRow = dec->yMin / DmtxPreprocessTileSize; tileRow <= dec->yMax / DmtxPreprocessTileSize; tileRow++) {
+            for(tileCol = dec->xMin / DmtxPreprocessTileSize; tileCol <= dec->xMax / DmtxPreprocessTileSize; tileCol++) {
+               if(dec->ppTileDone[tileRow * dec->ppTileCols + tileCol] == 0)
+                  PreprocessTile(dec, tileCol, tileRow);
+            }
+         }
+      }
+
+#ifdef HAVE_PTHREAD
+      pthread_mutex_init(&build.lock, NULL);
+      pthread_cond_init(&build.passDone, NULL);
+
+      for(started = 1; started < workerCount; started++) {
+         if(pthread_create(&threads[started], NULL, HoughWorkerThread, &workers[started]) != 0)
+            break;
+      }
+#endif
+
+      /* Calling thread takes chunks too, and does them all if no thread started */
+      HoughWorkerRun(&workers[0]);
+
+#ifdef HAVE_PTHREAD
+      for(i = 1; i < started; i++)
+         pthread_join(threads[i], NULL);
+
+      pthread_cond_destroy(&build.passDone);
+      pthread_mutex_destroy(&build.lock);
+#endif
+   }
+
+   for(i = 0; workers != NULL && i < workerCount; i++) {
+      free(workers[i].rowGx);
+      free(workers[i].rowGy);
+      free(workers[i].rowMag);
+   }
+   free(workers);
+   free(build.pixels);
+   free(build.gx);
+   free(build.gy);
+   free(build.mag);
+
+   return passFail;
+}
+
+#ifdef HAVE_PTHREAD
+/**
+ * \brief  Thread entry point for HoughWorkerRun()
+ * \param  worker
+ * \return NULL
+ */
+static void *
+HoughWorkerThread(void *worker)
+{
+   HoughWorkerRun((DmtxHoughWorker *)worker);
+
+   return NULL;
+}
+#endif
+
+/**
+ * \brief  Take chunks of every pass in turn until the grid is built
+ * \param  worker
+ * \return void
+ */
+static void
+HoughWorkerRun(DmtxHoughWorker *worker)
+{
+   int pass, chunk;
+   DmtxHoughBuild *build;
+
+   build = worker->build;
+
+   for(pass = 0; pass < DmtxHoughPassCount; pass++) {
+      while((chunk = HoughClaimChunk(build, pass)) != DmtxUndefined) {
+         switch(pass) {
+            case DmtxHoughPassRead:
+               HoughReadBand(build, chunk);
+               break;
+            case DmtxHoughPassSobel:
+               SobelBand(worker, chunk);
+               break;
+            case DmtxHoughPassThin:
+               SobelThinBand(build, chunk);
+               break;
+            case DmtxHoughPassScore:
+               HoughScoreTile(worker, &(build->grid->tiles[chunk]));
+               break;
+         }
+         HoughFinishChunk(build, pass);
+      }
+
+      /* Next pass reads what neighboring chunks of this one wrote */
+      HoughWaitPass(build, pass);
+   }
+}
+
+/**
+ * \brief  Claim the next unstarted chunk of a pass
+ * \param  build
+ * \param  pass
+ * \return Chunk index, or DmtxUndefined once all are taken
+ */
+static int
+HoughClaimChunk(DmtxHoughBuild *build, int pass)
+{
+   int chunk;
+
+#ifdef HAVE_PTHREAD
+   pthread_mutex_lock(&build->lock);
+#endif
+   chunk = DmtxUndefined;
+   if(build->chunkNext[pass] < build->chunkCount[pass])
+      chunk = build->chunkNext[pass]++;
+#ifdef HAVE_PTHREAD
+   pthread_mutex_unlock(&build->lock);
+#endif
+
+   return chunk;
+}
+
+/**
+ * \brief  Record a finished chunk, waking waiters after the last one
+ * \param  build
+ * \param  pass
+ * \return void
+ */
+static void
+HoughFinishChunk(DmtxHoughBuild *build, int pass)
+{
+#ifdef HAVE_PTHREAD
+   pthread_mutex_lock(&build->lock);
+   if(++build->chunkDone[pass] == build->chunkCount[pass])
+      pthread_cond_broadcast(&build->passDone);
+   pthread_mutex_unlock(&build->lock);
+#else
+   build->chunkDone[pass]++;
+#endif
+}
+
+/**
+ * \brief  Block until every chunk of a pass is finished
+ * \param  build
+ * \param  pass
+ * \return void
+ */
+static void
+HoughWaitPass(DmtxHoughBuild *build, int pass)
+{
+#ifdef HAVE_PTHREAD
+   pthread_mutex_lock(&build->lock);
+   while(build->chunkDone[pass] < build->chunkCount[pass])
+      pthread_cond_wait(&build->passDone, &build->lock);
+   pthread_mutex_unlock(&build->lock);
+#else
+   assert(build->chunkDone[pass] == build->chunkCount[pass]);
+#endif
+}
+
+/**
+ * \brief  Copy one row band into the per channel pixel planes
+ * \param  build
+ * \param  band
+ * \return void
+ *
+ * Reads go through dmtxDecodeGetPixelValue() so scale and preprocessing are
+ * honored.
+ */
+static void
+HoughReadBand(DmtxHoughBuild *build, int band)
+{
+   int x, y, yEnd, plane, value, size;
+   DmtxDecode *dec;
+   unsigned char *row;
+
+   dec = build->dec;
+   size = build->grid->width * build->grid->height;
+   y = dec->yMin + band * DmtxHoughBandRows;
+   yEnd = min(y + DmtxHoughBandRows, dec->yMax + 1);
+
+   for(; y < yEnd; y++) {
+      for(plane = 0; plane < dec->channelCount; plane++) {
+         row = build->pixels + plane * size + y * build->grid->width;
+         for(x = dec->xMin; x <= dec->xMax; x++) {
+            if(dmtxDecodeGetPixelValue(dec, x, y, plane, &value) == DmtxPass)
+               row[x] = (unsigned char)value;
+         }
+      }
+   }
+}
+
+/**
+ * \brief  Gradient of the strongest plane over one row band
+ * \param  worker
+ * \param  band
+ * \return void
+ *
+ * Each plane goes through SobelRow() whole, and later planes replace the
+ * gradient where their magnitude is strictly larger.
+ */
+static void
+SobelBand(DmtxHoughWorker *worker, int band)
+{
+   int x, y, yEnd, plane, idx, count, size, width;
+   DmtxDecode *dec;
+   DmtxHoughBuild *build;
+   unsigned char *edgePlane;
+
+   build = worker->build;
+   dec = build->dec;
+   width = build->grid->width;
+   size = width * build->grid->height;
+   y = max(dec->yMin + band * DmtxHoughBandRows, dec->yMin + 1);
+   yEnd = min(dec->yMin + (band + 1) * DmtxHoughBandRows, dec->yMax);
+   count = dec->xMax - dec->xMin - 1;
+
+   for(; y < yEnd && count > 0; y++) {
+      idx = y * width + dec->xMin + 1;
+      SobelRow(build->pixels + idx, width, count, build->gx + idx, build->gy + idx, build->mag + idx);
+
+      for(plane = 1; plane < dec->channelCount; plane++) {
+         SobelRow(build->pixels + plane * size + idx, width, count,
+               worker->rowGx, worker->rowGy, worker->rowMag);
+
+         edgePlane = build->grid->edgePlane + idx;
+         for(x = 0; x < count; x++) {
+            if(worker->rowMag[x] > build->mag[idx + x]) {
+               build->gx[idx + x] = worker->rowGx[x];
+               build->gy[idx + x] = worker->rowGy[x];
+               build->mag[idx + x] = worker->rowMag[x];
+               edgePlane[x] = (unsigned char)plane;
+            }
+         }
+      }
+   }
+}
+
+/**
+ * \brief  3x3 Sobel gradient along part of one row of a single plane
+ * \param  p First pixel, with a readable neighbor on every side
+ * \param  width Plane row length
+ * \param  count Pixels to compute
+ * \param  gx
+ * \param  gy
+ * \param  mag Squared magnitude
+ * \return void
+ *
+ * Kept free of branches and strided reads so compilers vectorize it.
+ */
+static void
+SobelRow(const unsigned char *p, int width, int count, int *gx, int *gy, int *mag)
+{
+   int x;
+   const unsigned char *up, *down;
+
+   up = p - width;
+   down = p + width;
+
+   for(x = 0; x < count; x++) {
+      gx[x] = (up[x + 1] + 2 * p[x + 1] + down[x + 1]) - (up[x - 1] + 2 * p[x - 1] + down[x - 1]);
+      gy[x] = (down[x - 1] + 2 * down[x] + down[x + 1]) - (up[x - 1] + 2 * up[x] + up[x + 1]);
+      mag[x] = gx[x] * gx[x] + gy[x] * gy[x];
+   }
+}
+
+/**
+ * \brief  Keep thinned edges of one row band
+ * \param  build
+ * \param  band
+ * \return void
+ *
+ * Pixels that reach the decoder's edge threshold and are not outranked by
+ * either neighbor across the edge record the angle of their gradient.
+ */
+static void
+SobelThinBand(DmtxHoughBuild *build, int band)
+{
+   int x, y, yEnd, idx, width;
+   int gx, gy, mag, magPrev, magNext;
+   int ax, ay, step;
+   double phi;
+   DmtxDecode *dec;
+
+   dec = build->dec;
+   width = build->grid->width;
+   y = max(dec->yMin + band * DmtxHoughBandRows, dec->yMin + 2);
+   yEnd = min(dec->yMin + (band + 1) * DmtxHoughBandRows, dec->yMax - 1);
+
+   for(; y < yEnd; y++) {
+      for(x = dec->xMin + 2; x < dec->xMax - 1; x++) {
+         idx = y * width + x;
+         mag = build->mag[idx];
+         if(mag < build->thresh)
+            continue;
+
+         gx = build->gx[idx];
+         gy = build->gy[idx];
+         ax = abs(gx);
+         ay = abs(gy);
+
+         /* tan(22.5 degrees) ~= 53/128 */
+         if(ay * 128 <= ax * 53)
+            step = 1;
+         else if(ax * 128 <= ay * 53)
+            step = width;
+         else if((gx > 0) == (gy > 0))
+            step = width + 1;
+         else
+            step = width - 1;
+
+         magPrev = build->mag[idx - step];
+         magNext = build->mag[idx + step];
+         if(mag < magPrev || mag <= magNext)
+            continue;
+
+         phi = atan2((double)gy, (double)gx);
+         if(phi < 0.0)
+            phi += M_PI;
+         build->grid->edgePhi[idx] = (unsigned char)((int)(phi * (DmtxHoughPhiExtent/M_PI) + 0.5) % DmtxHoughPhiExtent);
+      }
+   }
+}
+
+/**
+ * \brief  Score a tile by its two strongest crossing line directions
+ * \param  worker
+ * \param  tile
+ * \return void
+ *
+ * Tiles left with a score under DmtxHoughLocalSize/2 are dropped by
+ * HoughMerge().
+ */
+static void
+HoughScoreTile(DmtxHoughWorker *worker, DmtxHoughTile *tile)
+{
+   int i, j, x, y, idx;
+   int score, xSum, ySum, count;
+   int planeCount[4];
+   DmtxHoughGrid *grid;
+   DmtxVanishPointSort vPoints;
+
+   grid = worker->build->grid;
+
+   worker->line.xOrigin = tile->xOrigin;
+   worker->line.yOrigin = tile->yOrigin;
+   LineHoughAccumulate(&(worker->line), grid);
+
+   vPoints = FindVanishPoints(&(worker->line));
+
+   /* Best pair is the one whose weaker direction is strongest */
+   tile->score = 0;
+   for(i = 0; i < vPoints.count; i++) {
+      for(j = i + 1; j < vPoints.count; j++) {
+         if(PhiDiff(vPoints.bucket[i].phi, vPoints.bucket[j].phi) < worker->build->phiDiffMin)
+            continue;
+
+         score = min(vPoints.bucket[i].val, vPoints.bucket[j].val);
+         if(score > tile->score) {
+            tile->score = score;
+            tile->vanish[0] = vPoints.bucket[i];
+            tile->vanish[1] = vPoints.bucket[j];
+         }
+      }
+   }
+
+   if(tile->score < DmtxHoughLocalSize/2)
+      return;
+
+   /* Seed at the centroid of edges along either direction */
+   xSum = ySum = count = 0;
+   memset(planeCount, 0x00, sizeof(planeCount));
+   for(y = tile->yOrigin; y < tile->yOrigin + DmtxHoughLocalSize && y < grid->height; y++) {
+      for(x = tile->xOrigin; x < tile->xOrigin + DmtxHoughLocalSize && x < grid->width; x++) {
+         idx = y * grid->width + x;
+         if(grid->edgePhi[idx] == DmtxHoughNoEdge)
+            continue;
+         if(PhiDiff(grid->edgePhi[idx], tile->vanish[0].phi) > 4 &&
+               PhiDiff(grid->edgePhi[idx], tile->vanish[1].phi) > 4)
+            continue;
+
+         xSum += x;
+         ySum += y;
+         count++;
+         if(grid->edgePlane != NULL)
+            planeCount[grid->edgePlane[idx]]++;
+      }
+   }
+
+   if(count == 0) {
+      tile->score = 0;
+      return;
+   }
+
+   tile->seed.X = xSum / count;
+   tile->seed.Y = ySum / count;
+
+   tile->plane = 0;
+   for(i = 1; i < 4; i++) {
+      if(planeCount[i] > planeCount[tile->plane])
+         tile->plane = i;
+   }
+}
+
+/**
+ * \brief  Gather the scored tiles into one candidate list, strongest first
+ * \param  grid
+ * \return void
+ *
+ * Tiles were scored independently and in any order; their image position
+ * breaks ties, so the list is the same however many threads scored them.
+ */
+static void
+HoughMerge(DmtxHoughGrid *grid)
+{
+   int t, kept;
+
+   for(t = 0, kept = 0; t < grid->tileCount; t++) {
+      if(grid->tiles[t].score >= DmtxHoughLocalSize/2)
+         grid->tiles[kept++] = grid->tiles[t];
+   }
+
+   grid->tileCount = kept;
+   grid->tileNext = 0;
+
+   qsort(grid->tiles, grid->tileCount, sizeof(DmtxHoughTile), HoughTileCompare);
+}
+
+/**
+ * \brief  Order tiles by descending score, then by position
+ */
+static int
+HoughTileCompare(const void *a, const void *b)
+{
+   const DmtxHoughTile *tileA = (const DmtxHoughTile *)a;
+   const DmtxHoughTile *tileB = (const DmtxHoughTile *)b;
+
+   if(tileA->score != tileB->score)
+      return (tileA->score > tileB->score) ? -1 : 1;
+
+   return tileA->order - tileB->order;
+}
+
+/**
+ * \brief  Accumulate line votes from the edges of one tile
+ * \param  line Transform with xOrigin and yOrigin already set
+ * \param  grid
+ * \return void
+ *
+ * Each edge votes for angles within a few buckets of its own gradient
+ * angle, which is as far as a 3x3 Sobel can be trusted.
+ */
+static void
+LineHoughAccumulate(DmtxHoughLocal *line, DmtxHoughGrid *grid)
+{
+   int x, y, xEnd, yEnd;
+   int phi, phiEdge, dInt;
+   unsigned char *edgePhi;
+
+   memset(line->bucket, 0x00, sizeof(line->bucket));
+
+   xEnd = min(line->xOrigin + DmtxHoughLocalSize, grid->width);
+   yEnd = min(line->yOrigin + DmtxHoughLocalSize, grid->height);
+
+   for(y = line->yOrigin; y < yEnd; y++) {
+      edgePhi = grid->edgePhi + y * grid->width;
+      for(x = line->xOrigin; x < xEnd; x++) {
+         if(edgePhi[x] == DmtxHoughNoEdge)
+            continue;
+
+         for(phiEdge = edgePhi[x] - 2; phiEdge <= edgePhi[x] + 2; phiEdge++) {
+            phi = (phiEdge + DmtxHoughPhiExtent) % DmtxHoughPhiExtent;
+            dInt = (int)HoughGetLocalOffset(grid, x - line->xOrigin, y - line->yOrigin, phi);
+            dInt = max(0, min(DmtxHoughDExtent - 1, dInt));
+            line->bucket[dInt][phi]++;
+         }
+      }
+   }
+}
+
+/**
+ * \brief  Line offset of a tile point, compacted so every angle spans the
+ *         full range of d
+ * \param  grid
+ * \param  xLoc Tile relative location
+ * \param  yLoc
+ * \param  phi
+ * \return Offset from 0 to DmtxHoughDExtent
+ */
+static double
+HoughGetLocalOffset(DmtxHoughGrid *grid, double xLoc, double yLoc, int phi)
+{
+   double sinPhi, cosPhi;
+
+   cosPhi = grid->cosPhi[phi];
+   sinPhi = grid->sinPhi[phi];
+
+   if(phi <= DmtxHoughPhiExtent/2)
+      return (xLoc * cosPhi + yLoc * sinPhi) / (sinPhi + cosPhi);
+
+   return ((xLoc * cosPhi + yLoc * sinPhi) - (cosPhi * DmtxHoughLocalSize)) / (sinPhi - cosPhi);
+}
+
+/**
+ * \brief  Insert a maxima magnitude, keeping the strongest few in order
+ * \param  sort
+ * \param  maximaMag
+ * \return void
+ */
+static void
+AddToMaximaSort(DmtxHoughMaximaSort *sort, int maximaMag)
+{
+   int i;
+
+   if(sort->count == DmtxHoughMaximaSortMax) {
+      if(maximaMag <= sort->mag[sort->count - 1])
+         return;
+      sort->count--;
+   }
+
+   for(i = sort->count; i > 0 && sort->mag[i - 1] < maximaMag; i--)
+      sort->mag[i] = sort->mag[i - 1];
+
+   sort->mag[i] = maximaMag;
+   sort->count++;
+}
+
+/**
+ * \brief  Strength of one angle as the sum of its strongest line maxima
+ * \param  line
+ * \param  phi
+ * \return Bucket holding phi and the sum
+ *
+ * Parallel module edges make several strong, separate maxima where a single
+ * stray line or texture does not.
+ */
+static DmtxHoughBucket
+GetAngleSumAtPhi(DmtxHoughLocal *line, int phi)
+{
+   int i, d;
+   int prev, here, next;
+   DmtxHoughBucket bucket;
+   DmtxHoughMaximaSort sort;
+
+   memset(&sort, 0x00, sizeof(DmtxHoughMaximaSort));
+
+   for(d = 0; d < DmtxHoughDExtent; d++) {
+      prev = (d > 0) ? line->bucket[d - 1][phi] : 0;
+      here = line->bucket[d][phi];
+      next = (d < DmtxHoughDExtent - 1) ? line->bucket[d + 1][phi] : 0;
+
+      if(here > 0 && here >= prev && here > next)
+         AddToMaximaSort(&sort, here);
+   }
+
+   bucket.d = 0;
+   bucket.phi = phi;
+   bucket.val = 0;
+   for(i = 0; i < sort.count; i++)
+      bucket.val += sort.mag[i];
+
+   return bucket;
+}
+
+/**
+ * \brief  Insert a direction, keeping the strongest and only one per angle
+ * \param  sort
+ * \param  bucket
+ * \return void
+ */
+static void
+AddToVanishPointSort(DmtxVanishPointSort *sort, DmtxHoughBucket bucket)
+{
+   int i, startHere;
+   DmtxBoolean isFull;
+   DmtxHoughBucket *lastBucket;
+
+   isFull = (sort->count == DmtxVanishSortMax) ? DmtxTrue : DmtxFalse;
+   lastBucket = &(sort->bucket[DmtxVanishSortMax - 1]);
+
+   /* Array is full and incoming bucket is already weakest */
+   if(isFull && bucket.val < lastBucket->val)
+      return;
+
+   startHere = DmtxUndefined;
+
+   /* If sort already has entry near this angle then either:
+    *   a) Overwrite the old one without shifting if stronger
+    *   b) Reject the new one completely if weaker
+    */
+   for(i = 0; i < sort->count; i++) {
+      if(PhiDiff(bucket.phi, sort->bucket[i].phi) < 10) {
+         if(bucket.val < sort->bucket[i].val)
+            return;
+
+         sort->bucket[i] = bucket;
+         startHere = i;
+         break;
+      }
+   }
+
+   if(startHere == DmtxUndefined) {
+      if(isFull)
+         *lastBucket = bucket;
+      else
+         sort->bucket[sort->count++] = bucket;
+
+      startHere = sort->count - 1;
+   }
+
+   /* Shift weak entries downward */
+   for(i = startHere; i > 0 && bucket.val > sort->bucket[i-1].val; i--) {
+      sort->bucket[i] = sort->bucket[i-1];
+      sort->bucket[i-1] = bucket;
+   }
+}
+
+/**
+ * \brief  Strongest line directions of a tile transform
+ * \param  line
+ * \return Directions, strongest first
+ */
+static DmtxVanishPointSort
+FindVanishPoints(DmtxHoughLocal *line)
+{
+   int phi;
+   DmtxVanishPointSort sort;
+
+   memset(&sort, 0x00, sizeof(DmtxVanishPointSort));
+
+   for(phi = 0; phi < DmtxHoughPhiExtent; phi++)
+      AddToVanishPointSort(&sort, GetAngleSumAtPhi(line, phi));
+
+   return sort;
+}
+
+/**
+ * \brief  Distance between two line angles, which wrap at 180 degrees
+ */
+static int
+PhiDiff(int phi0, int phi1)
+{
+   int phiDiff;
+
+   phiDiff = abs(phi0 - phi1) % DmtxHoughPhiExtent;
+
+   return (phiDiff <= DmtxHoughPhiExtent/2) ? phiDiff : DmtxHoughPhiExtent - phiDiff;
+}
+
+/**
+ * \brief  Fit a region to the two directions of a candidate tile
+ * \param  dec
+ * \param  grid
+ * \param  tile
+ * \return Detected region (if any)
+ */
+static DmtxRegion *
+HoughRegionScanTile(DmtxDecode *dec, DmtxHoughGrid *grid, DmtxHoughTile *tile)
+{
+   int i;
+   unsigned char *cache;
+   DmtxHoughFrame frame;
+   DmtxRay2 side[4];
+   DmtxVector2 corner[4], vTmp0, vTmp1;
+   DmtxPixelLoc px[4];
+   DmtxRegion reg;
+   DmtxPassFail passFail;
+
+   /* Seed already covered by a decoded (or returned) region */
+   cache = dmtxDecodeGetCache(dec, tile->seed.X, tile->seed.Y);
+   if(cache == NULL || (int)(*cache & 0x80) != 0x00) {
+      STATS_ADD(&dec->stats, gridSkipped, 1);
+      return NULL;
+   }
+
+   STATS_ADD(&dec->stats, edgeHits, 1);
+
+   memset(&reg, 0x00, sizeof(DmtxRegion));
+   reg.flowBegin.plane = tile->plane;
+   reg.flowBegin.arrive = dmtxNeighborNone;
+   reg.flowBegin.loc = tile->seed;
+   reg.traceId = dec->traceRegions++;
+
+   /* Measure extent along both directions */
+   StageBegin(dec, DmtxStatsStageOrient, &reg);
+   passFail = HoughFindExtents(grid, tile, &frame);
+   StageEnd(dec, DmtxStatsStageOrient, &reg);
+   if(passFail == DmtxFail) {
+      STATS_ADD(&dec->stats, orientationFails, 1);
+      return NULL;
+   }
+
+   /* Fit sides in order around the region: low and high offsets along each normal */
+   StageBegin(dec, DmtxStatsStageFit, &reg);
+   for(i = 0; i < 4 && passFail == DmtxPass; i++)
+      passFail = HoughFitSide(dec, grid, &frame, i, &reg, &side[i]);
+   for(i = 0; i < 4 && passFail == DmtxPass; i++)
+      passFail = dmtxRay2Intersect(&corner[i], &side[i], &side[(i + 1) & 0x03]);
+   StageEnd(dec, DmtxStatsStageFit, &reg);
+   if(passFail == DmtxFail)
+      return NULL;
+
+   /* Corners must turn counterclockwise for dmtxRegionUpdateCorners() */
+   dmtxVector2Sub(&vTmp0, &corner[1], &corner[0]);
+   dmtxVector2Sub(&vTmp1, &corner[2], &corner[1]);
+   if(dmtxVector2Cross(&vTmp0, &vTmp1) < 0.0) {
+      vTmp0 = corner[1];
+      corner[1] = corner[3];
+      corner[3] = vTmp0;
+   }
+
+   /* Any corner may hold the finder L, the size check tells them apart */
+   StageBegin(dec, DmtxStatsStageSize, &reg);
+   for(i = 0, passFail = DmtxFail; i < 4 && passFail == DmtxFail; i++) {
+      passFail = dmtxRegionUpdateCorners(dec, &reg, corner[i], corner[(i + 1) & 0x03],
+            corner[(i + 2) & 0x03], corner[(i + 3) & 0x03]);
+      if(passFail == DmtxPass)
+         passFail = MatrixRegionFindSize(dec, &reg);
+   }
+   StageEnd(dec, DmtxStatsStageSize, &reg);
+   if(passFail == DmtxFail)
+      return NULL;
+
+   CALLBACK_MATRIX(&reg);
+
+   /* Keep later tiles of the same symbol from fitting it again */
+   for(i = 0; i < 4; i++) {
+      px[i].X = (int)(corner[i].X + 0.5);
+      px[i].Y = (int)(corner[i].Y + 0.5);
+   }
+   CacheFillQuad(dec, px[0], px[1], px[2], px[3]);
+
+   /* Found a valid matrix region */
+   return dmtxRegionCreate(&reg);
+}
+
+/**
+ * \brief  Grow a candidate from its tile until edges along both directions
+ *         give way to a quiet zone
+ * \param  grid
+ * \param  tile
+ * \param  frame Receives the directions, extents, and module pitch
+ * \return DmtxPass | DmtxFail
+ *
+ * Edges are projected onto each direction's normal inside the current
+ * window. Walking outward from the seed, the extent ends at the first empty
+ * run longer than about one and a half modules. A side that runs into the
+ * window grows it by half a tile, so symbols larger than a tile are covered
+ * after a few rounds.
+ */
+static DmtxPassFail
+HoughFindExtents(DmtxHoughGrid *grid, DmtxHoughTile *tile, DmtxHoughFrame *frame)
+{
+   int i, other, iter;
+   int histLen, histCap, seedBin, minCount;
+   int first, last;
+   int *hist;
+   double seed[2], winLo[2], winHi[2];
+   double extLo[2], extHi[2], span, pitch;
+   DmtxBoolean changed;
+
+   for(i = 0; i < 2; i++) {
+      frame->phi[i] = tile->vanish[i].phi;
+      frame->n[i].X = grid->cosPhi[frame->phi[i]];
+      frame->n[i].Y = grid->sinPhi[frame->phi[i]];
+      seed[i] = tile->seed.X * frame->n[i].X + tile->seed.Y * frame->n[i].Y;
+      winLo[i] = seed[i] - DmtxHoughLocalSize/2;
+      winHi[i] = seed[i] + DmtxHoughLocalSize/2;
+      extLo[i] = extHi[i] = seed[i];
+      frame->pitch[i] = 0.0;
+      frame->gap[i] = DmtxHoughLocalSize/2;
+   }
+   frame->det = frame->n[0].X * frame->n[1].Y - frame->n[0].Y * frame->n[1].X;
+
+   histCap = 2 * (grid->width + grid->height) + DmtxHoughLocalSize * 2;
+   hist = (int *)malloc(2 * histCap * sizeof(int));
+   if(hist == NULL)
+      return DmtxFail;
+
+   for(iter = 0, changed = DmtxTrue; iter < 16 && changed == DmtxTrue; iter++) {
+      changed = DmtxFalse;
+
+      for(i = 0; i < 2; i++) {
+         other = 1 - i;
+         histLen = (int)(winHi[i] - winLo[i]) + 1;
+         if(histLen > histCap) {
+            free(hist);
+            return DmtxFail;
+         }
+
+         HoughProject(grid, frame, winLo, winHi, i, hist, histLen);
+
+         /* Stray edges in the quiet zone stay below a fraction of a full side */
+         minCount = max(2, (int)((winHi[other] - winLo[other]) / 48.0));
+         seedBin = (int)(seed[i] - winLo[i]);
+
+         if(HoughWalkExtent(hist, histLen, seedBin, frame->gap[i], minCount,
+               hist + histCap, &first, &last, &pitch) == DmtxFail) {
+            free(hist);
+            return DmtxFail;
+         }
+
+         if(winLo[i] + first != extLo[i] || winLo[i] + last + 1 != extHi[i])
+            changed = DmtxTrue;
+
+         extLo[i] = winLo[i] + first;
+         extHi[i] = winLo[i] + last + 1;
+
+         /* Edge runs mark module boundaries, too few of them say nothing */
+         if(pitch > 0.0) {
+            frame->pitch[i] = pitch;
+            frame->gap[i] = max(2, (int)(1.5 * pitch + 1.0));
+         }
+      }
+
+      /* Grow sides that ran into the window, never shrink so the extents settle */
+      for(i = 0; i < 2; i++) {
+         winLo[i] = min(winLo[i], (extLo[i] - winLo[i] <= frame->gap[i]) ?
+               extLo[i] - DmtxHoughLocalSize/2 : extLo[i] - frame->gap[i] - 1);
+         winHi[i] = max(winHi[i], (winHi[i] - extHi[i] <= frame->gap[i]) ?
+               extHi[i] + DmtxHoughLocalSize/2 : extHi[i] + frame->gap[i] + 1);
+      }
+   }
+
+   free(hist);
+
+   for(i = 0; i < 2; i++) {
+      span = extHi[i] - extLo[i];
+      if(span < 8.0 || frame->pitch[i] < 1.0)
+         return DmtxFail;
+
+      frame->lo[i] = extLo[i];
+      frame->hi[i] = extHi[i];
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * \brief  Image location of offsets a and b along a frame's normals
+ */
+static DmtxVector2
+HoughFramePoint(const DmtxHoughFrame *frame, double a, double b)
+{
+   DmtxVector2 p;
+
+   p.X = (a * frame->n[1].Y - b * frame->n[0].Y) / frame->det;
+   p.Y = (b * frame->n[0].X - a * frame->n[1].X) / frame->det;
+
+   return p;
+}
+
+/**
+ * \brief  Histogram of edges along one direction, by offset along its normal
+ * \param  grid
+ * \param  frame
+ * \param  lo Window low offsets along both normals
+ * \param  hi Window high offsets along both normals
+ * \param  dir Direction to project, 0 or 1
+ * \param  hist Receives histLen bins, bin 0 at lo[dir]
+ * \param  histLen
+ * \return void
+ */
+static void
+HoughProject(DmtxHoughGrid *grid, const DmtxHoughFrame *frame, const double *lo,
+      const double *hi, int dir, int *hist, int histLen)
+{
+   int i, x, y, bin;
+   int xMin, xMax, yMin, yMax;
+   int edgePhi;
+   double proj[2];
+   DmtxVector2 p;
+
+   memset(hist, 0x00, histLen * sizeof(int));
+
+   /* Bounding box of the window parallelogram */
+   xMin = grid->width;
+   yMin = grid->height;
+   xMax = yMax = -1;
+   for(i = 0; i < 4; i++) {
+      p = HoughFramePoint(frame, (i & 0x01) ? hi[0] : lo[0], (i & 0x02) ? hi[1] : lo[1]);
+      xMin = min(xMin, (int)floor(p.X));
+      xMax = max(xMax, (int)ceil(p.X));
+      yMin = min(yMin, (int)floor(p.Y));
+      yMax = max(yMax, (int)ceil(p.Y));
+   }
+   xMin = max(xMin, 0);
+   yMin = max(yMin, 0);
+   xMax = min(xMax, grid->width - 1);
+   yMax = min(yMax, grid->height - 1);
+
+   for(y = yMin; y <= yMax; y++) {
+      for(x = xMin; x <= xMax; x++) {
+         edgePhi = grid->edgePhi[y * grid->width + x];
+         if(edgePhi == DmtxHoughNoEdge || PhiDiff(edgePhi, frame->phi[dir]) > 14)
+            continue;
+
+         proj[0] = x * frame->n[0].X + y * frame->n[0].Y;
+         proj[1] = x * frame->n[1].X + y * frame->n[1].Y;
+         if(proj[0] < lo[0] || proj[0] >= hi[0] || proj[1] < lo[1] || proj[1] >= hi[1])
+            continue;
+
+         bin = (int)(proj[dir] - lo[dir]);
+         if(bin >= 0 && bin < histLen)
+            hist[bin]++;
+      }
+   }
+}
+
+/**
+ * \brief  Walk outward from the seed while populated bins keep coming
+ * \param  hist
+ * \param  histLen
+ * \param  seedBin
+ * \param  gap Longest empty run still inside the extent
+ * \param  minCount Fewest edges for a populated bin
+ * \param  spacing Scratch space of histLen bins
+ * \param  first Receives first populated bin
+ * \param  last Receives last populated bin
+ * \param  pitch Receives median distance between populated runs, or 0.0
+ *         if there are too few runs to tell
+ * \return DmtxPass | DmtxFail if nothing is populated near the seed
+ *
+ * Under perspective a single module boundary can break into neighboring
+ * runs and some boundaries are missing altogether, so the median spacing
+ * is used rather than the average.
+ */
+static DmtxPassFail
+HoughWalkExtent(const int *hist, int histLen, int seedBin, int gap, int minCount,
+      int *spacing, int *first, int *last, double *pitch)
+{
+   int i, start, runSum, runWeight, half;
+   int spacingCount;
+   double center, centerPrev;
+
+   for(i = 0, start = DmtxUndefined; i <= gap && start == DmtxUndefined; i++) {
+      if(seedBin + i >= 0 && seedBin + i < histLen && hist[seedBin + i] >= minCount)
+         start = seedBin + i;
+      else if(seedBin - i >= 0 && seedBin - i < histLen && hist[seedBin - i] >= minCount)
+         start = seedBin - i;
+   }
+
+   if(start == DmtxUndefined)
+      return DmtxFail;
+
+   *last = start;
+   for(i = start + 1; i < histLen && i - *last <= gap; i++) {
+      if(hist[i] >= minCount)
+         *last = i;
+   }
+
+   *first = start;
+   for(i = start - 1; i >= 0 && *first - i <= gap; i--) {
+      if(hist[i] >= minCount)
+         *first = i;
+   }
+
+   /* Count spacings between weighted run centers */
+   memset(spacing, 0x00, histLen * sizeof(int));
+   spacingCount = 0;
+   centerPrev = -1.0;
+   runSum = runWeight = 0;
+   for(i = *first; i <= *last + 1; i++) {
+      if(i <= *last && hist[i] >= minCount) {
+         runSum += i * hist[i];
+         runWeight += hist[i];
+      }
+      else if(runWeight > 0) {
+         center = runSum / (double)runWeight;
+         if(centerPrev >= 0.0) {
+            spacing[(int)(center - centerPrev + 0.5)]++;
+            spacingCount++;
+         }
+         centerPrev = center;
+         runSum = runWeight = 0;
+      }
+   }
+
+   *pitch = 0.0;
+   if(spacingCount < 2)
+      return DmtxPass;
+
+   for(i = 0, half = 0; i < histLen; i++) {
+      half += spacing[i];
+      if(2 * half >= spacingCount) {
+         *pitch = (double)i;
+         break;
+      }
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * \brief  Fit one side of a candidate to the first edges met coming in
+ *         from the quiet zone
+ * \param  dec
+ * \param  grid
+ * \param  frame
+ * \param  side 0 and 2 are the low and high sides along n[0], 1 and 3 along n[1]
+ * \param  reg Candidate whose trail holds the sampled points
+ * \param  ray Receives the fitted side
+ * \return DmtxPass | DmtxFail
+ *
+ * Sampling goes a quarter of the symbol inward so a side narrowed by
+ * perspective is still reached.
+ */
+static DmtxPassFail
+HoughFitSide(DmtxDecode *dec, DmtxHoughGrid *grid, const DmtxHoughFrame *frame,
+      int side, DmtxRegion *reg, DmtxRay2 *ray)
+{
+   int dir, other, sign, count, edgePhi;
+   double t, u, uOut, uIn, reach;
+   DmtxVector2 p;
+   DmtxPixelLoc loc;
+
+   dir = side & 0x01;
+   other = 1 - dir;
+   sign = (side < 2) ? -1 : 1;
+
+   reach = max(2.0 * frame->pitch[dir], (frame->hi[dir] - frame->lo[dir]) / 4.0);
+   if(sign > 0) {
+      uOut = frame->hi[dir] + frame->gap[dir];
+      uIn = frame->hi[dir] - reach;
+   }
+   else {
+      uOut = frame->lo[dir] - frame->gap[dir];
+      uIn = frame->lo[dir] + reach;
+   }
+
+   if(TrailReserve(dec, reg, (int)(frame->hi[other] - frame->lo[other]) + 2) == DmtxFail)
+      return DmtxFail;
+
+   count = 0;
+   for(t = frame->lo[other] + frame->pitch[other]/2; t < frame->hi[other] - frame->pitch[other]/2; t += 1.0) {
+      for(u = uOut; (u - uIn) * sign > 0.0; u -= sign * 0.5) {
+         p = (dir == 0) ? HoughFramePoint(frame, u, t) : HoughFramePoint(frame, t, u);
+         loc.X = (int)(p.X + 0.5);
+         loc.Y = (int)(p.Y + 0.5);
+         if(loc.X < 0 || loc.X >= grid->width || loc.Y < 0 || loc.Y >= grid->height)
+            continue;
+
+         edgePhi = grid->edgePhi[loc.Y * grid->width + loc.X];
+         if(edgePhi != DmtxHoughNoEdge && PhiDiff(edgePhi, frame->phi[dir]) <= 20) {
+            reg->trail[count++] = loc;
+            break;
+         }
+      }
+   }
+
+   STATS_ADD(&dec->stats, houghLines, 1);
+
+   return HoughFitLine(reg->trail, count, frame->phi[dir], sign, ray);
+}
+
+/**
+ * \brief  Fit the outermost well supported line near angle phi
+ * \param  points
+ * \param  count
+ * \param  phi Expected normal angle
+ * \param  sign Side of the line facing the quiet zone, 1 along the normal
+ *         or -1 against it
+ * \param  ray Receives the line, unit direction
+ * \return DmtxPass | DmtxFail
+ *
+ * A small Hough search over nearby angles scores each line by the points it
+ * holds less the points left outside it. Points come from the first edge
+ * met from the quiet zone, so a true side has none outside, while a line
+ * through light timing modules, whose first edge lies a module further in,
+ * does. The winner's points are then refined by least squares.
+ */
+static DmtxPassFail
+HoughFitLine(const DmtxPixelLoc *points, int count, int phi, int sign, DmtxRay2 *ray)
+{
+   int i, k, bin, histLen;
+   int best, bestScore, bestCount, inliers, outside, score;
+   int *hist;
+   double xMean, yMean, radius, dx, dy, r;
+   double theta, bestTheta, bestR;
+   double sxx, sxy, syy, angle;
+
+   if(count < 8)
+      return DmtxFail;
+
+   xMean = yMean = 0.0;
+   for(i = 0; i < count; i++) {
+      xMean += points[i].X;
+      yMean += points[i].Y;
+   }
+   xMean /= count;
+   yMean /= count;
+
+   radius = 0.0;
+   for(i = 0; i < count; i++) {
+      dx = points[i].X - xMean;
+      dy = points[i].Y - yMean;
+      radius = max(radius, sqrt(dx * dx + dy * dy));
+   }
+
+   histLen = (int)(2.0 * radius) + 3;
+   hist = (int *)malloc(histLen * sizeof(int));
+   if(hist == NULL)
+      return DmtxFail;
+
+   /* Normal angles within about 22 degrees of phi, in steps of 0.35 degrees */
+   bestScore = bestCount = 0;
+   bestTheta = bestR = 0.0;
+   for(k = -64; k <= 64; k++) {
+      theta = phi * (M_PI/DmtxHoughPhiExtent) + k * (M_PI/512.0);
+      memset(hist, 0x00, histLen * sizeof(int));
+
+      /* Bins run from the quiet zone inward */
+      for(i = 0; i < count; i++) {
+         r = (points[i].X - xMean) * cos(theta) + (points[i].Y - yMean) * sin(theta);
+         bin = (int)(radius - sign * r + 0.5);
+         if(bin >= 0 && bin < histLen)
+            hist[bin]++;
+      }
+
+      for(best = 0, outside = 0; best < histLen - 1; best++) {
+         score = hist[best] + hist[best + 1] - outside;
+         if(score > bestScore) {
+            bestScore = score;
+            bestCount = hist[best] + hist[best + 1];
+            bestTheta = theta;
+            bestR = sign * (radius - best - 0.5);
+         }
+         outside += hist[best];
+      }
+   }
+
+   free(hist);
+
+   if(bestCount < max(8, count/4))
+      return DmtxFail;
+
+   /* Least squares over points near the winning line */
+   inliers = 0;
+   sxx = sxy = syy = dx = dy = 0.0;
+   for(i = 0; i < count; i++) {
+      r = (points[i].X - xMean) * cos(bestTheta) + (points[i].Y - yMean) * sin(bestTheta);
+      if(fabs(r - bestR) > 1.5)
+         continue;
+      dx += points[i].X;
+      dy += points[i].Y;
+      inliers++;
+   }
+   dx /= inliers;
+   dy /= inliers;
+
+   for(i = 0; i < count; i++) {
+      r = (points[i].X - xMean) * cos(bestTheta) + (points[i].Y - yMean) * sin(bestTheta);
+      if(fabs(r - bestR) > 1.5)
+         continue;
+      sxx += (points[i].X - dx) * (points[i].X - dx);
+      sxy += (points[i].X - dx) * (points[i].Y - dy);
+      syy += (points[i].Y - dy) * (points[i].Y - dy);
+   }
+
+   angle = 0.5 * atan2(2.0 * sxy, sxx - syy);
+
+   ray->p.X = dx;
+   ray->p.Y = dy;
+   ray->v.X = cos(angle);
+   ray->v.Y = sin(angle);
+   ray->tMin = 0.0;
+   ray->tMax = 1.0;
+
+   return DmtxPass;
+}
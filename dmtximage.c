@@ -54,6 +54,20 @@
  *     top-to-bottom; use DmtxFlipNone
  */
 
+/**
+ * Lookup tables that stretch 5-bit and 6-bit channel values of 16-bpp images
+ * onto the full 0-255 range, so that pure white reads as 255 rather than 248.
+ */
+static const unsigned char dmtxExpand5to8[32] = {
+     0,   8,  16,  25,  33,  41,  49,  58,  66,  74,  82,  90,  99, 107, 115, 123,
+   132, 140, 148, 156, 165, 173, 181, 189, 197, 206, 214, 222, 230, 239, 247, 255 };
+
+static const unsigned char dmtxExpand6to8[64] = {
+     0,   4,   8,  12,  16,  20,  24,  28,  32,  36,  40,  45,  49,  53,  57,  61,
+    65,  69,  73,  77,  81,  85,  89,  93,  97, 101, 105, 109, 113, 117, 121, 125,
+   130, 134, 138, 142, 146, 150, 154, 158, 162, 166, 170, 174, 178, 182, 186, 190,
+   194, 198, 202, 206, 210, 215, 219, 223, 227, 231, 235, 239, 243, 247, 251, 255 };
+
 /**
  * \brief  XXX
  * \param  XXX
@@ -77,9 +91,9 @@ dmtxImageCreate(unsigned char *pxl, int width, int height, int pack)
    img->height = height;
    img->pixelPacking = pack;  // 图像格式
    img->bitsPerPixel = GetBitsPerPixel(pack);   // 像素比特数
-   img->bytesPerPixel = img->bitsPerPixel/8; // 像素字节数
+   img->bytesPerPixel = img->bitsPerPixel/8; // 像素字节数，1-bpp 图像为 0
    img->rowPadBytes = 0;   // 图像每一行填充的字节数
-   img->rowSizeBytes = img->width * img->bytesPerPixel + img->rowPadBytes; // 图像每一行的字节数
+   img->rowSizeBytes = GetRowDataBytes(img) + img->rowPadBytes; // 图像每一行的字节数
    img->imageFlip = DmtxFlipNone;
 
    /* Leave channelStart[] and bitsPerChannel[] with zeros from calloc */
@@ -90,8 +104,7 @@ dmtxImageCreate(unsigned char *pxl, int width, int height, int pack)
          break;
       case DmtxPack1bppK:
          dmtxImageSetChannel(img, 0, 1);
-         return NULL; /* unsupported packing order */
-/*       break; */
+         break;
       case DmtxPack8bppK:
          dmtxImageSetChannel(img, 0, 8);
          break;
@@ -123,6 +136,14 @@ dmtxImageCreate(unsigned char *pxl, int width, int height, int pack)
          dmtxImageSetChannel(img,  6, 5);
          dmtxImageSetChannel(img, 11, 5);
          break;
+      case DmtxPack16bppRGB565:
+      case DmtxPack16bppBGR565:
+      case DmtxPack16bppRGB565LE:
+      case DmtxPack16bppBGR565LE:
+         dmtxImageSetChannel(img,  0, 5);
+         dmtxImageSetChannel(img,  5, 6);
+         dmtxImageSetChannel(img, 11, 5);
+         break;
       case DmtxPack32bppXRGB:
       case DmtxPack32bppXBGR:
          dmtxImageSetChannel(img,  8, 8);
@@ -142,6 +163,53 @@ dmtxImageCreate(unsigned char *pxl, int width, int height, int pack)
    return img;
 }
 
+/**
+ * \brief  Create an image that shares a rectangle of another image's pixels
+ * \param  parent Image owning the pixel buffer
+ * \param  x Left edge of the rectangle in parent coordinates
+ * \param  y Bottom edge of the rectangle in parent coordinates
+ * \param  width
+ * \param  height
+ * \return Image view (or NULL if the rectangle does not fit in parent)
+ *
+ * No pixels are copied. The view inherits the packing, flip, and row stride of
+ * its parent, and must be destroyed before the parent's buffer is released.
+ * For 1-bpp images the left edge must fall on a byte boundary.
+ */
+extern DmtxImage *
+dmtxImageCreateView(DmtxImage *parent, int x, int y, int width, int height)
+{
+   int offset;
+   DmtxImage *view;
+
+   if(parent == NULL || width < 1 || height < 1)
+      return NULL;
+
+   if(x < 0 || y < 0 || x + width > parent->width || y + height > parent->height)
+      return NULL;
+
+   if((x * parent->bitsPerPixel) % 8 != 0)
+      return NULL;
+
+   /* First row in memory is the top of the view unless rows are stored bottom-up */
+   if(parent->imageFlip & DmtxFlipY)
+      offset = dmtxImageGetByteOffset(parent, x, y);
+   else
+      offset = dmtxImageGetByteOffset(parent, x, y + height - 1);
+
+   view = (DmtxImage *)malloc(sizeof(DmtxImage));
+   if(view == NULL)
+      return NULL;
+
+   *view = *parent;
+   view->pxl = parent->pxl + offset;
+   view->width = width;
+   view->height = height;
+   view->rowPadBytes = parent->rowSizeBytes - GetRowDataBytes(view);
+
+   return view;
+}
+
 /**
  * \brief  Free libdmtx image memory
  * \param  img pointer to img location
@@ -195,7 +263,14 @@ dmtxImageSetProp(DmtxImage *img, int prop, int value)
    switch(prop) {
       case DmtxPropRowPadBytes:
          img->rowPadBytes = value;
-         img->rowSizeBytes = img->width * (img->bitsPerPixel/8) + img->rowPadBytes;
+         img->rowSizeBytes = GetRowDataBytes(img) + img->rowPadBytes;
+         break;
+      case DmtxPropRowSizeBytes:
+         /* Explicit stride, e.g. camera pitch or the luma plane of NV12 */
+         if(value < GetRowDataBytes(img))
+            return DmtxFail;
+         img->rowSizeBytes = value;
+         img->rowPadBytes = value - GetRowDataBytes(img);
          break;
       case DmtxPropImageFlip:
          img->imageFlip = value;
@@ -249,7 +324,8 @@ dmtxImageGetProp(DmtxImage *img, int prop)
  * \param  img
  * \param  x coordinate
  * \param  y coordinate
- * \return pixel byte offset
+ * \return pixel byte offset (for 1-bpp images, offset of the byte holding the
+ *         pixel, whose bit is 7 - x%8 since rows start on a byte boundary)
  */
 extern int
 dmtxImageGetByteOffset(DmtxImage *img, int x, int y)
@@ -261,9 +337,9 @@ dmtxImageGetByteOffset(DmtxImage *img, int x, int y)
       return DmtxUndefined;
 
    if(img->imageFlip & DmtxFlipY)
-      return (y * img->rowSizeBytes + x * img->bytesPerPixel);
+      return (y * img->rowSizeBytes + (x * img->bitsPerPixel)/8);
 
-   return ((img->height - y - 1) * img->rowSizeBytes + x * img->bytesPerPixel);  // 获取目标像素相对首像素的偏移量
+   return ((img->height - y - 1) * img->rowSizeBytes + (x * img->bitsPerPixel)/8);  // 获取目标像素相对首像素的偏移量
 }
 
 /**
@@ -274,10 +350,8 @@ extern DmtxPassFail
 dmtxImageGetPixelValue(DmtxImage *img, int x, int y, int channel, int *value)
 {
    int offset;
-/* unsigned char *pixelPtr;
    int pixelValue;
-   int mask;
-   int bitShift; */
+   int bitShift;
 
    assert(img != NULL);
    assert(channel < img->channelCount);
@@ -288,23 +362,29 @@ dmtxImageGetPixelValue(DmtxImage *img, int x, int y, int channel, int *value)
 
    switch(img->bitsPerChannel[channel]) {
       case 1:
-/*       assert(img->bitsPerPixel == 1);
-         mask = 0x01 << (7 - offset%8);
-         *value = (img->pxl[offset/8] & mask) ? 255 : 0; */
+         /* Set bits are white (255), clear bits are black (0) */
+         assert(img->bitsPerPixel == 1);
+         *value = (img->pxl[offset] & (0x80 >> (x & 0x07))) ? 255 : 0;
          break;
       case 5:
-         /* XXX might be expensive if we want to scale perfect 0-255 range */
-/*       assert(img->bitsPerPixel == 16);
-         pixelPtr = img->pxl + (offset * (img->bitsPerPixel/8));
-         pixelValue = (*pixelPtr << 8) | (*(pixelPtr+1));
-         bitShift = img->bitsPerPixel - 5 - img->channelStart[channel];
-         mask = 0x1f << bitShift;
-         *value = (((pixelValue & mask) >> bitShift) << 3); */
+      case 6:
+         /* 16-bpp pixels are stored most significant byte first unless the
+            packing says otherwise */
+         assert(img->bitsPerPixel == 16);
+         if(PackLittleEndian(img->pixelPacking) == DmtxTrue)
+            pixelValue = img->pxl[offset] | (img->pxl[offset + 1] << 8);
+         else
+            pixelValue = (img->pxl[offset] << 8) | img->pxl[offset + 1];
+         bitShift = 16 - img->bitsPerChannel[channel] - img->channelStart[channel];
+         if(img->bitsPerChannel[channel] == 5)
+            *value = dmtxExpand5to8[(pixelValue >> bitShift) & 0x1f];
+         else
+            *value = dmtxExpand6to8[(pixelValue >> bitShift) & 0x3f];
          break;
       case 8:
          assert(img->channelStart[channel] % 8 == 0);
          assert(img->bitsPerPixel % 8 == 0);
-         *value = img->pxl[offset + channel];
+         *value = img->pxl[offset + img->channelStart[channel]/8];
          break;
    }
 
@@ -319,10 +399,9 @@ extern DmtxPassFail
 dmtxImageSetPixelValue(DmtxImage *img, int x, int y, int channel, int value)
 {
    int offset;
-/* unsigned char *pixelPtr; */
-/* int pixelValue; */
-/* int mask; */
-/* int bitShift; */
+   int pixelValue;
+   int bitShift;
+   int mask;
 
    assert(img != NULL);
    assert(channel < img->channelCount);
@@ -333,23 +412,38 @@ dmtxImageSetPixelValue(DmtxImage *img, int x, int y, int channel, int value)
 
    switch(img->bitsPerChannel[channel]) {
       case 1:
-/*       assert(img->bitsPerPixel == 1);
-         mask = 0x01 << (7 - offset%8);
-         *value = (img->pxl[offset/8] & mask) ? 255 : 0; */
+         /* Threshold at mid-gray: light values set the bit, dark values clear it */
+         assert(img->bitsPerPixel == 1);
+         if(value >= 128)
+            img->pxl[offset] |= (0x80 >> (x & 0x07));
+         else
+            img->pxl[offset] &= ~(0x80 >> (x & 0x07));
          break;
       case 5:
-         /* XXX might be expensive if we want to scale perfect 0-255 range */
-/*       assert(img->bitsPerPixel == 16);
-         pixelPtr = img->pxl + (offset * (img->bitsPerPixel/8));
-         pixelValue = (*pixelPtr << 8) | (*(pixelPtr+1));
-         bitShift = img->bitsPerPixel - 5 - img->channelStart[channel];
-         mask = 0x1f << bitShift;
-         *value = (((pixelValue & mask) >> bitShift) << 3); */
+      case 6:
+         /* Keep the high bits of the 8-bit value; other channels are untouched */
+         assert(img->bitsPerPixel == 16);
+         if(PackLittleEndian(img->pixelPacking) == DmtxTrue)
+            pixelValue = img->pxl[offset] | (img->pxl[offset + 1] << 8);
+         else
+            pixelValue = (img->pxl[offset] << 8) | img->pxl[offset + 1];
+         bitShift = 16 - img->bitsPerChannel[channel] - img->channelStart[channel];
+         mask = ((1 << img->bitsPerChannel[channel]) - 1) << bitShift;
+         pixelValue = (pixelValue & ~mask) |
+               (((value & 0xff) >> (8 - img->bitsPerChannel[channel])) << bitShift);
+         if(PackLittleEndian(img->pixelPacking) == DmtxTrue) {
+            img->pxl[offset] = (unsigned char)(pixelValue & 0xff);
+            img->pxl[offset + 1] = (unsigned char)(pixelValue >> 8);
+         }
+         else {
+            img->pxl[offset] = (unsigned char)(pixelValue >> 8);
+            img->pxl[offset + 1] = (unsigned char)(pixelValue & 0xff);
+         }
          break;
       case 8:
          assert(img->channelStart[channel] % 8 == 0);
          assert(img->bitsPerPixel % 8 == 0);
-         img->pxl[offset + channel] = value;
+         img->pxl[offset + img->channelStart[channel]/8] = value;
          break;
    }
 
@@ -413,6 +507,10 @@ GetBitsPerPixel(int pack)
       case DmtxPack16bppBGRX:
       case DmtxPack16bppXBGR:
       case DmtxPack16bppYCbCr:
+      case DmtxPack16bppRGB565:
+      case DmtxPack16bppBGR565:
+      case DmtxPack16bppRGB565LE:
+      case DmtxPack16bppBGR565LE:
          return 16;
       case DmtxPack24bppRGB:
       case DmtxPack24bppBGR:
@@ -430,3 +528,70 @@ GetBitsPerPixel(int pack)
 
    return DmtxUndefined;
 }
+
+/**
+ * \brief  Test whether a 16-bpp packing stores the low byte of each pixel first
+ * \param  pack
+ * \return DmtxTrue | DmtxFalse
+ */
+static DmtxBoolean
+PackLittleEndian(int pack)
+{
+   return (pack == DmtxPack16bppRGB565LE || pack == DmtxPack16bppBGR565LE) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ * \brief  Number of bytes holding pixel data in one row, excluding padding
+ * \param  img
+ * \return Row data size in bytes
+ */
+static int
+GetRowDataBytes(DmtxImage *img)
+{
+   return (img->width * img->bitsPerPixel + 7) / 8;
+}
+
+/**
+ * \brief  Test whether the 3x3 neighborhood of a 1-bpp pixel is a single color
+ * \param  img
+ * \param  x coordinate
+ * \param  y coordinate
+ * \return DmtxTrue if all 9 bits match, DmtxFalse otherwise (or if not 1-bpp
+ *         or the neighborhood leaves the image)
+ *
+ * Reads each of the 3 rows as a 3-bit field straight from the packed bytes so
+ * the edge test can skip flat areas without 9 separate pixel lookups.
+ */
+static DmtxBoolean
+PackedNeighborhoodUniform(DmtxImage *img, int x, int y)
+{
+   int row, offset, bitIdx;
+   int window, bits, first;
+
+   if(img->bitsPerPixel != 1 || dmtxImageContainsInt(img, 1, x, y) == DmtxFalse)
+      return DmtxFalse;
+
+   first = DmtxUndefined;
+   bitIdx = (x - 1) & 0x07;
+
+   for(row = y - 1; row <= y + 1; row++)
+   {
+      offset = dmtxImageGetByteOffset(img, x - 1, row);
+
+      /* Only touch the following byte when the 3 bits straddle a boundary */
+      window = img->pxl[offset] << 8;
+      if(bitIdx > 5)
+         window |= img->pxl[offset + 1];
+
+      bits = (window >> (13 - bitIdx)) & 0x07;
+      if(bits != 0x00 && bits != 0x07)
+         return DmtxFalse;
+
+      if(first == DmtxUndefined)
+         first = bits;
+      else if(bits != first)
+         return DmtxFalse;
+   }
+
+   return DmtxTrue;
+}
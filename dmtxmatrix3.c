@@ -340,6 +340,44 @@ dmtxMatrix3VMultiplyBy(DmtxVector2 *v, DmtxMatrix3 m)
    return success;
 }
 
+/**
+ * \brief  Multiply several vectors by the same matrix
+ * \param  vOut Vector array (output), may be the same array as vIn
+ * \param  vIn Vector array (input)
+ * \param  count Number of vectors
+ * \param  m Matrix to be multiplied
+ * \return Number of vectors transformed, others are set to FLT_MAX
+ *
+ * Each vector takes one division for 1/w and multiplies by it, so results
+ * may differ from dmtxMatrix3VMultiply() in the last bit.
+ */
+extern int
+dmtxMatrix3VMultiplyN(DmtxVector2 *vOut, const DmtxVector2 *vIn, int count, DmtxMatrix3 m)
+{
+   int i, success;
+   double x, y, w;
+
+   success = 0;
+   for(i = 0; i < count; i++) {
+      x = vIn[i].X;
+      y = vIn[i].Y;
+
+      w = x*m[0][2] + y*m[1][2] + m[2][2];
+      if(fabs(w) <= DmtxAlmostZero) {
+         vOut[i].X = FLT_MAX;
+         vOut[i].Y = FLT_MAX;
+         continue;
+      }
+
+      w = 1.0/w;
+      vOut[i].X = (x*m[0][0] + y*m[1][0] + m[2][0]) * w;
+      vOut[i].Y = (x*m[0][1] + y*m[1][1] + m[2][1]) * w;
+      success++;
+   }
+
+   return success;
+}
+
 /**
  * \brief  Print matrix contents to STDOUT
  * \param  m
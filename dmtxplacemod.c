@@ -60,20 +60,20 @@ dmtxSymbolModuleStatus(DmtxMessage *message, int sizeIdx, int symbolRow, int sym
  * \brief  Logical relationship between bit and module locations
  * \param  modules
  * \param  codewords
- * \param  sizeIdx
+ * \param  symbolInfo
  * \param  moduleOnColor
  * \return Number of codewords read
  */
 static int
-ModulePlacementEcc200(unsigned char *modules, unsigned char *codewords, int sizeIdx, int moduleOnColor)
+ModulePlacementEcc200(unsigned char *modules, unsigned char *codewords, const DmtxSymbolInfo *symbolInfo, int moduleOnColor)
 {
    int row, col, chr;
    int mappingRows, mappingCols;
 
    assert(moduleOnColor & (DmtxModuleOnRed | DmtxModuleOnGreen | DmtxModuleOnBlue));
 
-   mappingRows = dmtxGetSymbolAttribute(DmtxSymAttribMappingMatrixRows, sizeIdx);
-   mappingCols = dmtxGetSymbolAttribute(DmtxSymAttribMappingMatrixCols, sizeIdx);
+   mappingRows = symbolInfo->mappingRows;
+   mappingCols = symbolInfo->mappingCols;
 
    /* Start in the nominal location for the 8th bit of the first character */
    chr = 0;
@@ -81,13 +81,13 @@ static DmtxByte antilog301[] =
  * Encode xyz.
  * More detailed description.
  * \param message
- * \param sizeIdx
+ * \param symbolInfo
  * \return Function success (DmtxPass|DmtxFail)
  */
 #undef CHKPASS
 #define CHKPASS { if(passFail == DmtxFail) return DmtxFail; }
 static DmtxPassFail
-RsEncode(DmtxMessage *message, int sizeIdx)
+RsEncode(DmtxMessage *message, const DmtxSymbolInfo *symbolInfo)
 {
    int i, j;
    int blockStride, blockIdx;
@@ -99,10 +99,10 @@ RsEncode(DmtxMessage *message, int sizeIdx)
    DmtxByteList gen = dmtxByteListBuild(genStorage, sizeof(genStorage));
    DmtxByteList ecc = dmtxByteListBuild(eccStorage, sizeof(eccStorage));
 
-   blockStride = dmtxGetSymbolAttribute(DmtxSymAttribInterleavedBlocks, sizeIdx);
-   blockErrorWords = dmtxGetSymbolAttribute(DmtxSymAttribBlockErrorWords, sizeIdx);
-   symbolDataWords = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, sizeIdx);
-   symbolErrorWords = dmtxGetSymbolAttribute(DmtxSymAttribSymbolErrorWords, sizeIdx);
+   blockStride = symbolInfo->interleavedBlocks;
+   blockErrorWords = symbolInfo->blockErrorWords;
+   symbolDataWords = symbolInfo->symbolDataWords;
+   symbolErrorWords = symbolInfo->symbolErrorWords;
    symbolTotalWords = symbolDataWords + symbolErrorWords;
 
    /* Populate generator polynomial */
@@ -141,14 +141,15 @@ RsEncode(DmtxMessage *message, int sizeIdx)
  * Decode xyz.
  * More detailed description.
  * \param code
- * \param sizeIdx
+ * \param symbolInfo
  * \param fix
+ * \param stats Repair counters to update, or NULL
  * \return Function success (DmtxPass|DmtxFail)
  */
 #undef CHKPASS
 #define CHKPASS { if(passFail == DmtxFail) return DmtxFail; }
 static DmtxPassFail
-RsDecode(unsigned char *code, int sizeIdx, int fix)
+RsDecode(unsigned char *code, const DmtxSymbolInfo *symbolInfo, int fix, DmtxDecodeStats *stats)
 {
    int i;
    int blockStride, blockIdx;
@@ -167,18 +168,18 @@ RsDecode(unsigned char *code, int sizeIdx, int fix)
    DmtxByteList rec = dmtxByteListBuild(recStorage, sizeof(recStorage));
    DmtxByteList loc = dmtxByteListBuild(locStorage, sizeof(locStorage));
 
-   blockStride = dmtxGetSymbolAttribute(DmtxSymAttribInterleavedBlocks, sizeIdx);
-   blockErrorWords = dmtxGetSymbolAttribute(DmtxSymAttribBlockErrorWords, sizeIdx);
-   blockMaxCorrectable = dmtxGetSymbolAttribute(DmtxSymAttribBlockMaxCorrectable, sizeIdx);
-   symbolDataWords = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, sizeIdx);
-   symbolErrorWords = dmtxGetSymbolAttribute(DmtxSymAttribSymbolErrorWords, sizeIdx);
+   blockStride = symbolInfo->interleavedBlocks;
+   blockErrorWords = symbolInfo->blockErrorWords;
+   blockMaxCorrectable = symbolInfo->blockMaxCorrectable;
+   symbolDataWords = symbolInfo->symbolDataWords;
+   symbolErrorWords = symbolInfo->symbolErrorWords;
    symbolTotalWords = symbolDataWords + symbolErrorWords;
 
    /* For each interleaved block */
    for(blockIdx = 0; blockIdx < blockStride; blockIdx++)
    {
       /* Data word count depends on blockIdx due to special case at 144x144 */
-      blockDataWords = dmtxGetBlockDataSize(sizeIdx, blockIdx);
+      blockDataWords = dmtxGetBlockDataSize(symbolInfo->sizeIdx, blockIdx);
 //      blockTotalWords = blockErrorWords + blockDataWords;
 
       /* Populate received list (rec) with data and error codewords */
@@ -218,6 +219,9 @@ RsDecode(unsigned char *code, int sizeIdx, int fix)
 
          /* Find error values and repair */
          RsRepairErrors(&rec, &loc, &elp, &syn);
+
+         STATS_ADD(stats, rsBlocksCorrected, 1);
+         STATS_ADD(stats, rsWordsFixed, loc.length);
       }
 
       /*
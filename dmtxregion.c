@@ -15,7 +15,6 @@
  * \brief Detect barcode regions
  */
 
-#define DMTX_HOUGH_RES 180
 
 /**
  * \brief  Create copy of existing region struct
@@ -33,6 +32,9 @@ dmtxRegionCreate(DmtxRegion *reg)
 
    memcpy(regCopy, reg, sizeof(DmtxRegion));
 
+   /* Trail points live in the decoder and are reused by the next candidate */
+   regCopy->trail = NULL;
+
    return regCopy;
 }
 
@@ -67,23 +69,42 @@ dmtxRegionFindNext(DmtxDecode *dec, DmtxTime *timeout)
    DmtxPixelLoc loc;
    DmtxRegion   *reg;
 
+   StageBegin(dec, DmtxStatsStageFind, NULL);
+
+   /* The Hough and run-length detectors keep their own progress through the image */
+   if(dec->detector == DmtxDetectorHough) {
+      reg = HoughRegionFindNext(dec, timeout);
+      StageEnd(dec, DmtxStatsStageFind, NULL);
+      return reg;
+   }
+
+   if(dec->detector == DmtxDetectorRuns) {
+      reg = RunsRegionFindNext(dec, timeout);
+      StageEnd(dec, DmtxStatsStageFind, NULL);
+      return reg;
+   }
+
    /* Continue until we find a region or run out of chances */
-   for(;;) {
+   for(reg = NULL; ; ) {
       locStatus = PopGridLocation(&(dec->grid), &loc);   // 通过十字结构遍历寻找可能是DM码区域的点
       if(locStatus == DmtxRangeEnd)
          break;
 
+      STATS_ADD(&dec->stats, gridPopped, 1);
+
       /* Scan location for presence of valid barcode region */
       reg = dmtxRegionScanPixel(dec, loc.X, loc.Y);   // 获取DM码区域的信息
       if(reg != NULL)
-         return reg;
+         break;
 
       /* Ran out of time? */
       if(timeout != NULL && dmtxTimeExceeded(*timeout))
          break;
    }
 
-   return NULL;
+   StageEnd(dec, DmtxStatsStageFind, NULL);
+
+   return reg;
 }
 
 /**
@@ -99,47 +120,76 @@ dmtxRegionScanPixel(DmtxDecode *dec, int x, int y)
    DmtxRegion reg;
    DmtxPointFlow flowBegin;
    DmtxPixelLoc loc;
+   DmtxPassFail passFail;
 
    loc.X = x;
    loc.Y = y;
 
    cache = dmtxDecodeGetCache(dec, loc.X, loc.Y);
-   if(cache == NULL)
-      return NULL;
-
-   if((int)(*cache & 0x80) != 0x00)
+   if(cache == NULL || (int)(*cache & 0x80) != 0x00) {
+      STATS_ADD(&dec->stats, gridSkipped, 1);
       return NULL;
+   }
 
    /* Test for presence of any reasonable edge at this location */
    flowBegin = MatrixRegionSeekEdge(dec, loc);
    if(flowBegin.mag < (int)(dec->edgeThresh * 7.65 + 0.5))
       return NULL;
 
+   STATS_ADD(&dec->stats, edgeHits, 1);
+
    memset(&reg, 0x00, sizeof(DmtxRegion));
+   reg.flowBegin = flowBegin;
+   reg.traceId = dec->traceRegions++;
 
    /* Determine barcode orientation */
-   if(MatrixRegionOrientation(dec, &reg, flowBegin) == DmtxFail)
+   StageBegin(dec, DmtxStatsStageOrient, &reg);
+   passFail = MatrixRegionOrientation(dec, &reg, flowBegin);
+   StageEnd(dec, DmtxStatsStageOrient, &reg);
+   if(passFail == DmtxFail) {
+      STATS_ADD(&dec->stats, orientationFails, 1);
       return NULL;
-   if(dmtxRegionUpdateXfrms(dec, &reg) == DmtxFail)
+   }
+   if(dmtxRegionUpdateXfrms(dec, &reg) == DmtxFail) {
+      STATS_ADD(&dec->stats, rejects[DmtxRejectCorners], 1);
       return NULL;
+   }
+
+   StageBegin(dec, DmtxStatsStageFit, &reg);
 
    /* Define top edge */
-   if(MatrixRegionAlignCalibEdge(dec, &reg, DmtxEdgeTop) == DmtxFail)
-      return NULL;
-   if(dmtxRegionUpdateXfrms(dec, &reg) == DmtxFail)
-      return NULL;
+   passFail = MatrixRegionAlignCalibEdge(dec, &reg, DmtxEdgeTop);
+   if(passFail == DmtxPass)
+      passFail = dmtxRegionUpdateXfrms(dec, &reg);
 
    /* Define right edge */
-   if(MatrixRegionAlignCalibEdge(dec, &reg, DmtxEdgeRight) == DmtxFail)
-      return NULL;
-   if(dmtxRegionUpdateXfrms(dec, &reg) == DmtxFail)
+   if(passFail == DmtxPass)
+      passFail = MatrixRegionAlignCalibEdge(dec, &reg, DmtxEdgeRight);
+   if(passFail == DmtxPass)
+      passFail = dmtxRegionUpdateXfrms(dec, &reg);
+
+   StageEnd(dec, DmtxStatsStageFit, &reg);
+   if(passFail == DmtxFail) {
+      STATS_ADD(&dec->stats, rejects[DmtxRejectCalibEdge], 1);
       return NULL;
+   }
 
    CALLBACK_MATRIX(&reg);
 
    /* Calculate the best fitting symbol size */
-   if(MatrixRegionFindSize(dec, &reg) == DmtxFail)
+   StageBegin(dec, DmtxStatsStageSize, &reg);
+   if(CalibBarAlternates(dec, &reg, DmtxEdgeTop) == DmtxFalse ||
+         CalibBarAlternates(dec, &reg, DmtxEdgeRight) == DmtxFalse) {
+      StageEnd(dec, DmtxStatsStageSize, &reg);
+      STATS_ADD(&dec->stats, rejects[DmtxRejectTimingPattern], 1);
       return NULL;
+   }
+   passFail = MatrixRegionFindSize(dec, &reg);
+   StageEnd(dec, DmtxStatsStageSize, &reg);
+   if(passFail == DmtxFail) {
+      STATS_ADD(&dec->stats, rejects[DmtxRejectSize], 1);
+      return NULL;
+   }
 
    /* Found a valid matrix region */
    return dmtxRegionCreate(&reg);
@@ -159,7 +209,14 @@ MatrixRegionSeekEdge(DmtxDecode *dec, DmtxPixelLoc loc)
    DmtxPointFlow flowPos, flowPosBack;
    DmtxPointFlow flowNeg, flowNegBack;
 
-   channelCount = dec->image->channelCount;
+   channelCount = dec->channelCount;
+
+   /* Packed 1-bpp images can rule out flat areas a whole row of bits at a
+      time. Preprocessed tiles are filtered over a wider area, so a flat raw
+      neighborhood says nothing about them. */
+   if(dec->scale == 1 && dec->ppTiles == NULL &&
+         PackedNeighborhoodUniform(dec->image, loc.X, loc.Y) == DmtxTrue)
+      return dmtxBlankEdge;
 
    /* Find whether red, green, or blue shows the strongest edge */
    strongIdx = 0;
@@ -231,7 +288,7 @@ MatrixRegionOrientation(DmtxDecode *dec, DmtxRegion *reg, DmtxPointFlow begin)
    /* Follow to end in both directions */
    err = TrailBlazeContinuous(dec, reg, begin, maxDiagonal);
    if(err == DmtxFail || reg->stepsTotal < 40) {
-      TrailClear(dec, reg, 0x40);
+      STATS_ADD(&dec->stats, rejects[DmtxRejectTrailLength], 1);
       return DmtxFail;
    }
 
@@ -245,37 +302,41 @@ MatrixRegionOrientation(DmtxDecode *dec, DmtxRegion *reg, DmtxPointFlow begin)
          minArea = (2 * dec->edgeMin * dec->edgeMin)/(scale * scale);
 
       if((reg->boundMax.X - reg->boundMin.X) * (reg->boundMax.Y - reg->boundMin.Y) < minArea) {
-         TrailClear(dec, reg, 0x40);
+         STATS_ADD(&dec->stats, rejects[DmtxRejectTrailLength], 1);
          return DmtxFail;
       }
    }
 
    line1x = FindBestSolidLine(dec, reg, 0, 0, +1, DmtxUndefined);
    if(line1x.mag < 5) {
-      TrailClear(dec, reg, 0x40);
+      STATS_ADD(&dec->stats, rejects[DmtxRejectFinderSide], 1);
       return DmtxFail;
    }
 
-   err = FindTravelLimits(dec, reg, &line1x);
+   err = FindTravelLimits(reg, &line1x);
    if(line1x.distSq < 100 || line1x.devn * 10 >= sqrt((double)line1x.distSq)) {
-      TrailClear(dec, reg, 0x40);
+      STATS_ADD(&dec->stats, rejects[DmtxRejectFinderSide], 1);
       return DmtxFail;
    }
    assert(line1x.stepPos >= line1x.stepNeg);
 
-   fTmp = FollowSeek(dec, reg, line1x.stepPos + 5);
+   fTmp = FollowSeek(reg, line1x.stepPos + 5);
    line2p = FindBestSolidLine(dec, reg, fTmp.step, line1x.stepNeg, +1, line1x.angle);
 
-   fTmp = FollowSeek(dec, reg, line1x.stepNeg - 5);
+   fTmp = FollowSeek(reg, line1x.stepNeg - 5);
    line2n = FindBestSolidLine(dec, reg, fTmp.step, line1x.stepPos, -1, line1x.angle);
-   if(max(line2p.mag, line2n.mag) < 5)
+   if(max(line2p.mag, line2n.mag) < 5) {
+      STATS_ADD(&dec->stats, rejects[DmtxRejectFinderSide], 1);
       return DmtxFail;
+   }
 
    if(line2p.mag > line2n.mag) {
       line2x = line2p;
-      err = FindTravelLimits(dec, reg, &line2x);
-      if(line2x.distSq < 100 || line2x.devn * 10 >= sqrt((double)line2x.distSq))
+      err = FindTravelLimits(reg, &line2x);
+      if(line2x.distSq < 100 || line2x.devn * 10 >= sqrt((double)line2x.distSq)) {
+         STATS_ADD(&dec->stats, rejects[DmtxRejectFinderSide], 1);
          return DmtxFail;
+      }
 
       cross = ((line1x.locPos.X - line1x.locNeg.X) * (line2x.locPos.Y - line2x.locNeg.Y)) -
             ((line1x.locPos.Y - line1x.locNeg.Y) * (line2x.locPos.X - line2x.locNeg.X));
@@ -310,9 +371,11 @@ MatrixRegionOrientation(DmtxDecode *dec, DmtxRegion *reg, DmtxPointFlow begin)
    }
    else {
       line2x = line2n;
-      err = FindTravelLimits(dec, reg, &line2x);
-      if(line2x.distSq < 100 || line2x.devn / sqrt((double)line2x.distSq) >= 0.1)
+      err = FindTravelLimits(reg, &line2x);
+      if(line2x.distSq < 100 || line2x.devn / sqrt((double)line2x.distSq) >= 0.1) {
+         STATS_ADD(&dec->stats, rejects[DmtxRejectFinderSide], 1);
          return DmtxFail;
+      }
 
       cross = ((line1x.locNeg.X - line1x.locPos.X) * (line2x.locNeg.Y - line2x.locPos.Y)) -
             ((line1x.locNeg.Y - line1x.locPos.Y) * (line2x.locNeg.X - line2x.locPos.X));
@@ -586,38 +649,37 @@ RightAngleTrueness(DmtxVector2 c0, DmtxVector2 c1, DmtxVector2 c2, double angle)
  * \param  reg
  * \param  symbolRow
  * \param  symbolCol
- * \param  sizeIdx
+ * \param  symbolInfo
  * \return Averaged module color
  */
 static int
 ReadModuleColor(DmtxDecode *dec, DmtxRegion *reg, int symbolRow, int symbolCol,
-      int sizeIdx, int colorPlane)
+      const DmtxSymbolInfo *symbolInfo, int colorPlane)
 {
    int i;
-   int symbolRows, symbolCols;
    int color, colorTmp;
-   double sampleX[] = { 0.5, 0.4, 0.5, 0.6, 0.5 };
-   double sampleY[] = { 0.5, 0.5, 0.4, 0.5, 0.6 };
-   DmtxVector2 p;
+   double rowScale, colScale;
+   static const double sampleX[] = { 0.5, 0.4, 0.5, 0.6, 0.5 };
+   static const double sampleY[] = { 0.5, 0.5, 0.4, 0.5, 0.6 };
+   DmtxVector2 p[5];
 
-   symbolRows = dmtxGetSymbolAttribute(DmtxSymAttribSymbolRows, sizeIdx);
-   symbolCols = dmtxGetSymbolAttribute(DmtxSymAttribSymbolCols, sizeIdx);
+   colScale = 1.0/symbolInfo->symbolCols;
+   rowScale = 1.0/symbolInfo->symbolRows;
 
-   color = 0;
    for(i = 0; i < 5; i++) {
+      p[i].X = colScale * (symbolCol + sampleX[i]);
+      p[i].Y = rowScale * (symbolRow + sampleY[i]);
+   }
 
-      p.X = (1.0/symbolCols) * (symbolCol + sampleX[i]);
-      p.Y = (1.0/symbolRows) * (symbolRow + sampleY[i]);
-
-      dmtxMatrix3VMultiplyBy(&p, reg->fit2raw);
-
-      //fprintf(stdout, "%dx%d\n", (int)(p.X + 0.5), (int)(p.Y + 0.5));
+   dmtxMatrix3VMultiplyN(p, p, 5, reg->fit2raw);
 
-      dmtxDecodeGetPixelValue(dec, (int)(p.X + 0.5), (int)(p.Y + 0.5),
+   color = 0;
+   for(i = 0; i < 5; i++) {
+      dmtxDecodeGetPixelValue(dec, (int)(p[i].X + 0.5), (int)(p[i].Y + 0.5),
             colorPlane, &colorTmp);
       color += colorTmp;
    }
-   //fprintf(stdout, "\n");
+
    return color/5;
 }
 
@@ -635,6 +697,7 @@ MatrixRegionFindSize(DmtxDecode *dec, DmtxRegion *reg)
    int sizeIdx, bestSizeIdx;
    int symbolRows, symbolCols;
    int jumpCount, errors;
+   const DmtxSymbolInfo *symbolInfo;
    int color;
    int colorOnAvg, bestColorOnAvg;
    int colorOffAvg, bestColorOffAvg;
@@ -663,17 +726,20 @@ MatrixRegionFindSize(DmtxDecode *dec, DmtxRegion *reg)
       sizeIdxEnd = dec->sizeIdxExpected + 1;
    }
 
+   STATS_ADD(&dec->stats, sizeCandidates, sizeIdxEnd - sizeIdxBeg);
+
    /* Test each barcode size to find best contrast in calibration modules */
    for(sizeIdx = sizeIdxBeg; sizeIdx < sizeIdxEnd; sizeIdx++) {
 
-      symbolRows = dmtxGetSymbolAttribute(DmtxSymAttribSymbolRows, sizeIdx);
-      symbolCols = dmtxGetSymbolAttribute(DmtxSymAttribSymbolCols, sizeIdx);
+      symbolInfo = dmtxGetSymbolInfo(sizeIdx);
+      symbolRows = symbolInfo->symbolRows;
+      symbolCols = symbolInfo->symbolCols;
       colorOnAvg = colorOffAvg = 0;
 
       /* Sum module colors along horizontal calibration bar */
       row = symbolRows - 1;
       for(col = 0; col < symbolCols; col++) {
-         color = ReadModuleColor(dec, reg, row, col, sizeIdx, reg->flowBegin.plane);
+         color = ReadModuleColor(dec, reg, row, col, symbolInfo, reg->flowBegin.plane);
          if((col & 0x01) != 0x00)
             colorOffAvg += color;
          else
@@ -683,7 +749,7 @@ MatrixRegionFindSize(DmtxDecode *dec, DmtxRegion *reg)
       /* Sum module colors along vertical calibration bar */
       col = symbolCols - 1;
       for(row = 0; row < symbolRows; row++) {
-         color = ReadModuleColor(dec, reg, row, col, sizeIdx, reg->flowBegin.plane);
+         color = ReadModuleColor(dec, reg, row, col, symbolInfo, reg->flowBegin.plane);
          if((row & 0x01) != 0x00)
             colorOffAvg += color;
          else
@@ -713,10 +779,11 @@ MatrixRegionFindSize(DmtxDecode *dec, DmtxRegion *reg)
    reg->onColor = bestColorOnAvg;
    reg->offColor = bestColorOffAvg;
 
-   reg->symbolRows = dmtxGetSymbolAttribute(DmtxSymAttribSymbolRows, reg->sizeIdx);
-   reg->symbolCols = dmtxGetSymbolAttribute(DmtxSymAttribSymbolCols, reg->sizeIdx);
-   reg->mappingRows = dmtxGetSymbolAttribute(DmtxSymAttribMappingMatrixRows, reg->sizeIdx);
-   reg->mappingCols = dmtxGetSymbolAttribute(DmtxSymAttribMappingMatrixCols, reg->sizeIdx);
+   symbolInfo = dmtxGetSymbolInfo(reg->sizeIdx);
+   reg->symbolRows = symbolInfo->symbolRows;
+   reg->symbolCols = symbolInfo->symbolCols;
+   reg->mappingRows = symbolInfo->mappingRows;
+   reg->mappingCols = symbolInfo->mappingCols;
 
    /* Tally jumps on horizontal calibration bar to verify sizeIdx */
    jumpCount = CountJumpTally(dec, reg, 0, reg->symbolRows - 1, DmtxDirRight);
@@ -780,6 +847,7 @@ CountJumpTally(DmtxDecode *dec, DmtxRegion *reg, int xStart, int yStart, DmtxDir
    int tModule, tPrev;
    int darkOnLight;
    int color;
+   const DmtxSymbolInfo *symbolInfo;
 
    assert(xStart == 0 || yStart == 0);
    assert(dir == DmtxDirRight || dir == DmtxDirUp);
@@ -793,9 +861,10 @@ CountJumpTally(DmtxDecode *dec, DmtxRegion *reg, int xStart, int yStart, DmtxDir
          yStart == -1 || yStart == reg->symbolRows)
       state = DmtxModuleOff;
 
+   symbolInfo = dmtxGetSymbolInfo(reg->sizeIdx);
    darkOnLight = (int)(reg->offColor > reg->onColor);
    jumpThreshold = abs((int)(0.4 * (reg->onColor - reg->offColor) + 0.5));
-   color = ReadModuleColor(dec, reg, yStart, xStart, reg->sizeIdx, reg->flowBegin.plane);
+   color = ReadModuleColor(dec, reg, yStart, xStart, symbolInfo, reg->flowBegin.plane);
    tModule = (darkOnLight) ? reg->offColor - color : color - reg->offColor;
 
    for(x = xStart + xInc, y = yStart + yInc;
@@ -804,7 +873,7 @@ CountJumpTally(DmtxDecode *dec, DmtxRegion *reg, int xStart, int yStart, DmtxDir
          x += xInc, y += yInc) {
 
       tPrev = tModule;
-      color = ReadModuleColor(dec, reg, y, x, reg->sizeIdx, reg->flowBegin.plane);
+      color = ReadModuleColor(dec, reg, y, x, symbolInfo, reg->flowBegin.plane);
       tModule = (darkOnLight) ? reg->offColor - color : color - reg->offColor;
 
       if(state == DmtxModuleOff) {
@@ -946,127 +1015,90 @@ FindStrongestNeighbor(DmtxDecode *dec, DmtxPointFlow center, int sign)
 }
 
 /**
+ * \brief  Locate a step of the continuous trail
+ * \param  reg
+ * \param  seek Step from the trail start, positive upstream and negative
+ *         downstream; steps past either end wrap around to the other
+ * \return Step and its location
  *
- *
+ * reg->trail runs once around the trail: the start at index 0, the upstream
+ * half in steps 1..jumpToNeg, then the downstream half from its far end
+ * (step -jumpToPos) back to step -1. Every step is therefore the point at
+ * its step number modulo stepsTotal + 1.
  */
 static DmtxFollow
-FollowSeek(DmtxDecode *dec, DmtxRegion *reg, int seek)
+FollowSeek(DmtxRegion *reg, int seek)
 {
-   int i;
-   int sign;
+   int idx;
    DmtxFollow follow;
 
-   follow.loc = reg->flowBegin.loc;
-   follow.step = 0;
-   follow.ptr = dmtxDecodeGetCache(dec, follow.loc.X, follow.loc.Y);
-   assert(follow.ptr != NULL);
-   follow.neighbor = *follow.ptr;
-
-   sign = (seek > 0) ? +1 : -1;
-   for(i = 0; i != seek; i += sign) {
-      follow = FollowStep(dec, reg, follow, sign);
-      assert(follow.ptr != NULL);
-      assert(abs(follow.step) <= reg->stepsTotal);
-   }
+   idx = seek % (reg->stepsTotal + 1);
+   if(idx < 0)
+      idx += reg->stepsTotal + 1;
+
+   follow.step = seek;
+   follow.loc = reg->trail[idx];
 
    return follow;
 }
 
 /**
- *
- *
+ * \brief  Move one step along the continuous trail
+ * \param  reg
+ * \param  followBeg
+ * \param  sign +1 upstream or -1 downstream
+ * \return Next step and its location
  */
 static DmtxFollow
-FollowSeekLoc(DmtxDecode *dec, DmtxPixelLoc loc)
+FollowStep(DmtxRegion *reg, DmtxFollow followBeg, int sign)
 {
-   DmtxFollow follow;
-
-   follow.loc = loc;
-   follow.step = 0;
-   follow.ptr = dmtxDecodeGetCache(dec, follow.loc.X, follow.loc.Y);
-   assert(follow.ptr != NULL);
-   follow.neighbor = *follow.ptr;
+   assert(abs(sign) == 1);
 
-   return follow;
+   return FollowSeek(reg, followBeg.step + sign);
 }
 
-
 /**
- *
- *
+ * \brief  Make room for count trail points
+ * \param  dec
+ * \param  reg Candidate whose trail pointer follows the buffer if it moves
+ * \param  count
+ * \return DmtxPass | DmtxFail
  */
-static DmtxFollow
-FollowStep(DmtxDecode *dec, DmtxRegion *reg, DmtxFollow followBeg, int sign)
+static DmtxPassFail
+TrailReserve(DmtxDecode *dec, DmtxRegion *reg, int count)
 {
-   int patternIdx;
-   int stepMod;
-   int factor;
-   DmtxFollow follow;
+   int capacity;
+   DmtxPixelLoc *trail;
 
-   assert(abs(sign) == 1);
-   assert((int)(followBeg.neighbor & 0x40) != 0x00);
+   if(count > dec->trailCapacity) {
+      capacity = (dec->trailCapacity > 0) ? dec->trailCapacity : 256;
+      while(capacity < count)
+         capacity *= 2;
 
-   factor = reg->stepsTotal + 1;
-   if(sign > 0)
-      stepMod = (factor + (followBeg.step % factor)) % factor;
-   else
-      stepMod = (factor - (followBeg.step % factor)) % factor;
+      trail = (DmtxPixelLoc *)realloc(dec->trail, capacity * sizeof(DmtxPixelLoc));
+      if(trail == NULL)
+         return DmtxFail;
 
-   /* End of positive trail -- magic jump */
-   if(sign > 0 && stepMod == reg->jumpToNeg) {
-      follow.loc = reg->finalNeg;
-   }
-   /* End of negative trail -- magic jump */
-   else if(sign < 0 && stepMod == reg->jumpToPos) {
-      follow.loc = reg->finalPos;
-   }
-   /* Trail in progress -- normal jump */
-   else {
-      patternIdx = (sign < 0) ? followBeg.neighbor & 0x07 : ((followBeg.neighbor & 0x38) >> 3);
-      follow.loc.X = followBeg.loc.X + dmtxPatternX[patternIdx];
-      follow.loc.Y = followBeg.loc.Y + dmtxPatternY[patternIdx];
+      dec->trail = trail;
+      dec->trailCapacity = capacity;
    }
 
-   follow.step = followBeg.step + sign;
-   follow.ptr = dmtxDecodeGetCache(dec, follow.loc.X, follow.loc.Y);
-   assert(follow.ptr != NULL);
-   follow.neighbor = *follow.ptr;
+   reg->trail = dec->trail;
 
-   return follow;
+   return DmtxPass;
 }
 
 /**
+ * \brief  Follow the strongest edge away from flowBegin in both directions
+ * \param  dec
+ * \param  reg
+ * \param  flowBegin
+ * \param  maxDiagonal Longest allowed bounding box side, or DmtxUndefined
+ * \return DmtxPass | DmtxFail
  *
- *
- */
-static DmtxFollow
-FollowStep2(DmtxDecode *dec, DmtxFollow followBeg, int sign)
-{
-   int patternIdx;
-   DmtxFollow follow;
-
-   assert(abs(sign) == 1);
-   assert((int)(followBeg.neighbor & 0x40) != 0x00);
-
-   patternIdx = (sign < 0) ? followBeg.neighbor & 0x07 : ((followBeg.neighbor & 0x38) >> 3);
-   follow.loc.X = followBeg.loc.X + dmtxPatternX[patternIdx];
-   follow.loc.Y = followBeg.loc.Y + dmtxPatternY[patternIdx];
-
-   follow.step = followBeg.step + sign;
-   follow.ptr = dmtxDecodeGetCache(dec, follow.loc.X, follow.loc.Y);
-   assert(follow.ptr != NULL);
-   follow.neighbor = *follow.ptr;
-
-   return follow;
-}
-
-/**
- * vaiiiooo
- * --------
- * 0x80 v = visited bit
- * 0x40 a = assigned bit
- * 0x38 u = 3 bits points upstream 0-7
- * 0x07 d = 3 bits points downstream 0-7
+ * Points are stored in reg->trail in the order FollowSeek() expects. The
+ * cache visited bit (0x80) keeps the trail from crossing itself and is
+ * cleared again before returning.
  */
 static DmtxPassFail
 TrailBlazeContinuous(DmtxDecode *dec, DmtxRegion *reg, DmtxPointFlow flowBegin, int maxDiagonal)
@@ -1074,23 +1106,25 @@ TrailBlazeContinuous(DmtxDecode *dec, DmtxRegion *reg, DmtxPointFlow flowBegin,
    int posAssigns, negAssigns, clears;
    int sign;
    int steps;
-   unsigned char *cache, *cacheNext, *cacheBeg;
+   int count, i, j;
+   unsigned char *cacheBeg, *cacheNext;
    DmtxPointFlow flow, flowNext;
-   DmtxPixelLoc boundMin, boundMax;
+   DmtxPixelLoc boundMin, boundMax, locTmp;
 
    boundMin = boundMax = flowBegin.loc;
    cacheBeg = dmtxDecodeGetCache(dec, flowBegin.loc.X, flowBegin.loc.Y);
-   if(cacheBeg == NULL)
+   if(cacheBeg == NULL || TrailReserve(dec, reg, 1) == DmtxFail)
       return DmtxFail;
-   *cacheBeg = (0x80 | 0x40); /* Mark location as visited and assigned */
+   *cacheBeg |= 0x80; /* Mark location as visited */
 
    reg->flowBegin = flowBegin;
+   reg->trail[0] = flowBegin.loc;
+   count = 1;
 
    posAssigns = negAssigns = 0;
    for(sign = 1; sign >= -1; sign -= 2) {
 
       flow = flowBegin;
-      cache = cacheBeg;
 
       for(steps = 0; ; steps++) {
 
@@ -1105,25 +1139,16 @@ TrailBlazeContinuous(DmtxDecode *dec, DmtxRegion *reg, DmtxPointFlow flowBegin,
 
          /* Get the neighbor's cache location */
          cacheNext = dmtxDecodeGetCache(dec, flowNext.loc.X, flowNext.loc.Y);
-         if(cacheNext == NULL)
+         if(cacheNext == NULL || TrailReserve(dec, reg, count + 1) == DmtxFail)
             break;
          assert(!(*cacheNext & 0x80));
 
-         /* Mark departure from current location. If flowing downstream
-          * (sign < 0) then departure vector here is the arrival vector
-          * of the next location. Upstream flow uses the opposite rule. */
-         *cache |= (sign < 0) ? flowNext.arrive : flowNext.arrive << 3;
-
-         /* Mark known direction for next location */
-         /* If testing downstream (sign < 0) then next upstream is opposite of next arrival */
-         /* If testing upstream (sign > 0) then next downstream is opposite of next arrival */
-         *cacheNext = (sign < 0) ? (((flowNext.arrive + 4)%8) << 3) : ((flowNext.arrive + 4)%8);
-         *cacheNext |= (0x80 | 0x40); /* Mark location as visited and assigned */
+         *cacheNext |= 0x80; /* Mark location as visited */
+         reg->trail[count++] = flowNext.loc;
          if(sign > 0)
             posAssigns++;
          else
             negAssigns++;
-         cache = cacheNext;
          flow = flowNext;
 
          if(flow.loc.X > boundMax.X)
@@ -1151,8 +1176,17 @@ TrailBlazeContinuous(DmtxDecode *dec, DmtxRegion *reg, DmtxPointFlow flowBegin,
    reg->boundMin = boundMin;
    reg->boundMax = boundMax;
 
+   /* Downstream points were stored walking away from the start */
+   for(i = reg->jumpToNeg + 1, j = count - 1; i < j; i++, j--) {
+      locTmp = reg->trail[i];
+      reg->trail[i] = reg->trail[j];
+      reg->trail[j] = locTmp;
+   }
+
+   STATS_ADD(&dec->stats, trailSteps, posAssigns + negAssigns);
+
    /* Clear "visited" bit from trail */
-   clears = TrailClear(dec, reg, 0x80);
+   clears = TrailClear(dec, reg);
    assert(posAssigns + negAssigns == clears - 1);
 
    /* XXX clean this up ... redundant test above */
@@ -1166,23 +1200,23 @@ TrailBlazeContinuous(DmtxDecode *dec, DmtxRegion *reg, DmtxPointFlow flowBegin,
 /**
  * recives bresline, and follows strongest neighbor unless it involves
  * ratcheting bresline inward or backward (although back + outward is allowed).
- *
+ * Points are stored in reg->trail after the continuous trail, starting with
+ * line.loc, and the number of steps taken is returned. Nothing is stored if
+ * line.loc is off the image or the trail cannot grow.
  */
 static int
 TrailBlazeGapped(DmtxDecode *dec, DmtxRegion *reg, DmtxBresLine line, int streamDir)
 {
-   unsigned char *beforeCache, *afterCache;
    DmtxBoolean onEdge;
    int distSq, distSqMax;
    int travel, outward;
    int xDiff, yDiff;
    int steps;
-   int stepDir, dirMap[] = { 0, 1, 2, 7, 8, 3, 6, 5, 4 };
+   int base;
    DmtxPassFail err;
    DmtxPixelLoc beforeStep, afterStep;
    DmtxPointFlow flow, flowNext;
    DmtxPixelLoc loc0;
-   int xStep, yStep;
 
    loc0 = line.loc;
    flow = GetPointFlow(dec, reg->flowBegin.plane, loc0, dmtxNeighborNone);
@@ -1191,11 +1225,10 @@ TrailBlazeGapped(DmtxDecode *dec, DmtxRegion *reg, DmtxBresLine line, int stream
    onEdge = DmtxTrue;
 
    beforeStep = loc0;
-   beforeCache = dmtxDecodeGetCache(dec, loc0.X, loc0.Y);
-   if(beforeCache == NULL)
+   base = reg->stepsTotal + 1;
+   if(dmtxDecodeGetCache(dec, loc0.X, loc0.Y) == NULL || TrailReserve(dec, reg, base + 1) == DmtxFail)
       return DmtxFail;
-   else
-      *beforeCache = 0x00; /* probably should just overwrite one direction */
+   reg->trail[base] = loc0;
 
    do {
       if(onEdge == DmtxTrue) {
@@ -1223,25 +1256,14 @@ TrailBlazeGapped(DmtxDecode *dec, DmtxRegion *reg, DmtxBresLine line, int stream
       }
 
       afterStep = line.loc;
-      afterCache = dmtxDecodeGetCache(dec, afterStep.X, afterStep.Y);
-      if(afterCache == NULL)
+      if(dmtxDecodeGetCache(dec, afterStep.X, afterStep.Y) == NULL ||
+            TrailReserve(dec, reg, base + steps + 2) == DmtxFail)
          break;
 
-      /* Determine step direction using pure magic */
-      xStep = afterStep.X - beforeStep.X;
-      yStep = afterStep.Y - beforeStep.Y;
-      assert(abs(xStep) <= 1 && abs(yStep) <= 1);
-      stepDir = dirMap[3 * yStep + xStep + 4];
-      assert(stepDir != 8);
-
-      if(streamDir < 0) {
-         *beforeCache |= (0x40 | stepDir);
-         *afterCache = (((stepDir + 4)%8) << 3);
-      }
-      else {
-         *beforeCache |= (0x40 | (stepDir << 3));
-         *afterCache = ((stepDir + 4)%8);
-      }
+      /* Each step moves to one of the 8 neighbors */
+      assert(abs(afterStep.X - beforeStep.X) <= 1 && abs(afterStep.Y - beforeStep.Y) <= 1);
+      assert(afterStep.X != beforeStep.X || afterStep.Y != beforeStep.Y);
+      reg->trail[base + steps + 1] = afterStep;
 
       /* Guaranteed to have taken one step since top of loop */
       xDiff = line.loc.X - loc0.X;
@@ -1249,39 +1271,143 @@ TrailBlazeGapped(DmtxDecode *dec, DmtxRegion *reg, DmtxBresLine line, int stream
       distSq = (xDiff * xDiff) + (yDiff * yDiff);
 
       beforeStep = line.loc;
-      beforeCache = afterCache;
       steps++;
 
    } while(distSq < distSqMax);
 
+   STATS_ADD(&dec->stats, trailSteps, steps);
+
    return steps;
 }
 
 /**
- *
- *
+ * \brief  Clear the visited bit from every point of the continuous trail
+ * \param  dec
+ * \param  reg
+ * \return Number of points cleared
  */
 static int
-TrailClear(DmtxDecode *dec, DmtxRegion *reg, int clearMask)
+TrailClear(DmtxDecode *dec, DmtxRegion *reg)
 {
    int clears;
-   DmtxFollow follow;
-
-   assert((clearMask | 0xff) == 0xff);
+   unsigned char *cache;
 
-   /* Clear "visited" bit from trail */
-   clears = 0;
-   follow = FollowSeek(dec, reg, 0);
-   while(abs(follow.step) <= reg->stepsTotal) {
-      assert((int)(*follow.ptr & clearMask) != 0x00);
-      *follow.ptr &= (clearMask ^ 0xff);
-      follow = FollowStep(dec, reg, follow, +1);
-      clears++;
+   for(clears = 0; clears <= reg->stepsTotal; clears++) {
+      cache = dmtxDecodeGetCache(dec, reg->trail[clears].X, reg->trail[clears].Y);
+      assert(cache != NULL && (int)(*cache & 0x80) != 0x00);
+      *cache &= 0x7f;
    }
 
    return clears;
 }
 
+/**
+ * \brief  Clear votes and choose the angles to test
+ * \param  hough
+ * \param  houghAvoid Angle of a known edge, whose neighborhood is skipped,
+ *         or DmtxUndefined to test every angle
+ * \return void
+ */
+static void
+HoughInit(DmtxHough *hough, int houghAvoid)
+{
+   int i;
+   int houghMin, houghMax;
+
+   memset(hough->count, 0x00, sizeof(hough->count));
+
+   houghMin = (houghAvoid + DMTX_HOUGH_RES/6) % DMTX_HOUGH_RES;
+   houghMax = (houghAvoid - DMTX_HOUGH_RES/6 + DMTX_HOUGH_RES) % DMTX_HOUGH_RES;
+   for(i = 0; i < DMTX_HOUGH_RES; i++) {
+      if(houghAvoid == DmtxUndefined)
+         hough->test[i] = 1;
+      else if(houghMin > houghMax)
+         hough->test[i] = (i > houghMin || i < houghMax) ? 1 : 0;
+      else
+         hough->test[i] = (i > houghMin && i < houghMax) ? 1 : 0;
+   }
+
+   hough->angleBest = 0;
+   hough->offsetBest = 0;
+   hough->countBest = 0;
+}
+
+/**
+ * \brief  Vote for every tested line passing near one trail point
+ * \param  hough
+ * \param  xDiff Point position relative to the first trail point
+ * \param  yDiff
+ * \return void
+ *
+ * A line at angle i passes within dH/256 pixels of the point, where dH is
+ * 256 * r * sin(phi - theta[i]) plus up to (|xDiff| + |yDiff|)/2 of table
+ * rounding. Only lines with |dH| <= 384 vote, so beyond the first few
+ * points only a narrow window of angles around the point's own direction
+ * phi needs testing. Angles are still visited in ascending order, so ties
+ * resolve exactly as a scan over every angle would.
+ */
+static void
+HoughAccumulate(DmtxHough *hough, int xDiff, int yDiff)
+{
+   int i, range;
+   int center, span;
+   int rangeBeg[2], rangeEnd[2];
+   int dH, offset;
+   double dist, reach;
+
+   dist = sqrt((double)(xDiff * xDiff + yDiff * yDiff));
+   reach = (384.0 + 0.5 * (abs(xDiff) + abs(yDiff))) / (256.0 * dist);
+
+   /* Window of angles that can vote, split in two where it wraps */
+   rangeBeg[0] = 0;
+   rangeEnd[0] = rangeBeg[1] = rangeEnd[1] = DMTX_HOUGH_RES;
+   if(dist > 0.0 && reach < 1.0) {
+      span = (int)(asin(reach) * (DMTX_HOUGH_RES/M_PI)) + 2;
+      center = (int)floor(atan2((double)yDiff, (double)xDiff) * (DMTX_HOUGH_RES/M_PI) + 0.5);
+      center = (center % DMTX_HOUGH_RES + DMTX_HOUGH_RES) % DMTX_HOUGH_RES;
+      if(2 * span + 1 < DMTX_HOUGH_RES) {
+         if(center - span < 0) {
+            rangeEnd[0] = center + span + 1;
+            rangeBeg[1] = center - span + DMTX_HOUGH_RES;
+         }
+         else if(center + span >= DMTX_HOUGH_RES) {
+            rangeEnd[0] = center + span + 1 - DMTX_HOUGH_RES;
+            rangeBeg[1] = center - span;
+         }
+         else {
+            rangeBeg[0] = center - span;
+            rangeEnd[0] = center + span + 1;
+         }
+      }
+   }
+
+   for(range = 0; range < 2; range++) {
+      for(i = rangeBeg[range]; i < rangeEnd[range]; i++) {
+
+         if((int)hough->test[i] == 0)
+            continue;
+
+         dH = (rHvX[i] * yDiff) - (rHvY[i] * xDiff);
+         if(dH >= -384 && dH <= 384) {
+
+            if(dH > 128)
+               offset = 2;
+            else if(dH >= -128)
+               offset = 1;
+            else
+               offset = 0;
+
+            /* New angle takes over lead */
+            if(++hough->count[offset][i] > hough->countBest) {
+               hough->angleBest = i;
+               hough->offsetBest = offset;
+               hough->countBest++;
+            }
+         }
+      }
+   }
+}
+
 /**
  *
  *
@@ -1289,26 +1415,17 @@ TrailClear(DmtxDecode *dec, DmtxRegion *reg, int clearMask)
 static DmtxBestLine
 FindBestSolidLine(DmtxDecode *dec, DmtxRegion *reg, int step0, int step1, int streamDir, int houghAvoid)
 {
-   int hough[3][DMTX_HOUGH_RES] = { { 0 } };
-   int houghMin, houghMax;
-   char houghTest[DMTX_HOUGH_RES];
-   int i;
    int step;
    int sign;
    int tripSteps;
-   int angleBest;
-   int hOffset, hOffsetBest;
-   int xDiff, yDiff;
-   int dH;
-   DmtxRay2 rH;
+   DmtxHough hough;
    DmtxFollow follow;
    DmtxBestLine line;
    DmtxPixelLoc rHp;
 
+   STATS_ADD(&dec->stats, houghLines, 1);
+
    memset(&line, 0x00, sizeof(DmtxBestLine));
-   memset(&rH, 0x00, sizeof(DmtxRay2));
-   angleBest = 0;
-   hOffset = hOffsetBest = 0;
 
    sign = 0;
 
@@ -1335,7 +1452,7 @@ FindBestSolidLine(DmtxDecode *dec, DmtxRegion *reg, int step0, int step1, int st
    }
    assert(sign == streamDir);
 
-   follow = FollowSeek(dec, reg, step0);
+   follow = FollowSeek(reg, step0);
    rHp = follow.loc;
 
    line.stepBeg = line.stepPos = line.stepNeg = step0;
@@ -1343,61 +1460,20 @@ FindBestSolidLine(DmtxDecode *dec, DmtxRegion *reg, int step0, int step1, int st
    line.locPos = follow.loc;
    line.locNeg = follow.loc;
 
-   /* Predetermine which angles to test */
-   for(i = 0; i < DMTX_HOUGH_RES; i++) {
-      if(houghAvoid == DmtxUndefined) {
-         houghTest[i] = 1;
-      }
-      else {
-         houghMin = (houghAvoid + DMTX_HOUGH_RES/6) % DMTX_HOUGH_RES;
-         houghMax = (houghAvoid - DMTX_HOUGH_RES/6 + DMTX_HOUGH_RES) % DMTX_HOUGH_RES;
-         if(houghMin > houghMax)
-            houghTest[i] = (i > houghMin || i < houghMax) ? 1 : 0;
-         else
-            houghTest[i] = (i > houghMin && i < houghMax) ? 1 : 0;
-      }
-   }
-
    /* Test each angle for steps along path */
+   HoughInit(&hough, houghAvoid);
    for(step = 0; step < tripSteps; step++) {
 
-      xDiff = follow.loc.X - rHp.X;
-      yDiff = follow.loc.Y - rHp.Y;
-
-      /* Increment Hough accumulator */
-      for(i = 0; i < DMTX_HOUGH_RES; i++) {
-
-         if((int)houghTest[i] == 0)
-            continue;
-
-         dH = (rHvX[i] * yDiff) - (rHvY[i] * xDiff);
-         if(dH >= -384 && dH <= 384) {
-
-            if(dH > 128)
-               hOffset = 2;
-            else if(dH >= -128)
-               hOffset = 1;
-            else
-               hOffset = 0;
-
-            hough[hOffset][i]++;
-
-            /* New angle takes over lead */
-            if(hough[hOffset][i] > hough[hOffsetBest][angleBest]) {
-               angleBest = i;
-               hOffsetBest = hOffset;
-            }
-         }
-      }
+      HoughAccumulate(&hough, follow.loc.X - rHp.X, follow.loc.Y - rHp.Y);
 
 /*    CALLBACK_POINT_PLOT(follow.loc, (sign > 1) ? 4 : 3, 1, 2); */
 
-      follow = FollowStep(dec, reg, follow, sign);
+      follow = FollowStep(reg, follow, sign);
    }
 
-   line.angle = angleBest;
-   line.hOffset = hOffsetBest;
-   line.mag = hough[hOffsetBest][angleBest];
+   line.angle = hough.angleBest;
+   line.hOffset = hough.offsetBest;
+   line.mag = hough.countBest;
 
    return line;
 }
@@ -1407,85 +1483,32 @@ FindBestSolidLine(DmtxDecode *dec, DmtxRegion *reg, int step0, int step1, int st
  *
  */
 static DmtxBestLine
-FindBestSolidLine2(DmtxDecode *dec, DmtxPixelLoc loc0, int tripSteps, int sign, int houghAvoid)
+FindBestSolidLine2(DmtxDecode *dec, DmtxPixelLoc *trail, int tripSteps, int houghAvoid)
 {
-   int hough[3][DMTX_HOUGH_RES] = { { 0 } };
-   int houghMin, houghMax;
-   char houghTest[DMTX_HOUGH_RES];
-   int i;
    int step;
-   int angleBest;
-   int hOffset, hOffsetBest;
-   int xDiff, yDiff;
-   int dH;
-   DmtxRay2 rH;
+   DmtxHough hough;
    DmtxBestLine line;
    DmtxPixelLoc rHp;
-   DmtxFollow follow;
+
+   STATS_ADD(&dec->stats, houghLines, 1);
 
    memset(&line, 0x00, sizeof(DmtxBestLine));
-   memset(&rH, 0x00, sizeof(DmtxRay2));
-   angleBest = 0;
-   hOffset = hOffsetBest = 0;
 
-   follow = FollowSeekLoc(dec, loc0);
-   rHp = line.locBeg = line.locPos = line.locNeg = follow.loc;
+   rHp = line.locBeg = line.locPos = line.locNeg = trail[0];
    line.stepBeg = line.stepPos = line.stepNeg = 0;
 
-   /* Predetermine which angles to test */
-   for(i = 0; i < DMTX_HOUGH_RES; i++) {
-      if(houghAvoid == DmtxUndefined) {
-         houghTest[i] = 1;
-      }
-      else {
-         houghMin = (houghAvoid + DMTX_HOUGH_RES/6) % DMTX_HOUGH_RES;
-         houghMax = (houghAvoid - DMTX_HOUGH_RES/6 + DMTX_HOUGH_RES) % DMTX_HOUGH_RES;
-         if(houghMin > houghMax)
-            houghTest[i] = (i > houghMin || i < houghMax) ? 1 : 0;
-         else
-            houghTest[i] = (i > houghMin && i < houghMax) ? 1 : 0;
-      }
-   }
-
    /* Test each angle for steps along path */
+   HoughInit(&hough, houghAvoid);
    for(step = 0; step < tripSteps; step++) {
 
-      xDiff = follow.loc.X - rHp.X;
-      yDiff = follow.loc.Y - rHp.Y;
+      HoughAccumulate(&hough, trail[step].X - rHp.X, trail[step].Y - rHp.Y);
 
-      /* Increment Hough accumulator */
-      for(i = 0; i < DMTX_HOUGH_RES; i++) {
-
-         if((int)houghTest[i] == 0)
-            continue;
-
-         dH = (rHvX[i] * yDiff) - (rHvY[i] * xDiff);
-         if(dH >= -384 && dH <= 384) {
-            if(dH > 128)
-               hOffset = 2;
-            else if(dH >= -128)
-               hOffset = 1;
-            else
-               hOffset = 0;
-
-            hough[hOffset][i]++;
-
-            /* New angle takes over lead */
-            if(hough[hOffset][i] > hough[hOffsetBest][angleBest]) {
-               angleBest = i;
-               hOffsetBest = hOffset;
-            }
-         }
-      }
-
-/*    CALLBACK_POINT_PLOT(follow.loc, (sign > 1) ? 4 : 3, 1, 2); */
-
-      follow = FollowStep2(dec, follow, sign);
+/*    CALLBACK_POINT_PLOT(trail[step], 4, 1, 2); */
    }
 
-   line.angle = angleBest;
-   line.hOffset = hOffsetBest;
-   line.mag = hough[hOffsetBest][angleBest];
+   line.angle = hough.angleBest;
+   line.hOffset = hough.offsetBest;
+   line.mag = hough.countBest;
 
    return line;
 }
@@ -1495,7 +1518,7 @@ FindBestSolidLine2(DmtxDecode *dec, DmtxPixelLoc loc0, int tripSteps, int sign,
  *
  */
 static DmtxPassFail
-FindTravelLimits(DmtxDecode *dec, DmtxRegion *reg, DmtxBestLine *line)
+FindTravelLimits(DmtxRegion *reg, DmtxBestLine *line)
 {
    int i;
    int distSq, distSqMax;
@@ -1509,7 +1532,7 @@ FindTravelLimits(DmtxDecode *dec, DmtxRegion *reg, DmtxBestLine *line)
    DmtxPixelLoc loc0, posMax, negMax;
 
    /* line->stepBeg is already known to sit on the best Hough line */
-   followPos = followNeg = FollowSeek(dec, reg, line->stepBeg);
+   followPos = followNeg = FollowSeek(reg, line->stepBeg);
    loc0 = followPos.loc;
 
    cosAngle = rHvX[line->angle];
@@ -1582,8 +1605,8 @@ FindTravelLimits(DmtxDecode *dec, DmtxRegion *reg, DmtxBestLine *line)
 /*  CALLBACK_POINT_PLOT(followPos.loc, 2, 1, 2);
     CALLBACK_POINT_PLOT(followNeg.loc, 4, 1, 2); */
 
-      followPos = FollowStep(dec, reg, followPos, +1);
-      followNeg = FollowStep(dec, reg, followNeg, -1);
+      followPos = FollowStep(reg, followPos, +1);
+      followNeg = FollowStep(reg, followNeg, -1);
    }
    line->devn = max(posWanderMaxLock - posWanderMinLock, negWanderMaxLock - negWanderMinLock)/256;
    line->distSq = distSqMax;
@@ -1607,8 +1630,8 @@ MatrixRegionAlignCalibEdge(DmtxDecode *dec, DmtxRegion *reg, int edgeLoc)
    int symbolShape;
    DmtxVector2 pTmp;
    DmtxPixelLoc loc0, loc1, locOrigin;
+   DmtxPixelLoc *trail;
    DmtxBresLine line;
-   DmtxFollow follow;
    DmtxBestLine bestLine;
 
    /* Determine pixel coordinates of origin */
@@ -1633,7 +1656,7 @@ MatrixRegionAlignCalibEdge(DmtxDecode *dec, DmtxRegion *reg, int edgeLoc)
    if(edgeLoc == DmtxEdgeTop) {
       streamDir = reg->polarity * -1;
       avoidAngle = reg->leftLine.angle;
-      follow = FollowSeekLoc(dec, reg->locT);
+      loc0 = reg->locT;
       pTmp.X = 0.8;
       pTmp.Y = (symbolShape == DmtxSymbolRectAuto) ? 0.2 : 0.6;
    }
@@ -1641,7 +1664,7 @@ MatrixRegionAlignCalibEdge(DmtxDecode *dec, DmtxRegion *reg, int edgeLoc)
       assert(edgeLoc == DmtxEdgeRight);
       streamDir = reg->polarity;
       avoidAngle = reg->bottomLine.angle;
-      follow = FollowSeekLoc(dec, reg->locR);
+      loc0 = reg->locR;
       pTmp.X = (symbolShape == DmtxSymbolSquareAuto) ? 0.7 : 0.9;
       pTmp.Y = 0.8;
    }
@@ -1650,11 +1673,12 @@ MatrixRegionAlignCalibEdge(DmtxDecode *dec, DmtxRegion *reg, int edgeLoc)
    loc1.X = (int)(pTmp.X + 0.5);
    loc1.Y = (int)(pTmp.Y + 0.5);
 
-   loc0 = follow.loc;
    line = BresLineInit(loc0, loc1, locOrigin);
    steps = TrailBlazeGapped(dec, reg, line, streamDir);
 
-   bestLine = FindBestSolidLine2(dec, loc0, steps, streamDir, avoidAngle);
+   /* A blaze that fails before its first step may not have stored loc0 */
+   trail = (steps > 0) ? reg->trail + reg->stepsTotal + 1 : &loc0;
+   bestLine = FindBestSolidLine2(dec, trail, steps, avoidAngle);
    if(bestLine.mag < 5) {
       ;
    }
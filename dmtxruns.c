@@ -0,0 +1,798 @@
+/**
+ * libdmtx - Data Matrix Encoding/Decoding Library
+ *
+ * See LICENSE file in the main project directory for full
+ * terms of use and distribution.
+ *
+ * \file dmtxruns.c
+ * \brief Propose regions from connected runs of a thresholded image
+ *
+ * Selected with DmtxPropDetector = DmtxDetectorRuns. Every row is cut into
+ * runs on either side of one global threshold, and runs of the same color
+ * that touch across rows are joined into components in the same pass. The
+ * solid finder L always lies on the convex outline of its component, so the
+ * outline gives both the orientation and the full extent of a symbol even
+ * where calibration modules came loose. Corners are ranked by how solid
+ * their two sides are and handed to dmtxRegionUpdateCorners() in that
+ * order. Meant for flat scans: sides are fitted as a parallelogram, and
+ * uneven lighting that a single threshold cannot split is better left to
+ * the trail detector.
+ */
+
+/**
+ * \brief  Find next barcode region with the run-length detector
+ * \param  dec Pointer to DmtxDecode information struct
+ * \param  timeout Pointer to timeout time (NULL if none)
+ * \return Detected region (if found)
+ */
+static DmtxRegion *
+RunsRegionFindNext(DmtxDecode *dec, DmtxTime *timeout)
+{
+   DmtxRunList *list;
+   DmtxRegion *reg;
+
+   if(dec->runList == NULL) {
+      dec->runList = RunListCreate(dec);
+      if(dec->runList == NULL)
+         return NULL;
+   }
+   list = dec->runList;
+
+   while(list->candidateNext < list->candidateCount) {
+      STATS_ADD(&dec->stats, gridPopped, 1);
+
+      reg = RunsRegionScan(dec, list, &(list->candidates[list->candidateNext++]));
+      if(reg != NULL)
+         return reg;
+
+      /* Ran out of time? */
+      if(timeout != NULL && dmtxTimeExceeded(*timeout))
+         break;
+   }
+
+   return NULL;
+}
+
+/**
+ * \brief  Threshold the decoder's image and collect ranked candidates
+ * \param  dec
+ * \return Candidate list (possibly empty), or NULL if out of memory
+ */
+static DmtxRunList *
+RunListCreate(DmtxDecode *dec)
+{
+   int runCount;
+   DmtxRun *runs;
+   DmtxRunList *list;
+   DmtxPassFail passFail;
+
+   list = (DmtxRunList *)calloc(1, sizeof(DmtxRunList));
+   if(list == NULL)
+      return NULL;
+
+   /* A flat image has nothing to offer, which is not an error */
+   if(RunsThreshold(dec, list) == DmtxFail)
+      return list;
+
+   runs = RunsEncode(dec, list, &runCount);
+   if(runs == NULL) {
+      RunListDestroy(&list);
+      return NULL;
+   }
+
+   passFail = RunsAddCandidates(dec, list, runs, runCount);
+   free(runs);
+   if(passFail == DmtxFail) {
+      RunListDestroy(&list);
+      return NULL;
+   }
+
+   if(list->candidateCount > 0)
+      qsort(list->candidates, list->candidateCount, sizeof(DmtxRunCandidate), RunsCandidateCompare);
+
+   return list;
+}
+
+/**
+ * \brief  Release run-length detector state
+ * \param  list
+ * \return void
+ */
+static void
+RunListDestroy(DmtxRunList **list)
+{
+   if(list == NULL || *list == NULL)
+      return;
+
+   free((*list)->candidates);
+   free(*list);
+
+   *list = NULL;
+}
+
+/**
+ * \brief  Pick the plane and Otsu threshold that best split the image
+ * \param  dec
+ * \param  list Receives plane and thresh
+ * \return DmtxPass | DmtxFail if no plane has the decoder's edge contrast
+ *
+ * Histograms are taken from every other pixel of every other row.
+ */
+static DmtxPassFail
+RunsThreshold(DmtxDecode *dec, DmtxRunList *list)
+{
+   int x, y, plane, value, t;
+   int hist[256];
+   long count, countLow, sum, sumLow;
+   double meanLow, meanHigh, between, betweenBest, contrastBest;
+
+   betweenBest = -1.0;
+   contrastBest = 0.0;
+
+   for(plane = 0; plane < dec->channelCount; plane++) {
+      memset(hist, 0x00, sizeof(hist));
+      for(y = dec->yMin; y <= dec->yMax; y += 2) {
+         for(x = dec->xMin; x <= dec->xMax; x += 2) {
+            if(dmtxDecodeGetPixelValue(dec, x, y, plane, &value) == DmtxPass)
+               hist[value]++;
+         }
+      }
+
+      count = sum = 0;
+      for(t = 0; t < 256; t++) {
+         count += hist[t];
+         sum += (long)t * hist[t];
+      }
+
+      countLow = sumLow = 0;
+      for(t = 0; t < 255; t++) {
+         countLow += hist[t];
+         sumLow += (long)t * hist[t];
+         if(countLow == 0 || countLow == count)
+            continue;
+
+         meanLow = (double)sumLow / countLow;
+         meanHigh = (double)(sum - sumLow) / (count - countLow);
+         between = (double)countLow * (count - countLow) * (meanHigh - meanLow) * (meanHigh - meanLow);
+         if(between > betweenBest) {
+            betweenBest = between;
+            contrastBest = meanHigh - meanLow;
+            list->plane = plane;
+            list->thresh = t + 1;
+         }
+      }
+   }
+
+   /* Same percent scale as DmtxPropEdgeThresh */
+   return (contrastBest >= dec->edgeThresh * 2.55) ? DmtxPass : DmtxFail;
+}
+
+/**
+ * \brief  Cut every row into runs and join runs that touch the row above
+ * \param  dec
+ * \param  list Plane and threshold to use
+ * \param  runCount Returns the number of runs
+ * \return Runs in row order, or NULL if out of memory
+ */
+static DmtxRun *
+RunsEncode(DmtxDecode *dec, DmtxRunList *list, int *runCount)
+{
+   int x, y, value, dark, prev;
+   int count, capacity, rowBeg, above, aboveEnd;
+   DmtxRun *runs, *grown, *run;
+
+   capacity = 4 * (dec->yMax - dec->yMin + 1);
+   runs = (DmtxRun *)malloc(capacity * sizeof(DmtxRun));
+   if(runs == NULL)
+      return NULL;
+
+   count = 0;
+   above = aboveEnd = 0;
+
+   for(y = dec->yMin; y <= dec->yMax; y++) {
+      rowBeg = count;
+
+      for(x = dec->xMin; x <= dec->xMax; x++) {
+         value = 0;
+         dmtxDecodeGetPixelValue(dec, x, y, list->plane, &value);
+         dark = (value < list->thresh) ? 1 : 0;
+
+         if(count > rowBeg && runs[count - 1].dark == dark) {
+            runs[count - 1].xEnd = x;
+            continue;
+         }
+
+         if(count == capacity) {
+            capacity *= 2;
+            grown = (DmtxRun *)realloc(runs, capacity * sizeof(DmtxRun));
+            if(grown == NULL) {
+               free(runs);
+               return NULL;
+            }
+            runs = grown;
+         }
+
+         run = &(runs[count]);
+         run->y = y;
+         run->xBeg = run->xEnd = x;
+         run->dark = dark;
+         run->parent = count;
+         run->blob = DmtxUndefined;
+         count++;
+      }
+
+      /* Runs of the previous row overlap these in order, so walk both at once */
+      for(run = &(runs[rowBeg]); run < &(runs[count]); run++) {
+         while(above < aboveEnd && runs[above].xEnd < run->xBeg)
+            above++;
+         for(prev = above; prev < aboveEnd && runs[prev].xBeg <= run->xEnd; prev++) {
+            if(runs[prev].dark == run->dark)
+               RunsJoin(runs, prev, (int)(run - runs));
+         }
+      }
+
+      above = rowBeg;
+      aboveEnd = count;
+   }
+
+   *runCount = count;
+
+   return runs;
+}
+
+/**
+ * \brief  Root of a run's component, halving the path on the way
+ * \param  runs
+ * \param  idx
+ * \return Index of the root run
+ */
+static int
+RunsFindRoot(DmtxRun *runs, int idx)
+{
+   while(runs[idx].parent != idx) {
+      runs[idx].parent = runs[runs[idx].parent].parent;
+      idx = runs[idx].parent;
+   }
+
+   return idx;
+}
+
+/**
+ * \brief  Merge the components of two runs under the earlier root
+ * \param  runs
+ * \param  idx0
+ * \param  idx1
+ * \return void
+ */
+static void
+RunsJoin(DmtxRun *runs, int idx0, int idx1)
+{
+   idx0 = RunsFindRoot(runs, idx0);
+   idx1 = RunsFindRoot(runs, idx1);
+
+   if(idx0 < idx1)
+      runs[idx1].parent = idx0;
+   else if(idx1 < idx0)
+      runs[idx0].parent = idx1;
+}
+
+/**
+ * \brief  Fit a candidate to every component that could be a symbol
+ * \param  dec
+ * \param  list
+ * \param  runs
+ * \param  runCount
+ * \return DmtxPass | DmtxFail if out of memory
+ *
+ * Components touching the edge of the search area are skipped, which also
+ * drops the background. Each run adds the outer corners of its pixels to
+ * its component's outline.
+ */
+static DmtxPassFail
+RunsAddCandidates(DmtxDecode *dec, DmtxRunList *list, DmtxRun *runs, int runCount)
+{
+   int i, root, blobCount, pointCount, hullCount, width, height;
+   DmtxRun *run;
+   DmtxRunBlob *blobs, *blob;
+   DmtxVector2 *points, *hull, *p;
+   DmtxRunCandidate cand, *grown;
+   DmtxPassFail passFail;
+
+   blobs = (DmtxRunBlob *)malloc(runCount * sizeof(DmtxRunBlob));
+   if(blobs == NULL)
+      return DmtxFail;
+
+   /* Gather the extent of each component at its root */
+   blobCount = 0;
+   for(i = 0; i < runCount; i++) {
+      run = &(runs[i]);
+      root = RunsFindRoot(runs, i);
+      if(runs[root].blob == DmtxUndefined) {
+         runs[root].blob = blobCount;
+         blob = &(blobs[blobCount++]);
+         blob->dark = run->dark;
+         blob->xMin = run->xBeg;
+         blob->xMax = run->xEnd;
+         blob->yMin = blob->yMax = run->y;
+         blob->area = 0;
+      }
+      blob = &(blobs[runs[root].blob]);
+      blob->xMin = min(blob->xMin, run->xBeg);
+      blob->xMax = max(blob->xMax, run->xEnd);
+      blob->yMax = run->y;
+      blob->area += run->xEnd - run->xBeg + 1;
+   }
+
+   /* Lay out outline points for the components worth fitting */
+   pointCount = 0;
+   for(i = 0; i < blobCount; i++) {
+      blob = &(blobs[i]);
+      width = blob->xMax - blob->xMin + 1;
+      height = blob->yMax - blob->yMin + 1;
+      blob->pointBeg = pointCount;
+      blob->pointCount = 0;
+      if(width < DmtxRunsMinSide || height < DmtxRunsMinSide ||
+            blob->xMin == dec->xMin || blob->xMax == dec->xMax ||
+            blob->yMin == dec->yMin || blob->yMax == dec->yMax)
+         continue;
+      blob->pointCount = 4 * height;
+      pointCount += blob->pointCount;
+   }
+
+   points = (DmtxVector2 *)malloc((pointCount + 1) * sizeof(DmtxVector2));
+   hull = (DmtxVector2 *)malloc((pointCount + 1) * sizeof(DmtxVector2));
+   if(points == NULL || hull == NULL) {
+      free(points);
+      free(hull);
+      free(blobs);
+      return DmtxFail;
+   }
+
+   /* Only the outer ends of each row can reach the outline */
+   for(i = 0; i < blobCount; i++)
+      blobs[i].pointCount = (blobs[i].pointCount > 0) ? 0 : DmtxUndefined;
+
+   for(i = 0; i < runCount; i++) {
+      run = &(runs[i]);
+      blob = &(blobs[runs[RunsFindRoot(runs, i)].blob]);
+      if(blob->pointCount == DmtxUndefined)
+         continue;
+
+      p = &(points[blob->pointBeg + blob->pointCount]);
+      if(blob->pointCount >= 4 && p[-4].Y == run->y - 0.5) {
+         /* Another run of this row: widen the row's ends instead */
+         p[-2].X = p[-1].X = run->xEnd + 0.5;
+         continue;
+      }
+
+      p[0].X = p[1].X = run->xBeg - 0.5;
+      p[2].X = p[3].X = run->xEnd + 0.5;
+      p[0].Y = p[2].Y = run->y - 0.5;
+      p[1].Y = p[3].Y = run->y + 0.5;
+      blob->pointCount += 4;
+   }
+
+   passFail = DmtxPass;
+   for(i = 0; i < blobCount && passFail == DmtxPass; i++) {
+      blob = &(blobs[i]);
+      if(blob->pointCount == DmtxUndefined)
+         continue;
+
+      hullCount = RunsHull(points + blob->pointBeg, blob->pointCount, hull);
+      if(RunsFitBlob(dec, list, blob, hull, hullCount, &cand) == DmtxFail)
+         continue;
+      cand.order = i;
+
+      if(list->candidateCount % 64 == 0) {
+         grown = (DmtxRunCandidate *)realloc(list->candidates,
+               (list->candidateCount + 64) * sizeof(DmtxRunCandidate));
+         if(grown == NULL) {
+            passFail = DmtxFail;
+            break;
+         }
+         list->candidates = grown;
+      }
+      list->candidates[list->candidateCount++] = cand;
+   }
+
+   free(points);
+   free(hull);
+   free(blobs);
+
+   return passFail;
+}
+
+/**
+ * \brief  Order points by X, then Y
+ */
+static int
+RunsPointCompare(const void *a, const void *b)
+{
+   const DmtxVector2 *pA = (const DmtxVector2 *)a;
+   const DmtxVector2 *pB = (const DmtxVector2 *)b;
+
+   if(pA->X != pB->X)
+      return (pA->X < pB->X) ? -1 : 1;
+   if(pA->Y != pB->Y)
+      return (pA->Y < pB->Y) ? -1 : 1;
+
+   return 0;
+}
+
+/**
+ * \brief  Convex hull by the monotone chain method
+ * \param  points Sorted in place
+ * \param  count
+ * \param  hull Room for count + 1 points, receives the hull counterclockwise
+ * \return Number of hull points, without collinear ones
+ */
+static int
+RunsHull(DmtxVector2 *points, int count, DmtxVector2 *hull)
+{
+   int i, n, lower;
+   DmtxVector2 v0, v1;
+
+   qsort(points, count, sizeof(DmtxVector2), RunsPointCompare);
+
+   n = 0;
+   for(i = 0; i < count; i++) {
+      while(n >= 2 && dmtxVector2Cross(dmtxVector2Sub(&v0, &hull[n - 1], &hull[n - 2]),
+            dmtxVector2Sub(&v1, &points[i], &hull[n - 1])) <= 0.0)
+         n--;
+      hull[n++] = points[i];
+   }
+
+   lower = n + 1;
+   for(i = count - 2; i >= 0; i--) {
+      while(n >= lower && dmtxVector2Cross(dmtxVector2Sub(&v0, &hull[n - 1], &hull[n - 2]),
+            dmtxVector2Sub(&v1, &points[i], &hull[n - 1])) <= 0.0)
+         n--;
+      hull[n++] = points[i];
+   }
+
+   /* Last point repeats the first */
+   return n - 1;
+}
+
+/**
+ * \brief  Fit a parallelogram to a component outline and rank its corners
+ * \param  dec
+ * \param  list
+ * \param  blob
+ * \param  hull Counterclockwise outline
+ * \param  hullCount
+ * \param  cand Receives the candidate
+ * \return DmtxPass | DmtxFail if the component cannot be a symbol
+ *
+ * Finder sides run straight along the whole symbol, so they show up among
+ * the longest outline edges while ragged sides break into short ones. Each
+ * long edge is tried as a square fit and paired with the others as a
+ * skewed one, and the fit whose finder L looks most solid wins.
+ */
+static DmtxPassFail
+RunsFitBlob(DmtxDecode *dec, DmtxRunList *list, const DmtxRunBlob *blob,
+      const DmtxVector2 *hull, int hullCount, DmtxRunCandidate *cand)
+{
+   int i, j, k, dirCount;
+   double dir[DmtxRunsDirections], angle, length, lengthBest;
+   double area, areaBest, angleSquare;
+   DmtxVector2 edge;
+   DmtxRunCandidate candTmp;
+   DmtxPassFail passFail;
+
+   /* Longest outline edges, no two along the same direction */
+   for(dirCount = 0; dirCount < DmtxRunsDirections; dirCount++) {
+      lengthBest = 0.0;
+      for(i = 0; i < hullCount; i++) {
+         dmtxVector2Sub(&edge, &hull[(i + 1) % hullCount], &hull[i]);
+         angle = RunsEdgeAngle(&edge);
+         length = dmtxVector2Mag(&edge);
+         for(k = 0; k < dirCount && RunsAngleDiff(angle, dir[k]) > 4.0; k++)
+            ;
+         if(k == dirCount && length > lengthBest) {
+            lengthBest = length;
+            dir[dirCount] = angle;
+         }
+      }
+      if(lengthBest < DmtxRunsMinSide)
+         break;
+   }
+
+   passFail = DmtxFail;
+   for(i = 0; i < dirCount; i++) {
+      for(j = i; j < dirCount; j++) {
+         if(j == i) {
+            /* Square fit turns to whichever nearby edge leaves the least area */
+            areaBest = DBL_MAX;
+            angleSquare = dir[i];
+            for(k = 0; k < hullCount; k++) {
+               dmtxVector2Sub(&edge, &hull[(k + 1) % hullCount], &hull[k]);
+               angle = RunsEdgeAngle(&edge);
+               if(RunsAngleDiff(angle, dir[i]) > 4.0 && RunsAngleDiff(angle, dir[i] + 90.0) > 4.0)
+                  continue;
+               area = RunsFitArea(hull, hullCount, angle, angle + 90.0);
+               if(area < areaBest) {
+                  areaBest = area;
+                  angleSquare = angle;
+               }
+            }
+            if(RunsFitSides(dec, list, blob, hull, hullCount, angleSquare,
+                  angleSquare + 90.0, &candTmp) == DmtxFail)
+               continue;
+         }
+         else if(RunsAngleDiff(dir[i], dir[j]) < 30.0 || RunsFitSides(dec, list,
+               blob, hull, hullCount, dir[i], dir[j], &candTmp) == DmtxFail) {
+            continue;
+         }
+
+         if(passFail == DmtxFail || candTmp.score > cand->score) {
+            *cand = candTmp;
+            passFail = DmtxPass;
+         }
+      }
+   }
+
+   return passFail;
+}
+
+/**
+ * \brief  Bound a component outline by lines in two directions
+ * \param  dec
+ * \param  list
+ * \param  blob
+ * \param  hull Counterclockwise outline
+ * \param  hullCount
+ * \param  angle0 Direction of one pair of sides in degrees
+ * \param  angle1 Direction of the other pair
+ * \param  cand Receives the candidate
+ * \return DmtxPass | DmtxFail if the component cannot be a symbol
+ */
+static DmtxPassFail
+RunsFitSides(DmtxDecode *dec, DmtxRunList *list, const DmtxRunBlob *blob,
+      const DmtxVector2 *hull, int hullCount, double angle0, double angle1,
+      DmtxRunCandidate *cand)
+{
+   int i, j, k;
+   double lo[2], hi[2], offset[2], area, det, length[4];
+   double solid[4], score[4], tmp;
+   DmtxVector2 normal[2], center, vTmp;
+
+   normal[0].X = -sin(angle0 * (M_PI/180.0));
+   normal[0].Y = cos(angle0 * (M_PI/180.0));
+   normal[1].X = -sin(angle1 * (M_PI/180.0));
+   normal[1].Y = cos(angle1 * (M_PI/180.0));
+
+   for(k = 0; k < 2; k++) {
+      lo[k] = DBL_MAX;
+      hi[k] = -DBL_MAX;
+      for(i = 0; i < hullCount; i++) {
+         offset[k] = dmtxVector2Dot(&hull[i], &normal[k]);
+         lo[k] = min(lo[k], offset[k]);
+         hi[k] = max(hi[k], offset[k]);
+      }
+   }
+
+   det = dmtxVector2Cross(&normal[0], &normal[1]);
+   area = (hi[0] - lo[0]) * (hi[1] - lo[1]) / fabs(det);
+
+   /* Corners where the offset lines cross, turned counterclockwise */
+   for(i = 0; i < 4; i++) {
+      offset[0] = (i == 0 || i == 3) ? lo[0] : hi[0];
+      offset[1] = (i < 2) ? lo[1] : hi[1];
+      cand->corner[i].X = (offset[0] * normal[1].Y - offset[1] * normal[0].Y) / det;
+      cand->corner[i].Y = (offset[1] * normal[0].X - offset[0] * normal[1].X) / det;
+   }
+   if(det < 0.0) {
+      vTmp = cand->corner[1];
+      cand->corner[1] = cand->corner[3];
+      cand->corner[3] = vTmp;
+   }
+
+   /* Shortest symbol side is 8 modules and the longest rectangle is 8x32 */
+   for(i = 0; i < 4; i++) {
+      length[i] = dmtxVector2Mag(dmtxVector2Sub(&vTmp, &cand->corner[(i + 1) & 0x03], &cand->corner[i]));
+      if(length[i] < DmtxRunsMinSide)
+         return DmtxFail;
+   }
+   if(length[0] > 4.5 * length[1] || length[1] > 4.5 * length[0])
+      return DmtxFail;
+
+   /* A finder L on its own fills little, but solid blobs are no symbol */
+   if(blob->area > 0.85 * area)
+      return DmtxFail;
+
+   for(i = 0; i < 4; i++)
+      solid[i] = RunsSideSolidity(dec, list, cand->corner[i], cand->corner[(i + 1) & 0x03], blob->dark);
+
+   /* Finder corner joins two solid sides, facing two broken ones */
+   for(i = 0; i < 4; i++) {
+      cand->rank[i] = i;
+      score[i] = min(solid[(i + 3) & 0x03], solid[i]) -
+            max(solid[(i + 1) & 0x03], solid[(i + 2) & 0x03]);
+   }
+   for(i = 1; i < 4; i++) {
+      for(j = i; j > 0 && score[j] > score[j - 1]; j--) {
+         tmp = score[j];
+         score[j] = score[j - 1];
+         score[j - 1] = tmp;
+         k = cand->rank[j];
+         cand->rank[j] = cand->rank[j - 1];
+         cand->rank[j - 1] = k;
+      }
+   }
+
+   i = cand->rank[0];
+   if(min(solid[(i + 3) & 0x03], solid[i]) < 0.75 || score[0] < 0.1)
+      return DmtxFail;
+
+   cand->score = (int)(100.0 * min(solid[(i + 3) & 0x03], solid[i]) + 0.5);
+
+   dmtxVector2Add(&center, &cand->corner[0], &cand->corner[2]);
+   cand->center.X = (int)(center.X/2.0 + 0.5);
+   cand->center.Y = (int)(center.Y/2.0 + 0.5);
+
+   return DmtxPass;
+}
+
+/**
+ * \brief  Area of the parallelogram bounding an outline in two directions
+ * \param  hull
+ * \param  hullCount
+ * \param  angle0 Direction of one pair of sides in degrees
+ * \param  angle1 Direction of the other pair
+ * \return Area in pixels
+ */
+static double
+RunsFitArea(const DmtxVector2 *hull, int hullCount, double angle0, double angle1)
+{
+   int i, k;
+   double lo[2], hi[2], offset;
+   DmtxVector2 normal[2];
+
+   normal[0].X = -sin(angle0 * (M_PI/180.0));
+   normal[0].Y = cos(angle0 * (M_PI/180.0));
+   normal[1].X = -sin(angle1 * (M_PI/180.0));
+   normal[1].Y = cos(angle1 * (M_PI/180.0));
+
+   for(k = 0; k < 2; k++) {
+      lo[k] = DBL_MAX;
+      hi[k] = -DBL_MAX;
+      for(i = 0; i < hullCount; i++) {
+         offset = dmtxVector2Dot(&hull[i], &normal[k]);
+         lo[k] = min(lo[k], offset);
+         hi[k] = max(hi[k], offset);
+      }
+   }
+
+   return (hi[0] - lo[0]) * (hi[1] - lo[1]) / fabs(dmtxVector2Cross(&normal[0], &normal[1]));
+}
+
+/**
+ * \brief  Direction of an edge in degrees, from 0 up to 180
+ */
+static double
+RunsEdgeAngle(const DmtxVector2 *edge)
+{
+   return fmod(atan2(edge->Y, edge->X) * (180.0/M_PI) + 360.0, 180.0);
+}
+
+/**
+ * \brief  Distance between two directions, which wrap at 180 degrees
+ */
+static double
+RunsAngleDiff(double angle0, double angle1)
+{
+   double diff;
+
+   diff = fmod(fabs(angle0 - angle1), 180.0);
+
+   return (diff <= 90.0) ? diff : 180.0 - diff;
+}
+
+/**
+ * \brief  Share of a side that has the component's color
+ * \param  dec
+ * \param  list
+ * \param  p0 Side start, counterclockwise around the candidate
+ * \param  p1 Side end
+ * \param  dark Color of the component
+ * \return Fraction from 0.0 to 1.0
+ *
+ * Samples one pixel inside the side, where a module of two pixels or more
+ * is always reached, and skips the ends to stay clear of the corners.
+ */
+static double
+RunsSideSolidity(DmtxDecode *dec, DmtxRunList *list, DmtxVector2 p0, DmtxVector2 p1, int dark)
+{
+   int i, count, hits, value;
+   double length, t;
+   DmtxVector2 dir, inward, p;
+
+   length = dmtxVector2Mag(dmtxVector2Sub(&dir, &p1, &p0));
+   dmtxVector2ScaleBy(&dir, 1.0/length);
+   inward.X = -dir.Y;
+   inward.Y = dir.X;
+
+   count = (int)(length * 0.8);
+   for(i = 0, hits = 0; i < count; i++) {
+      t = length * 0.1 + i + 0.5;
+      p.X = p0.X + dir.X * t + inward.X;
+      p.Y = p0.Y + dir.Y * t + inward.Y;
+      value = list->thresh;
+      dmtxDecodeGetPixelValue(dec, (int)(p.X + 0.5), (int)(p.Y + 0.5), list->plane, &value);
+      if(((value < list->thresh) ? 1 : 0) == dark)
+         hits++;
+   }
+
+   return (count > 0) ? (double)hits / count : 0.0;
+}
+
+/**
+ * \brief  Order candidates by descending score, then by position
+ */
+static int
+RunsCandidateCompare(const void *a, const void *b)
+{
+   const DmtxRunCandidate *candA = (const DmtxRunCandidate *)a;
+   const DmtxRunCandidate *candB = (const DmtxRunCandidate *)b;
+
+   if(candA->score != candB->score)
+      return (candA->score > candB->score) ? -1 : 1;
+
+   return candA->order - candB->order;
+}
+
+/**
+ * \brief  Try the ranked corners of a candidate as the finder L
+ * \param  dec
+ * \param  list
+ * \param  cand
+ * \return Detected region (if any)
+ */
+static DmtxRegion *
+RunsRegionScan(DmtxDecode *dec, DmtxRunList *list, DmtxRunCandidate *cand)
+{
+   int i, k;
+   unsigned char *cache;
+   DmtxPixelLoc px[4];
+   DmtxRegion reg;
+   DmtxPassFail passFail;
+
+   /* Center already covered by a decoded (or returned) region */
+   cache = dmtxDecodeGetCache(dec, cand->center.X, cand->center.Y);
+   if(cache == NULL || (int)(*cache & 0x80) != 0x00) {
+      STATS_ADD(&dec->stats, gridSkipped, 1);
+      return NULL;
+   }
+
+   STATS_ADD(&dec->stats, edgeHits, 1);
+
+   memset(&reg, 0x00, sizeof(DmtxRegion));
+   reg.flowBegin.plane = list->plane;
+   reg.flowBegin.arrive = dmtxNeighborNone;
+   reg.flowBegin.loc = cand->center;
+   reg.traceId = dec->traceRegions++;
+
+   StageBegin(dec, DmtxStatsStageSize, &reg);
+   for(i = 0, passFail = DmtxFail; i < 4 && passFail == DmtxFail; i++) {
+      k = cand->rank[i];
+      passFail = dmtxRegionUpdateCorners(dec, &reg, cand->corner[k], cand->corner[(k + 1) & 0x03],
+            cand->corner[(k + 2) & 0x03], cand->corner[(k + 3) & 0x03]);
+      if(passFail == DmtxPass)
+         passFail = MatrixRegionFindSize(dec, &reg);
+   }
+   StageEnd(dec, DmtxStatsStageSize, &reg);
+   if(passFail == DmtxFail)
+      return NULL;
+
+   CALLBACK_MATRIX(&reg);
+
+   for(i = 0; i < 4; i++) {
+      px[i].X = (int)(cand->corner[i].X + 0.5);
+      px[i].Y = (int)(cand->corner[i].Y + 0.5);
+   }
+   CacheFillQuad(dec, px[0], px[1], px[2], px[3]);
+
+   /* Found a valid matrix region */
+   return dmtxRegionCreate(&reg);
+}
@@ -156,9 +156,6 @@ GetGridCoordinates(DmtxScanGrid *grid, DmtxPixelLoc *locPtr)
 
    *locPtr = loc;
 
-   /* Jia-Baos */
-   printf("locPtr: %d, %d\n", loc.X, loc.Y);
-
    if(loc.X < grid->xMin || loc.X > grid->xMax ||
          loc.Y < grid->yMin || loc.Y > grid->yMax)
       return DmtxRangeBad; // 无效坐标（不在img区域中）
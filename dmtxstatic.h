@@ -49,6 +49,26 @@
 #define DmtxUnlatchExplicit            0
 #define DmtxUnlatchImplicit            1
 
+#define DmtxPreprocessTileSize        32
+#define DmtxPreprocessBlockSize      ((DmtxPreprocessTileSize + 4) * (DmtxPreprocessTileSize + 4))
+
+#define DMTX_HOUGH_RES               180
+
+#define DmtxHoughLocalSize            64  /* Side of one Hough detector tile, scaled pixels */
+#define DmtxHoughDExtent              64  /* Compacted line offsets per tile */
+#define DmtxHoughPhiExtent           128  /* Line normal angles over 180 degrees */
+#define DmtxHoughMaximaSortMax         8
+#define DmtxVanishSortMax              8
+#define DmtxHoughNoEdge             0xff
+#define DmtxHoughBandRows             16  /* Image rows per chunk of the edge passes */
+#define DmtxHoughThreadsMax           16
+
+#define DmtxRunsMinSide               10  /* Shortest candidate side, scaled pixels */
+#define DmtxRunsDirections             4  /* Outline edges tried as side directions */
+
+#define DmtxTimingProbeSamples       145  /* Over twice the 72 cycles of the longest side */
+#define DmtxTimingProbeSwings          4  /* Fewest light/dark changes along a timing edge */
+
 #define DmtxChannelValid            0x00
 #define DmtxChannelUnsupportedChar  0x01 << 0
 #define DmtxChannelCannotUnlatch    0x01 << 1
@@ -94,12 +114,198 @@ typedef enum {
  * @brief DmtxFollow
  */
 typedef struct DmtxFollow_struct {
-   unsigned char  *ptr;
-   unsigned char   neighbor;
    int             step;
    DmtxPixelLoc    loc;
 } DmtxFollow;
 
+/**
+ * @struct DmtxHough
+ * @brief Line votes collected along a trail, one row per offset band
+ */
+typedef struct DmtxHough_struct {
+   int             count[3][DMTX_HOUGH_RES];
+   char            test[DMTX_HOUGH_RES]; /* 1 where the angle is tested, 0 where avoided */
+   int             angleBest;
+   int             offsetBest;
+   int             countBest;     /* Equals count[offsetBest][angleBest], the highest count */
+} DmtxHough;
+
+/**
+ * @struct DmtxHoughBucket
+ * @brief One cell of a tile line transform
+ */
+typedef struct DmtxHoughBucket_struct {
+   int             phi;
+   int             d;
+   int             val;
+} DmtxHoughBucket;
+
+/**
+ * @struct DmtxHoughLocal
+ * @brief Line votes of a single tile, d compacted to fit the tile at every angle
+ */
+typedef struct DmtxHoughLocal_struct {
+   int             xOrigin;
+   int             yOrigin;
+   int             bucket[DmtxHoughDExtent][DmtxHoughPhiExtent]; /* [d][phi] */
+} DmtxHoughLocal;
+
+typedef struct DmtxHoughMaximaSort_struct {
+   int             count;
+   int             mag[DmtxHoughMaximaSortMax];
+} DmtxHoughMaximaSort;
+
+/**
+ * @struct DmtxVanishPointSort
+ * @brief Strongest line directions of a tile, strongest first
+ */
+typedef struct DmtxVanishPointSort_struct {
+   int             count;
+   DmtxHoughBucket bucket[DmtxVanishSortMax];
+} DmtxVanishPointSort;
+
+/**
+ * @struct DmtxHoughTile
+ * @brief Tile whose edges run along two crossing directions
+ */
+typedef struct DmtxHoughTile_struct {
+   int             xOrigin;
+   int             yOrigin;
+   int             order;         /* Position in the image, breaks score ties */
+   int             plane;         /* Color plane with most edges */
+   int             score;         /* Weaker of the two direction strengths */
+   DmtxHoughBucket vanish[2];     /* The two directions */
+   DmtxPixelLoc    seed;          /* Centroid of edges along either direction */
+} DmtxHoughTile;
+
+/**
+ * @struct DmtxHoughGrid
+ * @brief Per image state of the Hough detector, owned by DmtxDecode
+ */
+struct DmtxHoughGrid_struct {
+   int             width;
+   int             height;
+   unsigned char  *edgePhi;       /* Normal angle of each thinned edge pixel, or DmtxHoughNoEdge */
+   unsigned char  *edgePlane;     /* Color plane of each edge pixel, NULL with one channel */
+   DmtxHoughTile  *tiles;         /* Candidate tiles, strongest first */
+   int             tileCount;
+   int             tileNext;      /* Next tile handed to HoughRegionScanTile() */
+   double          cosPhi[DmtxHoughPhiExtent];
+   double          sinPhi[DmtxHoughPhiExtent];
+};
+
+/* Passes of HoughGridCreate(), each finished everywhere before the next */
+typedef enum {
+   DmtxHoughPassRead = 0,         /* Copy pixels into planes, by row band */
+   DmtxHoughPassSobel,            /* Gradient of the strongest plane, by row band */
+   DmtxHoughPassThin,             /* Keep maxima across the edge, by row band */
+   DmtxHoughPassScore,            /* Transform and score, by tile */
+   DmtxHoughPassCount
+} DmtxHoughPassType;
+
+/**
+ * @struct DmtxHoughBuild
+ * @brief Work shared by the threads building a DmtxHoughGrid
+ *
+ * Every pass is cut into chunks that any thread may claim, so the result
+ * does not depend on how many threads run.
+ */
+typedef struct DmtxHoughBuild_struct {
+   DmtxDecode     *dec;
+   DmtxHoughGrid  *grid;
+   unsigned char  *pixels;        /* One width * height plane per channel */
+   int            *gx;
+   int            *gy;
+   int            *mag;           /* gx * gx + gy * gy */
+   int             thresh;        /* Squared edge threshold */
+   int             phiDiffMin;    /* Narrowest corner angle, in phi buckets */
+   int             chunkCount[DmtxHoughPassCount];
+   int             chunkNext[DmtxHoughPassCount];
+   int             chunkDone[DmtxHoughPassCount];
+#ifdef HAVE_PTHREAD
+   pthread_mutex_t lock;
+   pthread_cond_t  passDone;
+#endif
+} DmtxHoughBuild;
+
+/**
+ * @struct DmtxHoughWorker
+ * @brief Scratch of one thread building a DmtxHoughGrid
+ */
+typedef struct DmtxHoughWorker_struct {
+   DmtxHoughBuild *build;
+   int            *rowGx;         /* Gradient of one row in a second plane */
+   int            *rowGy;
+   int            *rowMag;
+   DmtxHoughLocal  line;          /* Transform of the tile being scored */
+} DmtxHoughWorker;
+
+/**
+ * @struct DmtxRun
+ * @brief Pixels of one row on the same side of the threshold
+ */
+typedef struct DmtxRun_struct {
+   int             y;
+   int             xBeg;          /* First pixel */
+   int             xEnd;          /* Last pixel */
+   int             dark;          /* Nonzero below the threshold */
+   int             parent;        /* Union-find link, own index at a root */
+   int             blob;          /* Blob of a root run, or DmtxUndefined */
+} DmtxRun;
+
+/**
+ * @struct DmtxRunBlob
+ * @brief Runs joined into one 4-connected component
+ */
+typedef struct DmtxRunBlob_struct {
+   int             dark;
+   int             xMin;
+   int             xMax;
+   int             yMin;
+   int             yMax;
+   int             area;          /* Pixel count */
+   int             pointBeg;      /* First outline point in the shared array */
+   int             pointCount;    /* Zero once the blob is ruled out */
+} DmtxRunBlob;
+
+/**
+ * @struct DmtxRunCandidate
+ * @brief Parallelogram around a component, with its corners ranked as finder L
+ */
+typedef struct DmtxRunCandidate_struct {
+   DmtxVector2     corner[4];     /* Counterclockwise */
+   int             rank[4];       /* Corner indices, likeliest finder corner first */
+   int             score;         /* Solidity of the best finder sides, in percent */
+   int             order;         /* Position in the image, breaks score ties */
+   DmtxPixelLoc    center;
+} DmtxRunCandidate;
+
+/**
+ * @struct DmtxRunList
+ * @brief Per image state of the run-length detector, owned by DmtxDecode
+ */
+struct DmtxRunList_struct {
+   int             plane;         /* Color plane that was thresholded */
+   int             thresh;        /* Darkest value counted as light */
+   DmtxRunCandidate *candidates;  /* Strongest first */
+   int             candidateCount;
+   int             candidateNext; /* Next candidate handed to RunsRegionScan() */
+};
+
+/**
+ * @struct DmtxHoughFrame
+ * @brief Symbol extent measured along the normals of two directions
+ */
+typedef struct DmtxHoughFrame_struct {
+   int             phi[2];
+   DmtxVector2     n[2];          /* Unit normals */
+   double          det;           /* Cross product of the normals */
+   double          lo[2];         /* Extent, as offsets along n[] */
+   double          hi[2];
+   double          pitch[2];      /* Module size estimate along n[] */
+   int             gap[2];        /* Empty run that ends the extent */
+} DmtxHoughFrame;
+
 /**
  * @struct DmtxBresLine
  * @brief DmtxBresLine
@@ -130,31 +336,98 @@ static double RightAngleTrueness(DmtxVector2 c0, DmtxVector2 c1, DmtxVector2 c2,
 static DmtxPointFlow MatrixRegionSeekEdge(DmtxDecode *dec, DmtxPixelLoc loc0);
 static DmtxPassFail MatrixRegionOrientation(DmtxDecode *dec, DmtxRegion *reg, DmtxPointFlow flowBegin);
 static long DistanceSquared(DmtxPixelLoc a, DmtxPixelLoc b);
-static int ReadModuleColor(DmtxDecode *dec, DmtxRegion *reg, int symbolRow, int symbolCol, int sizeIdx, int colorPlane);
+static int ReadModuleColor(DmtxDecode *dec, DmtxRegion *reg, int symbolRow, int symbolCol, const DmtxSymbolInfo *symbolInfo, int colorPlane);
 
 static DmtxPassFail MatrixRegionFindSize(DmtxDecode *dec, DmtxRegion *reg);
 static int CountJumpTally(DmtxDecode *dec, DmtxRegion *reg, int xStart, int yStart, DmtxDirection dir);
 static DmtxPointFlow GetPointFlow(DmtxDecode *dec, int colorPlane, DmtxPixelLoc loc, int arrive);
 static DmtxPointFlow FindStrongestNeighbor(DmtxDecode *dec, DmtxPointFlow center, int sign);
-static DmtxFollow FollowSeek(DmtxDecode *dec, DmtxRegion *reg, int seek);
-static DmtxFollow FollowSeekLoc(DmtxDecode *dec, DmtxPixelLoc loc);
-static DmtxFollow FollowStep(DmtxDecode *dec, DmtxRegion *reg, DmtxFollow followBeg, int sign);
-static DmtxFollow FollowStep2(DmtxDecode *dec, DmtxFollow followBeg, int sign);
+static DmtxFollow FollowSeek(DmtxRegion *reg, int seek);
+static DmtxFollow FollowStep(DmtxRegion *reg, DmtxFollow followBeg, int sign);
+static DmtxPassFail TrailReserve(DmtxDecode *dec, DmtxRegion *reg, int count);
 static DmtxPassFail TrailBlazeContinuous(DmtxDecode *dec, DmtxRegion *reg, DmtxPointFlow flowBegin, int maxDiagonal);
 static int TrailBlazeGapped(DmtxDecode *dec, DmtxRegion *reg, DmtxBresLine line, int streamDir);
-static int TrailClear(DmtxDecode *dec, DmtxRegion *reg, int clearMask);
+static int TrailClear(DmtxDecode *dec, DmtxRegion *reg);
+static void HoughInit(DmtxHough *hough, int houghAvoid);
+static void HoughAccumulate(DmtxHough *hough, int xDiff, int yDiff);
 static DmtxBestLine FindBestSolidLine(DmtxDecode *dec, DmtxRegion *reg, int step0, int step1, int streamDir, int houghAvoid);
-static DmtxBestLine FindBestSolidLine2(DmtxDecode *dec, DmtxPixelLoc loc0, int tripSteps, int sign, int houghAvoid);
-static DmtxPassFail FindTravelLimits(DmtxDecode *dec, DmtxRegion *reg, DmtxBestLine *line);
+static DmtxBestLine FindBestSolidLine2(DmtxDecode *dec, DmtxPixelLoc *trail, int tripSteps, int houghAvoid);
+static DmtxPassFail FindTravelLimits(DmtxRegion *reg, DmtxBestLine *line);
 static DmtxPassFail MatrixRegionAlignCalibEdge(DmtxDecode *dec, DmtxRegion *reg, int whichEdge);
 static DmtxBresLine BresLineInit(DmtxPixelLoc loc0, DmtxPixelLoc loc1, DmtxPixelLoc locInside);
 static DmtxPassFail BresLineGetStep(DmtxBresLine line, DmtxPixelLoc target, int *travel, int *outward);
 static DmtxPassFail BresLineStep(DmtxBresLine *line, int travel, int outward);
 /*static void WriteDiagnosticImage(DmtxDecode *dec, DmtxRegion *reg, char *imagePath);*/
 
+/* dmtxhough.c */
+static DmtxRegion *HoughRegionFindNext(DmtxDecode *dec, DmtxTime *timeout);
+static DmtxHoughGrid *HoughGridCreate(DmtxDecode *dec);
+static void HoughGridDestroy(DmtxHoughGrid **grid);
+static DmtxPassFail HoughGridBuild(DmtxDecode *dec, DmtxHoughGrid *grid);
+#ifdef HAVE_PTHREAD
+static void *HoughWorkerThread(void *worker);
+#endif
+static void HoughWorkerRun(DmtxHoughWorker *worker);
+static int HoughClaimChunk(DmtxHoughBuild *build, int pass);
+static void HoughFinishChunk(DmtxHoughBuild *build, int pass);
+static void HoughWaitPass(DmtxHoughBuild *build, int pass);
+static void HoughReadBand(DmtxHoughBuild *build, int band);
+static void SobelBand(DmtxHoughWorker *worker, int band);
+static void SobelRow(const unsigned char *p, int width, int count, int *gx, int *gy, int *mag);
+static void SobelThinBand(DmtxHoughBuild *build, int band);
+static void HoughScoreTile(DmtxHoughWorker *worker, DmtxHoughTile *tile);
+static void HoughMerge(DmtxHoughGrid *grid);
+static int HoughTileCompare(const void *a, const void *b);
+static void LineHoughAccumulate(DmtxHoughLocal *line, DmtxHoughGrid *grid);
+static double HoughGetLocalOffset(DmtxHoughGrid *grid, double xLoc, double yLoc, int phi);
+static void AddToMaximaSort(DmtxHoughMaximaSort *sort, int maximaMag);
+static DmtxHoughBucket GetAngleSumAtPhi(DmtxHoughLocal *line, int phi);
+static void AddToVanishPointSort(DmtxVanishPointSort *sort, DmtxHoughBucket bucket);
+static DmtxVanishPointSort FindVanishPoints(DmtxHoughLocal *line);
+static int PhiDiff(int phi0, int phi1);
+static DmtxRegion *HoughRegionScanTile(DmtxDecode *dec, DmtxHoughGrid *grid, DmtxHoughTile *tile);
+static DmtxPassFail HoughFindExtents(DmtxHoughGrid *grid, DmtxHoughTile *tile, DmtxHoughFrame *frame);
+static DmtxVector2 HoughFramePoint(const DmtxHoughFrame *frame, double a, double b);
+static void HoughProject(DmtxHoughGrid *grid, const DmtxHoughFrame *frame, const double *lo, const double *hi, int dir, int *hist, int histLen);
+static DmtxPassFail HoughWalkExtent(const int *hist, int histLen, int seedBin, int gap, int minCount, int *spacing, int *first, int *last, double *pitch);
+static DmtxPassFail HoughFitSide(DmtxDecode *dec, DmtxHoughGrid *grid, const DmtxHoughFrame *frame, int side, DmtxRegion *reg, DmtxRay2 *ray);
+static DmtxPassFail HoughFitLine(const DmtxPixelLoc *points, int count, int phi, int sign, DmtxRay2 *ray);
+
+/* dmtxruns.c */
+static DmtxRegion *RunsRegionFindNext(DmtxDecode *dec, DmtxTime *timeout);
+static DmtxRunList *RunListCreate(DmtxDecode *dec);
+static void RunListDestroy(DmtxRunList **list);
+static DmtxPassFail RunsThreshold(DmtxDecode *dec, DmtxRunList *list);
+static DmtxRun *RunsEncode(DmtxDecode *dec, DmtxRunList *list, int *runCount);
+static int RunsFindRoot(DmtxRun *runs, int idx);
+static void RunsJoin(DmtxRun *runs, int idx0, int idx1);
+static DmtxPassFail RunsAddCandidates(DmtxDecode *dec, DmtxRunList *list, DmtxRun *runs, int runCount);
+static int RunsPointCompare(const void *a, const void *b);
+static int RunsHull(DmtxVector2 *points, int count, DmtxVector2 *hull);
+static DmtxPassFail RunsFitBlob(DmtxDecode *dec, DmtxRunList *list, const DmtxRunBlob *blob, const DmtxVector2 *hull, int hullCount, DmtxRunCandidate *cand);
+static DmtxPassFail RunsFitSides(DmtxDecode *dec, DmtxRunList *list, const DmtxRunBlob *blob, const DmtxVector2 *hull, int hullCount, double angle0, double angle1, DmtxRunCandidate *cand);
+static double RunsFitArea(const DmtxVector2 *hull, int hullCount, double angle0, double angle1);
+static double RunsEdgeAngle(const DmtxVector2 *edge);
+static double RunsAngleDiff(double angle0, double angle1);
+static double RunsSideSolidity(DmtxDecode *dec, DmtxRunList *list, DmtxVector2 p0, DmtxVector2 p1, int dark);
+static int RunsCandidateCompare(const void *a, const void *b);
+static DmtxRegion *RunsRegionScan(DmtxDecode *dec, DmtxRunList *list, DmtxRunCandidate *cand);
+
+/* dmtxtiming.c */
+static DmtxBoolean CalibBarAlternates(DmtxDecode *dec, DmtxRegion *reg, int edgeLoc);
+
 /* dmtxdecode.c */
-static void TallyModuleJumps(DmtxDecode *dec, DmtxRegion *reg, int tally[][24], int xOrigin, int yOrigin, int mapWidth, int mapHeight, DmtxDirection dir);
+static void TallyModuleJumps(DmtxDecode *dec, DmtxRegion *reg, const DmtxSymbolInfo *symbolInfo, int tally[][24], int xOrigin, int yOrigin, int mapWidth, int mapHeight, DmtxDirection dir);
 static DmtxPassFail PopulateArrayFromMatrix(DmtxDecode *dec, DmtxRegion *reg, DmtxMessage *msg);
+static DmtxPassFail PreprocessInit(DmtxDecode *dec, int preprocess, int colorReduce);
+static DmtxBoolean PreprocessLumaWeights(DmtxImage *img, int *weights);
+static void PreprocessGather(DmtxDecode *dec, int x0, int y0, int size, unsigned char planes[][DmtxPreprocessBlockSize]);
+static void PreprocessReduce(DmtxDecode *dec, unsigned char planes[][DmtxPreprocessBlockSize], int count, int *out);
+static void PreprocessLevels(DmtxDecode *dec);
+static void PreprocessTile(DmtxDecode *dec, int tileCol, int tileRow);
+static DmtxMessage *DecodePopulatedArray(int sizeIdx, DmtxMessage *msg, int fix, DmtxDecodeStats *stats);
+static void StageBegin(DmtxDecode *dec, int stage, DmtxRegion *reg);
+static void StageEnd(DmtxDecode *dec, int stage, DmtxRegion *reg);
 
 /* dmtxdecodescheme.c */
 static DmtxPassFail DecodeDataStream(DmtxMessage *msg, int sizeIdx, unsigned char *outputStart);
@@ -172,9 +445,12 @@ static unsigned char *DecodeSchemeBase256(DmtxMessage *msg, unsigned char *ptr,
 /* dmtxencode.c */
 static void PrintPattern(DmtxEncode *encode);
 static int EncodeDataCodewords(DmtxByteList *input, DmtxByteList *output, int sizeIdxRequest, DmtxScheme scheme, int fnc1);
+static DmtxPassFail MosaicPlaneFits(DmtxEncode *enc, int inputSize, unsigned char *inputString, int sizeIdx);
+static DmtxPassFail MosaicFindSplit(DmtxEncode *enc, int inputSize, unsigned char *inputString, int sizeIdx, int *split);
+static DmtxMessage *MosaicEncodePlane(DmtxEncode *enc, int inputSize, unsigned char *inputString, int sizeIdx);
 
 /* dmtxplacemod.c */
-static int ModulePlacementEcc200(unsigned char *modules, unsigned char *codewords, int sizeIdx, int moduleOnColor);
+static int ModulePlacementEcc200(unsigned char *modules, unsigned char *codewords, const DmtxSymbolInfo *symbolInfo, int moduleOnColor);
 static void PatternShapeStandard(unsigned char *modules, int mappingRows, int mappingCols, int row, int col, unsigned char *codeword, int moduleOnColor);
 static void PatternShapeSpecial1(unsigned char *modules, int mappingRows, int mappingCols, unsigned char *codeword, int moduleOnColor);
 static void PatternShapeSpecial2(unsigned char *modules, int mappingRows, int mappingCols, unsigned char *codeword, int moduleOnColor);
@@ -184,8 +460,8 @@ static void PlaceModule(unsigned char *modules, int mappingRows, int mappingCols
       unsigned char *codeword, int mask, int moduleOnColor);
 
 /* dmtxreedsol.c */
-static DmtxPassFail RsEncode(DmtxMessage *message, int sizeIdx);
-static DmtxPassFail RsDecode(unsigned char *code, int sizeIdx, int fix);
+static DmtxPassFail RsEncode(DmtxMessage *message, const DmtxSymbolInfo *symbolInfo);
+static DmtxPassFail RsDecode(unsigned char *code, const DmtxSymbolInfo *symbolInfo, int fix, DmtxDecodeStats *stats);
 static DmtxPassFail RsGenPoly(DmtxByteList *gen, int errorWordCount);
 static DmtxBoolean RsComputeSyndromes(DmtxByteList *syn, const DmtxByteList *rec, int blockErrorWords);
 static DmtxBoolean RsFindErrorLocatorPoly(DmtxByteList *elp, const DmtxByteList *syn, int errorWordCount, int maxCorrectable);
@@ -201,8 +477,14 @@ static void SetDerivedFields(DmtxScanGrid *grid);
 /* dmtxsymbol.c */
 static int FindSymbolSize(int dataWords, int sizeIdxRequest);
 
+/* dmtxtrace.c */
+static void TraceRecord(DmtxTrace *trace, DmtxTime time, int stage, int phase, DmtxRegion *reg);
+
 /* dmtximage.c */
 static int GetBitsPerPixel(int pack);
+static DmtxBoolean PackLittleEndian(int pack);
+static int GetRowDataBytes(DmtxImage *img);
+static DmtxBoolean PackedNeighborhoodUniform(DmtxImage *img, int x, int y);
 
 /* dmtxencodestream.c */
 static DmtxEncodeStream StreamInit(DmtxByteList *input, DmtxByteList *output);
@@ -220,6 +502,14 @@ static void StreamInputAdvancePrev(DmtxEncodeStream *stream);
 
 /* dmtxencodescheme.c */
 static int EncodeSingleScheme(DmtxByteList *input, DmtxByteList *output, int sizeIdxRequest, DmtxScheme scheme, int fnc1);
+static int EncodeAutoFast(DmtxByteList *input, DmtxByteList *output, int sizeIdxRequest, int fnc1);
+static DmtxScheme LookAheadScheme(DmtxByteList *input, int inputNext, DmtxScheme currentScheme, int fnc1);
+static DmtxBoolean LookAheadLeads(int *count, DmtxScheme scheme, int margin);
+static DmtxBoolean AutoFastChunkFits(DmtxEncodeStream *stream, DmtxScheme scheme);
+static DmtxBoolean IsNativeC40(int value);
+static DmtxBoolean IsNativeText(int value);
+static DmtxBoolean IsNativeX12(int value);
+static DmtxBoolean IsNativeEdifact(int value);
 static void EncodeNextChunk(DmtxEncodeStream *stream, int scheme, int subScheme, int sizeIdxRequest);
 static void EncodeChangeScheme(DmtxEncodeStream *stream, DmtxScheme targetScheme, int unlatchType);
 static int GetRemainingSymbolCapacity(int outputLength, int sizeIdx);
@@ -37,6 +37,59 @@ getSizeIdxFromSymbolDimension(int rows, int cols)
 }
 
 
+/**
+ * Symbol attributes for every sizeIdx, precomputed so that decoding loops can
+ * resolve a symbol size once and then read plain struct members instead of
+ * dispatching through dmtxGetSymbolAttribute() for each value.
+ */
+static const DmtxSymbolInfo dmtxSymbolInfo[] = {
+/* sizeIdx  rows cols  region r/c  h  v  mapping r/c  blocks err corr  dataWords errWords corr */
+   {  0,  10,  10,  8,  8, 1, 1,   8,   8,  1,  5,  2,    3,    5,   2 },
+   {  1,  12,  12, 10, 10, 1, 1,  10,  10,  1,  7,  3,    5,    7,   3 },
+   {  2,  14,  14, 12, 12, 1, 1,  12,  12,  1, 10,  5,    8,   10,   5 },
+   {  3,  16,  16, 14, 14, 1, 1,  14,  14,  1, 12,  6,   12,   12,   6 },
+   {  4,  18,  18, 16, 16, 1, 1,  16,  16,  1, 14,  7,   18,   14,   7 },
+   {  5,  20,  20, 18, 18, 1, 1,  18,  18,  1, 18,  9,   22,   18,   9 },
+   {  6,  22,  22, 20, 20, 1, 1,  20,  20,  1, 20, 10,   30,   20,  10 },
+   {  7,  24,  24, 22, 22, 1, 1,  22,  22,  1, 24, 12,   36,   24,  12 },
+   {  8,  26,  26, 24, 24, 1, 1,  24,  24,  1, 28, 14,   44,   28,  14 },
+   {  9,  32,  32, 14, 14, 2, 2,  28,  28,  1, 36, 18,   62,   36,  18 },
+   { 10,  36,  36, 16, 16, 2, 2,  32,  32,  1, 42, 21,   86,   42,  21 },
+   { 11,  40,  40, 18, 18, 2, 2,  36,  36,  1, 48, 24,  114,   48,  24 },
+   { 12,  44,  44, 20, 20, 2, 2,  40,  40,  1, 56, 28,  144,   56,  28 },
+   { 13,  48,  48, 22, 22, 2, 2,  44,  44,  1, 68, 34,  174,   68,  34 },
+   { 14,  52,  52, 24, 24, 2, 2,  48,  48,  2, 42, 21,  204,   84,  42 },
+   { 15,  64,  64, 14, 14, 4, 4,  56,  56,  2, 56, 28,  280,  112,  56 },
+   { 16,  72,  72, 16, 16, 4, 4,  64,  64,  4, 36, 18,  368,  144,  72 },
+   { 17,  80,  80, 18, 18, 4, 4,  72,  72,  4, 48, 24,  456,  192,  96 },
+   { 18,  88,  88, 20, 20, 4, 4,  80,  80,  4, 56, 28,  576,  224, 112 },
+   { 19,  96,  96, 22, 22, 4, 4,  88,  88,  4, 68, 34,  696,  272, 136 },
+   { 20, 104, 104, 24, 24, 4, 4,  96,  96,  6, 56, 28,  816,  336, 168 },
+   { 21, 120, 120, 18, 18, 6, 6, 108, 108,  6, 68, 34, 1050,  408, 204 },
+   { 22, 132, 132, 20, 20, 6, 6, 120, 120,  8, 62, 31, 1304,  496, 248 },
+   { 23, 144, 144, 22, 22, 6, 6, 132, 132, 10, 62, 31, 1558,  620, 310 },
+   { 24,   8,  18,  6, 16, 1, 1,   6,  16,  1,  7,  3,    5,    7,   3 },
+   { 25,   8,  32,  6, 14, 2, 1,   6,  28,  1, 11,  5,   10,   11,   5 },
+   { 26,  12,  26, 10, 24, 1, 1,  10,  24,  1, 14,  7,   16,   14,   7 },
+   { 27,  12,  36, 10, 16, 2, 1,  10,  32,  1, 18,  9,   22,   18,   9 },
+   { 28,  16,  36, 14, 16, 2, 1,  14,  32,  1, 24, 12,   32,   24,  12 },
+   { 29,  16,  48, 14, 22, 2, 1,  14,  44,  1, 28, 14,   49,   28,  14 }
+};
+
+/**
+ * \brief  Retrieve precomputed attributes for a symbol size
+ * \param  sizeIdx
+ * \return Pointer to read-only symbol info (or NULL if sizeIdx is invalid)
+ */
+extern const DmtxSymbolInfo *
+dmtxGetSymbolInfo(int sizeIdx)
+{
+   if(sizeIdx < 0 || sizeIdx >= DmtxSymbolSquareCount + DmtxSymbolRectCount)
+      return NULL;
+
+   return &dmtxSymbolInfo[sizeIdx];
+}
+
 /**
  * \brief  Retrieve property based on symbol size，此处的sizeIdx是否为DM码每行的小方格数目
  * \param  attribute
@@ -46,93 +99,41 @@ getSizeIdxFromSymbolDimension(int rows, int cols)
 extern int
 dmtxGetSymbolAttribute(int attribute, int sizeIdx)
 {
-   static const int symbolRows[] = { 10, 12, 14, 16, 18, 20,  22,  24,  26,
-                                                 32, 36, 40,  44,  48,  52,
-                                                 64, 72, 80,  88,  96, 104,
-                                                        120, 132, 144,
-                                                  8,  8, 12,  12,  16,  16 };
-
-   static const int symbolCols[] = { 10, 12, 14, 16, 18, 20,  22,  24,  26,
-                                                 32, 36, 40,  44,  48,  52,
-                                                 64, 72, 80,  88,  96, 104,
-                                                        120, 132, 144,
-                                                 18, 32, 26,  36,  36,  48 };
-
-   static const int dataRegionRows[] = { 8, 10, 12, 14, 16, 18, 20, 22, 24,
-                                                    14, 16, 18, 20, 22, 24,
-                                                    14, 16, 18, 20, 22, 24,
-                                                            18, 20, 22,
-                                                     6,  6, 10, 10, 14, 14 };
-
-   static const int dataRegionCols[] = { 8, 10, 12, 14, 16, 18, 20, 22, 24,
-                                                    14, 16, 18, 20, 22, 24,
-                                                    14, 16, 18, 20, 22, 24,
-                                                            18, 20, 22,
-                                                    16, 14, 24, 16, 16, 22 };
-
-   static const int horizDataRegions[] = { 1, 1, 1, 1, 1, 1, 1, 1, 1,
-                                                    2, 2, 2, 2, 2, 2,
-                                                    4, 4, 4, 4, 4, 4,
-                                                          6, 6, 6,
-                                                    1, 2, 1, 2, 2, 2 };
-
-   static const int interleavedBlocks[] = { 1, 1, 1, 1, 1, 1, 1,  1, 1,
-                                                     1, 1, 1, 1,  1, 2,
-                                                     2, 4, 4, 4,  4, 6,
-                                                           6, 8, 10,
-                                                     1, 1, 1, 1,  1, 1 };
-
-   static const int symbolDataWords[] = { 3, 5, 8,  12,   18,   22,   30,   36,  44,
-                                                    62,   86,  114,  144,  174, 204,
-                                                   280,  368,  456,  576,  696, 816,
-                                                              1050, 1304, 1558,
-                                                     5,   10,   16,   22,   32,  49 };
-
-   static const int blockErrorWords[] = { 5, 7, 10, 12, 14, 18, 20, 24, 28,
-                                                    36, 42, 48, 56, 68, 42,
-                                                    56, 36, 48, 56, 68, 56,
-                                                            68, 62, 62,
-                                                     7, 11, 14, 18, 24, 28 };
-
-   static const int blockMaxCorrectable[] = { 2, 3, 5,  6,  7,  9,  10,  12,  14,
-                                                       18, 21, 24,  28,  34,  21,
-                                                       28, 18, 24,  28,  34,  28,
-                                                               34,  31,  31,
-                                                   3,  5,  7,   9,  12,  14 };
+   const DmtxSymbolInfo *info;
 
-   if(sizeIdx < 0 || sizeIdx >= DmtxSymbolSquareCount + DmtxSymbolRectCount)
+   info = dmtxGetSymbolInfo(sizeIdx);
+   if(info == NULL)
       return DmtxUndefined;
 
    switch(attribute) {
       case DmtxSymAttribSymbolRows:
-         return symbolRows[sizeIdx];
+         return info->symbolRows;
       case DmtxSymAttribSymbolCols:
-         return symbolCols[sizeIdx];
+         return info->symbolCols;
       case DmtxSymAttribDataRegionRows:
-         return dataRegionRows[sizeIdx];
+         return info->dataRegionRows;
       case DmtxSymAttribDataRegionCols:
-         return dataRegionCols[sizeIdx];
+         return info->dataRegionCols;
       case DmtxSymAttribHorizDataRegions:
-         return horizDataRegions[sizeIdx];
+         return info->horizDataRegions;
       case DmtxSymAttribVertDataRegions:
-         return (sizeIdx < DmtxSymbolSquareCount) ? horizDataRegions[sizeIdx] : 1;
+         return info->vertDataRegions;
       case DmtxSymAttribMappingMatrixRows:
-         return dataRegionRows[sizeIdx] *
-               dmtxGetSymbolAttribute(DmtxSymAttribVertDataRegions, sizeIdx);
+         return info->mappingRows;
       case DmtxSymAttribMappingMatrixCols:
-         return dataRegionCols[sizeIdx] * horizDataRegions[sizeIdx];
+         return info->mappingCols;
       case DmtxSymAttribInterleavedBlocks:
-         return interleavedBlocks[sizeIdx];
+         return info->interleavedBlocks;
       case DmtxSymAttribBlockErrorWords:
-         return blockErrorWords[sizeIdx];
+         return info->blockErrorWords;
       case DmtxSymAttribBlockMaxCorrectable:
-         return blockMaxCorrectable[sizeIdx];
+         return info->blockMaxCorrectable;
       case DmtxSymAttribSymbolDataWords:
-         return symbolDataWords[sizeIdx];
+         return info->symbolDataWords;
       case DmtxSymAttribSymbolErrorWords:
-         return blockErrorWords[sizeIdx] * interleavedBlocks[sizeIdx];
+         return info->symbolErrorWords;
       case DmtxSymAttribSymbolMaxCorrectable:
-         return blockMaxCorrectable[sizeIdx] * interleavedBlocks[sizeIdx];
+         return info->symbolMaxCorrectable;
    }
 
    return DmtxUndefined;
@@ -147,17 +148,14 @@ dmtxGetSymbolAttribute(int attribute, int sizeIdx)
 extern int
 dmtxGetBlockDataSize(int sizeIdx, int blockIdx)
 {
-   int symbolDataWords;
-   int interleavedBlocks;
+   const DmtxSymbolInfo *info;
    int count;
 
-   symbolDataWords = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, sizeIdx);
-   interleavedBlocks = dmtxGetSymbolAttribute(DmtxSymAttribInterleavedBlocks, sizeIdx);
-
-   if(symbolDataWords < 1 || interleavedBlocks < 1)
+   info = dmtxGetSymbolInfo(sizeIdx);
+   if(info == NULL)
       return DmtxUndefined;
 
-   count = (int)(symbolDataWords/interleavedBlocks);
+   count = (int)(info->symbolDataWords/info->interleavedBlocks);
 
    return (sizeIdx == DmtxSymbol144x144 && blockIdx < 8) ? count + 1 : count;
 }
@@ -0,0 +1,84 @@
+/**
+ * libdmtx - Data Matrix Encoding/Decoding Library
+ *
+ * See LICENSE file in the main project directory for full
+ * terms of use and distribution.
+ *
+ * \file dmtxtiming.c
+ * \brief Calibration bar probes
+ *
+ * The calibration bars alternate dark and light one module at a time, so a
+ * profile sampled evenly along a fitted bar changes color at every module.
+ * A sparse probe of that profile is enough to tell whether a candidate
+ * deserves the full size search.
+ */
+
+/**
+ * \brief  Check that the top or right edge of a region alternates
+ * \param  dec
+ * \param  reg Region with a current fit2raw
+ * \param  edgeLoc DmtxEdgeTop or DmtxEdgeRight
+ * \return DmtxTrue if the edge could hold a calibration bar, or is too small
+ *         to tell
+ *
+ * Samples a line about 2 pixels inside the edge and counts swings across
+ * the middle of the profile's range. A band around the middle keeps
+ * noise on a flat edge from counting.
+ */
+static DmtxBoolean
+CalibBarAlternates(DmtxDecode *dec, DmtxRegion *reg, int edgeLoc)
+{
+   int i, color, colorMin, colorMax, mid, band, dark, darkPrev, swings;
+   int colors[DmtxTimingProbeSamples];
+   double depth, across;
+   DmtxVector2 p[DmtxTimingProbeSamples], p0, p1, pTmp;
+
+   p0.X = p0.Y = 0.0;
+   p1.X = (edgeLoc == DmtxEdgeTop) ? 0.0 : 1.0;
+   p1.Y = (edgeLoc == DmtxEdgeTop) ? 1.0 : 0.0;
+   dmtxMatrix3VMultiplyBy(&p0, reg->fit2raw);
+   dmtxMatrix3VMultiplyBy(&p1, reg->fit2raw);
+   across = dmtxVector2Mag(dmtxVector2Sub(&pTmp, &p1, &p0));
+   if(across < 8.0)
+      return DmtxTrue;
+   depth = 1.0 - 2.0/across;
+
+   for(i = 0; i < DmtxTimingProbeSamples; i++) {
+      p[i].X = (edgeLoc == DmtxEdgeTop) ? (i + 0.5)/DmtxTimingProbeSamples : depth;
+      p[i].Y = (edgeLoc == DmtxEdgeTop) ? depth : (i + 0.5)/DmtxTimingProbeSamples;
+   }
+   dmtxMatrix3VMultiplyN(p, p, DmtxTimingProbeSamples, reg->fit2raw);
+
+   colorMin = 255;
+   colorMax = 0;
+   for(i = 0; i < DmtxTimingProbeSamples; i++) {
+      color = 0;
+      dmtxDecodeGetPixelValue(dec, (int)(p[i].X + 0.5), (int)(p[i].Y + 0.5),
+            reg->flowBegin.plane, &color);
+      colors[i] = color;
+      colorMin = min(colorMin, color);
+      colorMax = max(colorMax, color);
+   }
+
+   /* Same percent scale as DmtxPropEdgeThresh */
+   if(colorMax - colorMin < (int)(dec->edgeThresh * 2.55 + 0.5))
+      return DmtxFalse;
+
+   mid = (colorMax + colorMin)/2;
+   band = (colorMax - colorMin)/4;
+   darkPrev = DmtxUndefined;
+   for(i = 0, swings = 0; i < DmtxTimingProbeSamples; i++) {
+      if(colors[i] < mid - band)
+         dark = 1;
+      else if(colors[i] > mid + band)
+         dark = 0;
+      else
+         continue;
+
+      if(darkPrev != DmtxUndefined && dark != darkPrev)
+         swings++;
+      darkPrev = dark;
+   }
+
+   return (swings >= DmtxTimingProbeSwings) ? DmtxTrue : DmtxFalse;
+}
@@ -0,0 +1,174 @@
+/**
+ * libdmtx - Data Matrix Encoding/Decoding Library
+ *
+ * See LICENSE file in the main project directory for full
+ * terms of use and distribution.
+ *
+ * \file dmtxtrace.c
+ * \brief Decoder stage events, exported as Chrome trace JSON
+ *
+ * A trace is a fixed ring of events written without locking, so it must
+ * only be fed by decoders running on one thread. Give each worker thread
+ * its own trace and export them together once the workers are idle. The
+ * JSON produced by dmtxTraceCreateJson() loads in chrome://tracing and in
+ * the Perfetto UI.
+ */
+
+static const char *dmtxTraceStageName[] = {
+   "FindNext",
+   "Orient",
+   "Fit",
+   "Size",
+   "Decode"
+};
+
+/**
+ * \brief  Allocate an event ring
+ * \param  capacity Number of most recent events kept
+ * \param  tid Thread id written with each event
+ * \return Address of allocated memory
+ */
+extern DmtxTrace *
+dmtxTraceCreate(int capacity, int tid)
+{
+   DmtxTrace *trace;
+
+   if(capacity < 1)
+      return NULL;
+
+   trace = (DmtxTrace *)calloc(1, sizeof(DmtxTrace));
+   if(trace == NULL)
+      return NULL;
+
+   trace->events = (DmtxTraceEvent *)malloc(capacity * sizeof(DmtxTraceEvent));
+   if(trace->events == NULL) {
+      free(trace);
+      return NULL;
+   }
+
+   trace->tid = tid;
+   trace->capacity = capacity;
+
+   return trace;
+}
+
+/**
+ * \brief  Free event ring
+ * \param  trace
+ * \return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+dmtxTraceDestroy(DmtxTrace **trace)
+{
+   if(trace == NULL || *trace == NULL)
+      return DmtxFail;
+
+   free((*trace)->events);
+   free(*trace);
+
+   *trace = NULL;
+
+   return DmtxPass;
+}
+
+/**
+ * \brief  Write the retained events of several traces as one Chrome trace
+ * \param  traces
+ * \param  traceCount
+ * \param  jsonBytes Receives the length of the returned text
+ * \return NUL terminated JSON that the caller frees, or NULL
+ *
+ * Timestamps are microseconds from the earliest retained event.
+ */
+extern char *
+dmtxTraceCreateJson(DmtxTrace **traces, int traceCount, int *jsonBytes)
+{
+   int i, n;
+   long j, first, total;
+   char *json, *ptr;
+   DmtxTime t0;
+   DmtxTraceEvent *event;
+
+   if(traces == NULL || traceCount < 0)
+      return NULL;
+
+   /* Find the earliest retained event to use as time zero */
+   total = 0;
+   t0.sec = 0;
+   t0.usec = 0;
+   for(i = 0; i < traceCount; i++) {
+      if(traces[i] == NULL || traces[i]->count == 0)
+         continue;
+      first = (traces[i]->count > traces[i]->capacity) ? traces[i]->count - traces[i]->capacity : 0;
+      event = &traces[i]->events[first % traces[i]->capacity];
+      if(total == 0 || event->time.sec < t0.sec ||
+            (event->time.sec == t0.sec && event->time.usec < t0.usec))
+         t0 = event->time;
+      total += traces[i]->count - first;
+   }
+
+   /* Longest event line is well under 160 characters */
+   json = (char *)malloc(total * 160 + 64);
+   if(json == NULL)
+      return NULL;
+
+   ptr = json;
+   ptr += sprintf(ptr, "{\"traceEvents\":[");
+
+   n = 0;
+   for(i = 0; i < traceCount; i++) {
+      if(traces[i] == NULL)
+         continue;
+      first = (traces[i]->count > traces[i]->capacity) ? traces[i]->count - traces[i]->capacity : 0;
+      for(j = first; j < traces[i]->count; j++) {
+         event = &traces[i]->events[j % traces[i]->capacity];
+         ptr += sprintf(ptr, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%ld,\"pid\":1,\"tid\":%d",
+               (n++ > 0) ? "," : "", dmtxTraceStageName[event->stage], event->phase,
+               (long)(event->time.sec - t0.sec) * 1000000L + ((long)event->time.usec - (long)t0.usec),
+               traces[i]->tid);
+         if(event->regionId != DmtxUndefined)
+            ptr += sprintf(ptr, ",\"args\":{\"region\":%d,\"x\":%d,\"y\":%d}",
+                  event->regionId, event->x, event->y);
+         ptr += sprintf(ptr, "}");
+      }
+   }
+
+   ptr += sprintf(ptr, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+   if(jsonBytes != NULL)
+      *jsonBytes = (int)(ptr - json);
+
+   return json;
+}
+
+/**
+ * \brief  Append one event, overwriting the oldest when full
+ * \param  trace
+ * \param  time
+ * \param  stage DmtxStatsStage
+ * \param  phase 'B' or 'E'
+ * \param  reg Candidate region, or NULL
+ * \return void
+ */
+static void
+TraceRecord(DmtxTrace *trace, DmtxTime time, int stage, int phase, DmtxRegion *reg)
+{
+   DmtxTraceEvent *event;
+
+   event = &trace->events[trace->count % trace->capacity];
+   event->time = time;
+   event->stage = stage;
+   event->phase = phase;
+
+   if(reg != NULL) {
+      event->regionId = reg->traceId;
+      event->x = reg->flowBegin.loc.X;
+      event->y = reg->flowBegin.loc.Y;
+   }
+   else {
+      event->regionId = DmtxUndefined;
+      event->x = event->y = DmtxUndefined;
+   }
+
+   trace->count++;
+}
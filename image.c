@@ -2,11 +2,25 @@
 // Created by Jia-Baos on 2023/9/22.
 //
 
+// aligned_alloc() is C11, expose it to builds using -std=c99
+#define _ISOC11_SOURCE
+
 #include "image.h"
 #include <xmmintrin.h>
 
 typedef __v4sf v4sf;
 
+/* generic kernels use 8 lanes when compiled with AVX enabled, 4 (SSE) otherwise */
+#ifdef __AVX__
+#define CONV_LANES 8
+#else
+#define CONV_LANES 4
+#endif
+
+/* unaligned vectors, so a tap can be read at any column offset */
+typedef float conv_vf __attribute__((vector_size(CONV_LANES * 4), aligned(4)));
+typedef int conv_vi __attribute__((vector_size(CONV_LANES * 4), aligned(4)));
+
 /********** Create/Delete **********/
 
 /* allocate a new image of size width x height */
@@ -259,6 +273,21 @@ static void convolve_extract_coeffs(const int order, const float *half_coeffs, f
   }
 }
 
+/* quantize coefficients to CONV_FIXED_BITS, pushing the rounding error into the center tap so
+ * that a smoothing filter still sums exactly to one */
+static void convolve_fixed_coeffs(const int taps, const float *coeffs, int *coeffs_fixed)
+{
+  int i, sum_fixed = 0;
+  float sum = 0.0f;
+  for (i = 0; i < taps; i++)
+  {
+    coeffs_fixed[i] = (int)lrintf(coeffs[i] * (1 << CONV_FIXED_BITS));
+    sum_fixed += coeffs_fixed[i];
+    sum += coeffs[i];
+  }
+  coeffs_fixed[taps / 2] += (int)lrintf(sum * (1 << CONV_FIXED_BITS)) - sum_fixed;
+}
+
 /* create a convolution structure with a given order, half_coeffs, symmetric or anti-symmetric according to even
  * parameter */
 convolution *convolution_new(const int order, const float *half_coeffs, const int even)
@@ -286,6 +315,16 @@ convolution *convolution_new(const int order, const float *half_coeffs, const in
     exit(1);
   }
   convolve_extract_coeffs(order, half_coeffs, conv->coeffs, conv->coeffs_accu, even);
+  conv->coeffs_fixed = (int *)malloc((2 * order + 1) * sizeof(int));
+  if (conv->coeffs_fixed == NULL)
+  {
+    printf("Error: convolution_new() - not enough memory !");
+    free(conv->coeffs_accu);
+    free(conv->coeffs);
+    free(conv);
+    exit(1);
+  }
+  convolve_fixed_coeffs(2 * order + 1, conv->coeffs, conv->coeffs_fixed);
   return conv;
 }
 
@@ -482,6 +521,74 @@ static void convolve_horiz_fast_5(gray_image *dst, const gray_image *src, const
   free(src_p1);
 }
 
+/* copy a row between order replicated border pixels on each side, plus enough slack on the right
+ * for the last vector of the padded stride */
+static void convolve_extend_row(float *ext, const float *row, const int width, const int stride, const int order)
+{
+  int i;
+  for (i = 0; i < order; i++)
+  {
+    ext[i] = row[0];
+  }
+  memcpy(ext + order, row, width * sizeof(float));
+  for (i = order + width; i < stride + 2 * order + CONV_LANES; i++)
+  {
+    ext[i] = row[width - 1];
+  }
+}
+
+/* horizontal convolution of one extended row, any number of taps */
+static void convolve_row_horiz(float *dst, const float *ext, const int stride, const float *coeffs, const int taps)
+{
+  int i, k;
+  for (i = 0; i + CONV_LANES <= stride; i += CONV_LANES)
+  {
+    conv_vf sum = coeffs[0] * *(const conv_vf *)(ext + i);
+    for (k = 1; k < taps; k++)
+    {
+      sum += coeffs[k] * *(const conv_vf *)(ext + i + k);
+    }
+    *(conv_vf *)(dst + i) = sum;
+  }
+  for (; i < stride; i++)
+  {
+    float sum = 0.0f;
+    for (k = 0; k < taps; k++)
+    {
+      sum += coeffs[k] * ext[i + k];
+    }
+    dst[i] = sum;
+  }
+}
+
+/* vertical convolution producing one row from taps source rows, already clamped to the image */
+static void convolve_row_vert(float *dst, const float *const *rows, const int stride, const float *coeffs,
+                              const int taps)
+{
+  int i, k;
+  for (i = 0; i + CONV_LANES <= stride; i += CONV_LANES)
+  {
+    conv_vf sum = coeffs[0] * *(const conv_vf *)(rows[0] + i);
+    for (k = 1; k < taps; k++)
+    {
+      sum += coeffs[k] * *(const conv_vf *)(rows[k] + i);
+    }
+    *(conv_vf *)(dst + i) = sum;
+  }
+  for (; i < stride; i++)
+  {
+    float sum = 0.0f;
+    for (k = 0; k < taps; k++)
+    {
+      sum += coeffs[k] * rows[k][i];
+    }
+    dst[i] = sum;
+  }
+}
+
+/* clamp a row index to the image, which replicates the first and last rows */
+static int convolve_clamp(const int i, const int size) { return (i < 0) ? 0 : (i >= size) ? size - 1 : i; }
+
 /* perform an horizontal convolution of an image */
 void convolve_horiz(gray_image *dest, const gray_image *src, const convolution *conv)
 {
@@ -495,53 +602,19 @@ void convolve_horiz(gray_image *dest, const gray_image *src, const convolution *
     convolve_horiz_fast_5(dest, src, conv);
     return;
   }
-  float *in = src->data;
-  float *out = dest->data;
-  int i, j, ii;
-  float *o = out;
-  int i0 = -conv->order;
-  int i1 = +conv->order;
-  float *coeff = conv->coeffs + conv->order;
-  float *coeff_accu = conv->coeffs_accu + conv->order;
+  float *ext = (float *)malloc((src->stride + 2 * conv->order + CONV_LANES) * sizeof(float));
+  if (ext == NULL)
+  {
+    printf("error convolve_horiz(): not enough memory");
+    exit(1);
+  }
+  int j;
   for (j = 0; j < src->height; j++)
   {
-    const float *al = in + j * src->stride;
-    const float *f0 = coeff + i0;
-    float sum;
-    for (i = 0; i < -i0; i++)
-    {
-      sum = coeff_accu[-i - 1] * al[0];
-      for (ii = i1 + i; ii >= 0; ii--)
-      {
-        sum += coeff[ii - i] * al[ii];
-      }
-      *o++ = sum;
-    }
-    for (; i < src->width - i1; i++)
-    {
-      sum = 0;
-      for (ii = i1 - i0; ii >= 0; ii--)
-      {
-        sum += f0[ii] * al[ii];
-      }
-      al++;
-      *o++ = sum;
-    }
-    for (; i < src->width; i++)
-    {
-      sum = coeff_accu[src->width - i] * al[src->width - i0 - 1 - i];
-      for (ii = src->width - i0 - 1 - i; ii >= 0; ii--)
-      {
-        sum += f0[ii] * al[ii];
-      }
-      al++;
-      *o++ = sum;
-    }
-    for (i = 0; i < src->stride - src->width; i++)
-    {
-      o++;
-    }
+    convolve_extend_row(ext, src->data + j * src->stride, src->width, src->stride, conv->order);
+    convolve_row_horiz(dest->data + j * src->stride, ext, src->stride, conv->coeffs, 2 * conv->order + 1);
   }
+  free(ext);
 }
 
 /* perform a vertical convolution of an image */
@@ -557,126 +630,238 @@ void convolve_vert(gray_image *dest, const gray_image *src, const convolution *c
     convolve_vert_fast_5(dest, src, conv);
     return;
   }
-  float *in = src->data;
-  float *out = dest->data;
-  int i0 = -conv->order;
-  int i1 = +conv->order;
-  float *coeff = conv->coeffs + conv->order;
-  float *coeff_accu = conv->coeffs_accu + conv->order;
-  int i, j, ii;
-  float *o = out;
-  const float *alast = in + src->stride * (src->height - 1);
-  const float *f0 = coeff + i0;
-  for (i = 0; i < -i0; i++)
-  {
-    float fa = coeff_accu[-i - 1];
-    const float *al = in + i * src->stride;
-    for (j = 0; j < src->width; j++)
+  const int taps = 2 * conv->order + 1;
+  const float **rows = (const float **)malloc(taps * sizeof(float *));
+  if (rows == NULL)
+  {
+    printf("error convolve_vert(): not enough memory");
+    exit(1);
+  }
+  int i, k;
+  for (i = 0; i < src->height; i++)
+  {
+    for (k = 0; k < taps; k++)
     {
-      float sum = fa * in[j];
-      for (ii = -i; ii <= i1; ii++)
-      {
-        sum += coeff[ii] * al[j + ii * src->stride];
-      }
-      *o++ = sum;
+      rows[k] = src->data + convolve_clamp(i + k - conv->order, src->height) * src->stride;
     }
-    for (j = 0; j < src->stride - src->width; j++)
+    convolve_row_vert(dest->data + i * src->stride, rows, src->stride, conv->coeffs, taps);
+  }
+  free(rows);
+}
+
+/* free memory of a convolution structure */
+void convolution_delete(convolution *conv)
+{
+  if (conv)
+  {
+    free(conv->coeffs);
+    free(conv->coeffs_accu);
+    free(conv->coeffs_fixed);
+    free(conv);
+  }
+}
+
+/* pass-through filter standing in for a missing horizontal or vertical convolution */
+static float convolve_identity_coeff = 1.0f;
+static int convolve_identity_fixed = 1 << CONV_FIXED_BITS;
+static const convolution convolve_identity = {0, &convolve_identity_coeff, &convolve_identity_coeff,
+                                              &convolve_identity_fixed};
+
+/* perform horizontal and/or vertical convolution to a color image
+ *
+ * The three planes are filtered in one pass over the rows. Horizontally filtered rows are kept in a
+ * small ring per plane, just deep enough for the vertical filter, so no full-size intermediate image
+ * is written and read back. dst may be src. */
+void color_image_convolve_hv(color_image *dst, const color_image *src, const convolution *horiz_conv,
+                             const convolution *vert_conv)
+{
+  const int width = src->width, height = src->height, stride = src->stride;
+  const convolution *hconv = (horiz_conv != NULL) ? horiz_conv : &convolve_identity;
+  const convolution *vconv = (vert_conv != NULL) ? vert_conv : &convolve_identity;
+  const int ring_rows = 2 * vconv->order + 1;
+  const float *src_planes[3] = {src->data1, src->data2, src->data3};
+  float *dst_planes[3] = {dst->data1, dst->data2, dst->data3};
+  int i, k, c, next = 0;
+
+  if (horiz_conv == NULL && vert_conv == NULL)
+  {
+    if (dst != src)
     {
-      o++;
+      memcpy(dst->data1, src->data1, 3 * stride * height * sizeof(float));
     }
+    return;
   }
-  for (; i < src->height - i1; i++)
+
+  float *ext = (float *)malloc((stride + 2 * hconv->order + CONV_LANES) * sizeof(float));
+  float *ring = (float *)malloc(3 * ring_rows * stride * sizeof(float));
+  const float **rows = (const float **)malloc(ring_rows * sizeof(float *));
+  if (ext == NULL || ring == NULL || rows == NULL)
+  {
+    printf("error color_image_convolve_hv(): not enough memory");
+    exit(1);
+  }
+
+  for (i = 0; i < height; i++)
   {
-    const float *al = in + (i + i0) * src->stride;
-    for (j = 0; j < src->width; j++)
+    // filter horizontally every source row the vertical filter of row i reaches
+    for (; next <= i + vconv->order && next < height; next++)
     {
-      float sum = 0;
-      const float *al2 = al;
-      for (ii = 0; ii <= i1 - i0; ii++)
+      for (c = 0; c < 3; c++)
       {
-        sum += f0[ii] * al2[0];
-        al2 += src->stride;
+        convolve_extend_row(ext, src_planes[c] + next * stride, width, stride, hconv->order);
+        convolve_row_horiz(ring + (c * ring_rows + next % ring_rows) * stride, ext, stride, hconv->coeffs,
+                           2 * hconv->order + 1);
       }
-      *o++ = sum;
-      al++;
     }
-    for (j = 0; j < src->stride - src->width; j++)
+    for (c = 0; c < 3; c++)
     {
-      o++;
+      for (k = 0; k < ring_rows; k++)
+      {
+        rows[k] = ring + (c * ring_rows + convolve_clamp(i + k - vconv->order, height) % ring_rows) * stride;
+      }
+      convolve_row_vert(dst_planes[c] + i * stride, rows, stride, vconv->coeffs, ring_rows);
     }
   }
-  for (; i < src->height; i++)
+
+  free(rows);
+  free(ring);
+  free(ext);
+}
+
+/* fixed-point counterpart of color_image_convolve_hv() for one 8-bit or 16-bit plane, extra_bits of
+ * sub-pixel precision are kept between the horizontal and vertical passes, stride counts elements of
+ * the plane type so it is a byte pitch for 8-bit planes and a 2-byte pitch for 16-bit planes */
+static void convolve_hv_fixed(void *dst, const void *src, const int bytes, const int extra_bits, const int width,
+                              const int height, const int stride, const convolution *horiz_conv,
+                              const convolution *vert_conv)
+{
+  const convolution *hconv = (horiz_conv != NULL) ? horiz_conv : &convolve_identity;
+  const convolution *vconv = (vert_conv != NULL) ? vert_conv : &convolve_identity;
+  const int htaps = 2 * hconv->order + 1, ring_rows = 2 * vconv->order + 1;
+  const int row_len = ((width + CONV_LANES - 1) / CONV_LANES) * CONV_LANES;
+  const int hshift = CONV_FIXED_BITS - extra_bits, vshift = CONV_FIXED_BITS + extra_bits;
+  const int max_value = (bytes == 1) ? 0xff : 0xffff;
+  int i, j, k, next = 0;
+
+  int *ext = (int *)malloc((row_len + 2 * hconv->order) * sizeof(int));
+  int *ring = (int *)malloc(ring_rows * row_len * sizeof(int));
+  int *out = (int *)malloc(row_len * sizeof(int));
+  const int **rows = (const int **)malloc(ring_rows * sizeof(int *));
+  if (ext == NULL || ring == NULL || out == NULL || rows == NULL)
+  {
+    printf("error convolve_hv_fixed(): not enough memory");
+    exit(1);
+  }
+
+  for (i = 0; i < height; i++)
   {
-    float fa = coeff_accu[src->height - i];
-    const float *al = in + i * src->stride;
-    for (j = 0; j < src->width; j++)
+    for (; next <= i + vconv->order && next < height; next++)
     {
-      float sum = fa * alast[j];
-      for (ii = i0; ii <= src->height - 1 - i; ii++)
+      // widen the row, replicating the border pixels
+      if (bytes == 1)
+      {
+        const unsigned char *row = (const unsigned char *)src + (size_t)next * stride;
+        for (j = 0; j < row_len + 2 * hconv->order; j++)
+          ext[j] = row[convolve_clamp(j - hconv->order, width)];
+      }
+      else
+      {
+        const unsigned short *row = (const unsigned short *)src + (size_t)next * stride;
+        for (j = 0; j < row_len + 2 * hconv->order; j++)
+          ext[j] = row[convolve_clamp(j - hconv->order, width)];
+      }
+      int *hrow = ring + (next % ring_rows) * row_len;
+      for (j = 0; j < row_len; j += CONV_LANES)
       {
-        sum += coeff[ii] * al[j + ii * src->stride];
+        conv_vi sum = hconv->coeffs_fixed[0] * *(const conv_vi *)(ext + j);
+        for (k = 1; k < htaps; k++)
+        {
+          sum += hconv->coeffs_fixed[k] * *(const conv_vi *)(ext + j + k);
+        }
+        *(conv_vi *)(hrow + j) = (sum + (1 << hshift >> 1)) >> hshift;
       }
-      *o++ = sum;
     }
-    for (j = 0; j < src->stride - src->width; j++)
+    for (k = 0; k < ring_rows; k++)
     {
-      o++;
+      rows[k] = ring + (convolve_clamp(i + k - vconv->order, height) % ring_rows) * row_len;
+    }
+    for (j = 0; j < row_len; j += CONV_LANES)
+    {
+      conv_vi sum = vconv->coeffs_fixed[0] * *(const conv_vi *)(rows[0] + j);
+      for (k = 1; k < ring_rows; k++)
+      {
+        sum += vconv->coeffs_fixed[k] * *(const conv_vi *)(rows[k] + j);
+      }
+      *(conv_vi *)(out + j) = (sum + (1 << vshift >> 1)) >> vshift;
+    }
+    // saturate back to the pixel type
+    if (bytes == 1)
+    {
+      unsigned char *row = (unsigned char *)dst + (size_t)i * stride;
+      for (j = 0; j < width; j++)
+        row[j] = (unsigned char)(out[j] < 0 ? 0 : out[j] > max_value ? max_value : out[j]);
+    }
+    else
+    {
+      unsigned short *row = (unsigned short *)dst + (size_t)i * stride;
+      for (j = 0; j < width; j++)
+        row[j] = (unsigned short)(out[j] < 0 ? 0 : out[j] > max_value ? max_value : out[j]);
     }
   }
+
+  free(rows);
+  free(out);
+  free(ring);
+  free(ext);
 }
 
-/* free memory of a convolution structure */
-void convolution_delete(convolution *conv)
+/* perform horizontal and/or vertical convolution of an 8-bit plane in fixed point, stride in bytes */
+void convolve_hv_u8(unsigned char *dst, const unsigned char *src, const int width, const int height, const int stride,
+                    const convolution *horiz_conv, const convolution *vert_conv)
 {
-  if (conv)
-  {
-    free(conv->coeffs);
-    free(conv->coeffs_accu);
-    free(conv);
-  }
+  convolve_hv_fixed(dst, src, 1, 4, width, height, stride, horiz_conv, vert_conv);
 }
 
-/* perform horizontal and/or vertical convolution to a color image */
-void color_image_convolve_hv(color_image *dst, const color_image *src, const convolution *horiz_conv,
-                             const convolution *vert_conv)
+/* perform horizontal and/or vertical convolution of a 16-bit plane in fixed point, stride in unsigned
+ * shorts */
+void convolve_hv_u16(unsigned short *dst, const unsigned short *src, const int width, const int height,
+                     const int stride, const convolution *horiz_conv, const convolution *vert_conv)
 {
-  const int width = src->width, height = src->height, stride = src->stride;
-  // separate channels of images
-  gray_image src_red = {width, height, stride, src->data1};
-  gray_image src_green = {width, height, stride, src->data2};
-  gray_image src_blue = {width, height, stride, src->data3};
-  gray_image dst_red = {width, height, stride, dst->data1};
-  gray_image dst_green = {width, height, stride, dst->data2};
-  gray_image dst_blue = {width, height, stride, dst->data3};
-  // horizontal and vertical
-  if (horiz_conv != NULL && vert_conv != NULL)
-  {
-    float *tmp_data = (float *)malloc(sizeof(float) * stride * height);
-    if (tmp_data == NULL)
+  convolve_hv_fixed(dst, src, 2, 0, width, height, stride, horiz_conv, vert_conv);
+}
+
+/************ Geometry ******/
+
+/* resample an 8-bit plane through a projective transform with bilinear interpolation */
+void image_warp_u8(unsigned char *dst, const int dst_width, const int dst_height, const int dst_stride,
+                   const unsigned char *src, const int src_width, const int src_height, const int src_stride,
+                   const float *h, const unsigned char fill)
+{
+  for (int i = 0; i < dst_height; i++)
+  {
+    unsigned char *row = dst + (size_t)i * dst_stride;
+    // source coordinates move linearly along a destination row before the perspective divide
+    const float cy = i + 0.5f;
+    float x = h[0] * 0.5f + h[1] * cy + h[2], y = h[3] * 0.5f + h[4] * cy + h[5], w = h[6] * 0.5f + h[7] * cy + h[8];
+    for (int j = 0; j < dst_width; j++, x += h[0], y += h[3], w += h[6])
     {
-      printf("error color_image_convolve_hv(): not enough memory");
-      exit(1);
+      const float sx = x / w - 0.5f, sy = y / w - 0.5f;
+      if (w <= 0.0f || !(sx > -1.0f && sy > -1.0f && sx < src_width && sy < src_height))
+      {
+        row[j] = fill;
+        continue;
+      }
+      const int x0 = (int)floorf(sx), y0 = (int)floorf(sy);
+      const float fx = sx - x0, fy = sy - y0;
+      float p[4];
+      for (int k = 0; k < 4; k++)
+      {
+        const int px = x0 + (k & 1), py = y0 + (k >> 1);
+        p[k] = (px < 0 || py < 0 || px >= src_width || py >= src_height) ? fill
+                                                                         : src[(size_t)py * src_stride + px];
+      }
+      const float top = p[0] + fx * (p[1] - p[0]), bottom = p[2] + fx * (p[3] - p[2]);
+      row[j] = (unsigned char)lrintf(top + fy * (bottom - top));
     }
-    gray_image tmp = {width, height, stride, tmp_data};
-    // perform convolution for each channel
-    convolve_horiz(&tmp, &src_red, horiz_conv);
-    convolve_vert(&dst_red, &tmp, vert_conv);
-    convolve_horiz(&tmp, &src_green, horiz_conv);
-    convolve_vert(&dst_green, &tmp, vert_conv);
-    convolve_horiz(&tmp, &src_blue, horiz_conv);
-    convolve_vert(&dst_blue, &tmp, vert_conv);
-    free(tmp_data);
-  }
-  else if (horiz_conv != NULL && vert_conv == NULL)
-  { // only horizontal
-    convolve_horiz(&dst_red, &src_red, horiz_conv);
-    convolve_horiz(&dst_green, &src_green, horiz_conv);
-    convolve_horiz(&dst_blue, &src_blue, horiz_conv);
-  }
-  else if (vert_conv != NULL && horiz_conv == NULL)
-  { // only vertical
-    convolve_vert(&dst_red, &src_red, vert_conv);
-    convolve_vert(&dst_green, &src_green, vert_conv);
-    convolve_vert(&dst_blue, &src_blue, vert_conv);
   }
 }
\ No newline at end of file
@@ -31,11 +31,15 @@ typedef struct color_image_struct {
   float *data3; /* Color 3, consecutive to c2 */
 } color_image;
 
+/* fractional bits of the fixed-point convolution coefficients */
+#define CONV_FIXED_BITS 12
+
 /* structure for convolutions */
 typedef struct convolution_struct {
   int order;          /* Order of the convolution */
   float *coeffs;      /* Coefficients */
   float *coeffs_accu; /* Accumulated coefficients */
+  int *coeffs_fixed;  /* Coefficients scaled by 1 << CONV_FIXED_BITS */
 } convolution;
 
 /********** Create/Delete **********/
@@ -98,4 +102,22 @@ void convolution_delete(convolution *conv);
 void color_image_convolve_hv(color_image *dst, const color_image *src, const convolution *horiz_conv,
                              const convolution *vert_conv);
 
+/* perform horizontal and/or vertical convolution of an 8-bit plane in fixed point, stride is the row
+ pitch in bytes, dst may be src */
+void convolve_hv_u8(unsigned char *dst, const unsigned char *src, const int width, const int height, const int stride,
+                    const convolution *horiz_conv, const convolution *vert_conv);
+
+/* perform horizontal and/or vertical convolution of a 16-bit plane in fixed point, stride is the row
+ pitch in unsigned shorts (half the pitch in bytes), dst may be src */
+void convolve_hv_u16(unsigned short *dst, const unsigned short *src, const int width, const int height,
+                     const int stride, const convolution *horiz_conv, const convolution *vert_conv);
+
+/************ Geometry ******/
+
+/* resample an 8-bit plane through a projective transform, h is a row-major 3x3 matrix taking destination
+ (column + 0.5, row + 0.5, 1) to source coordinates, pixels mapped outside the source are set to fill */
+void image_warp_u8(unsigned char *dst, const int dst_width, const int dst_height, const int dst_stride,
+                   const unsigned char *src, const int src_width, const int src_height, const int src_stride,
+                   const float *h, const unsigned char fill);
+
 #endif  // !__IMAGE_H__
@@ -4,6 +4,22 @@
 
 #include "image_io.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef HAVE_LIBPNG
+#include <png.h>
+#endif
+
+#ifdef HAVE_LIBJPEG
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
+
 /********************* IMAGE ***********************/
 
 // PPM
@@ -117,6 +133,553 @@ color_image *color_image_pnm_load(FILE *fp) {
   return image;
 }
 
+// Mapped PNM
+
+/* skip whitespace and comments, then parse a positive decimal header field */
+static const unsigned char *pnm_header_int(const unsigned char *p, const unsigned char *end, int *value) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '#')) {
+    if (*p == '#') {
+      while (p < end && *p != '\n') p++;
+    } else {
+      p++;
+    }
+  }
+  if (p == end || *p < '0' || *p > '9') {
+    return NULL;
+  }
+  *value = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    if (*value > 100000) {
+      return NULL;
+    }
+    *value = *value * 10 + (*p++ - '0');
+  }
+  return p;
+}
+
+/* map a raw P5 (8bppK) or P6 (24bppRGB) file without converting or copying pixels */
+mapped_image *mapped_image_pnm_load(const char *fname) {
+  int fd, width, height, pixmax, pack, bytes_per_pixel;
+  struct stat st;
+  void *map;
+  const unsigned char *p, *end;
+  mapped_image *mapped;
+
+  if ((fd = open(fname, O_RDONLY)) < 0) {
+    fprintf(stderr, "Error in mapped_image_pnm_load() - can not open file `%s' !\n", fname);
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size < 8) {
+    fprintf(stderr, "Error in mapped_image_pnm_load() - `%s' is not a PNM file\n", fname);
+    close(fd);
+    return NULL;
+  }
+  /* private writable mapping: pages are only copied if somebody writes to them */
+  map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Error in mapped_image_pnm_load() - can not map file `%s' !\n", fname);
+    return NULL;
+  }
+
+  p = (const unsigned char *)map;
+  end = p + st.st_size;
+  if (p[0] != 'P' || (p[1] != '5' && p[1] != '6')) {
+    fprintf(stderr, "Error in mapped_image_pnm_load() - only raw P5/P6 supported\n");
+    munmap(map, (size_t)st.st_size);
+    return NULL;
+  }
+  pack = (p[1] == '5') ? DmtxPack8bppK : DmtxPack24bppRGB;
+  bytes_per_pixel = (p[1] == '5') ? 1 : 3;
+
+  p = pnm_header_int(p + 2, end, &width);
+  if (p != NULL) p = pnm_header_int(p, end, &height);
+  if (p != NULL) p = pnm_header_int(p, end, &pixmax);
+  /* exactly one whitespace byte separates the header from the payload */
+  if (p == NULL || p == end || width < 1 || height < 1 || pixmax < 1 || pixmax > 255 ||
+      (size_t)(end - p - 1) < (size_t)width * height * bytes_per_pixel) {
+    fprintf(stderr, "Error in mapped_image_pnm_load() - `%s' corrupted or not 8-bit\n", fname);
+    munmap(map, (size_t)st.st_size);
+    return NULL;
+  }
+  p++;
+
+  mapped = (mapped_image *)malloc(sizeof(mapped_image));
+  if (mapped == NULL) {
+    munmap(map, (size_t)st.st_size);
+    return NULL;
+  }
+  mapped->map = map;
+  mapped->map_size = (size_t)st.st_size;
+  mapped->pixels = NULL;
+  mapped->image = dmtxImageCreate((unsigned char *)p, width, height, pack);
+  if (mapped->image == NULL) {
+    mapped_image_delete(mapped);
+    return NULL;
+  }
+  return mapped;
+}
+
+#if defined(HAVE_LIBPNG) || defined(HAVE_LIBJPEG)
+/* wrap a freshly allocated 8-bit luma buffer, taking ownership of it */
+static mapped_image *mapped_image_wrap_pixels(unsigned char *pixels, int width, int height) {
+  mapped_image *mapped = (mapped_image *)malloc(sizeof(mapped_image));
+  if (mapped == NULL) {
+    free(pixels);
+    return NULL;
+  }
+  mapped->map = NULL;
+  mapped->map_size = 0;
+  mapped->pixels = pixels;
+  mapped->image = dmtxImageCreate(pixels, width, height, DmtxPack8bppK);
+  if (mapped->image == NULL) {
+    mapped_image_delete(mapped);
+    return NULL;
+  }
+  return mapped;
+}
+#endif
+
+// Decoded PNG
+
+#ifdef HAVE_LIBPNG
+/* decode a PNG file row by row to 8bppK, converting each row to luma (needs HAVE_LIBPNG) */
+mapped_image *mapped_image_png_load(const char *fname) {
+  FILE *fp;
+  int passes, pass, color_type, bit_depth;
+  png_uint_32 row, width, height;
+  png_structp png_ptr;
+  png_infop info_ptr;
+  unsigned char *volatile pixels = NULL;
+
+  if ((fp = fopen(fname, "rb")) == NULL) {
+    fprintf(stderr, "Error in mapped_image_png_load() - can not open file `%s' !\n", fname);
+    return NULL;
+  }
+  png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  info_ptr = (png_ptr != NULL) ? png_create_info_struct(png_ptr) : NULL;
+  if (info_ptr == NULL) {
+    png_destroy_read_struct(&png_ptr, NULL, NULL);
+    fclose(fp);
+    return NULL;
+  }
+  if (setjmp(png_jmpbuf(png_ptr))) {
+    fprintf(stderr, "Error in mapped_image_png_load() - `%s' corrupted\n", fname);
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    free(pixels);
+    fclose(fp);
+    return NULL;
+  }
+  png_init_io(png_ptr, fp);
+  png_read_info(png_ptr, info_ptr);
+  width = png_get_image_width(png_ptr, info_ptr);
+  height = png_get_image_height(png_ptr, info_ptr);
+  color_type = png_get_color_type(png_ptr, info_ptr);
+  bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+
+  /* let libpng reduce every format to one 8-bit luma sample per pixel while inflating */
+  if (bit_depth == 16) png_set_strip_16(png_ptr);
+  if (color_type == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png_ptr);
+  if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) png_set_expand_gray_1_2_4_to_8(png_ptr);
+  if (color_type & PNG_COLOR_MASK_ALPHA) png_set_strip_alpha(png_ptr);
+  if (color_type == PNG_COLOR_TYPE_PALETTE || (color_type & PNG_COLOR_MASK_COLOR))
+    png_set_rgb_to_gray_fixed(png_ptr, 1, -1, -1);
+  passes = png_set_interlace_handling(png_ptr);
+  png_read_update_info(png_ptr, info_ptr);
+
+  /* png_read_row() applies the luma transforms above to each row as it is
+     inflated, so the only full-size buffer is the width * height luma plane
+     itself, plus libpng's buffer for one source row. Interlaced files run
+     the row loop once per pass over that same plane. */
+  pixels = (unsigned char *)malloc((size_t)width * height);
+  if (pixels == NULL) {
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    fclose(fp);
+    return NULL;
+  }
+  for (pass = 0; pass < passes; pass++) {
+    for (row = 0; row < height; row++) {
+      png_read_row(png_ptr, pixels + (size_t)row * width, NULL);
+    }
+  }
+  png_read_end(png_ptr, NULL);
+  png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+  fclose(fp);
+
+  return mapped_image_wrap_pixels(pixels, (int)width, (int)height);
+}
+#else
+mapped_image *mapped_image_png_load(const char *fname) {
+  fprintf(stderr, "Error in mapped_image_png_load() - built without libpng, can not read `%s'\n", fname);
+  return NULL;
+}
+#endif
+
+// Decoded JPEG
+
+#ifdef HAVE_LIBJPEG
+typedef struct {
+  struct jpeg_error_mgr pub;
+  jmp_buf jump;
+} jpeg_error_jump;
+
+/* return control to the loader instead of letting libjpeg call exit() */
+static void jpeg_error_exit(j_common_ptr cinfo) {
+  jpeg_error_jump *err = (jpeg_error_jump *)cinfo->err;
+  (*cinfo->err->output_message)(cinfo);
+  longjmp(err->jump, 1);
+}
+
+/* decode a JPEG file to 8bppK, letting the DCT downscale by 1, 2, 4 or 8 (needs HAVE_LIBJPEG) */
+mapped_image *mapped_image_jpeg_load(const char *fname, int scale_denom) {
+  FILE *fp;
+  JSAMPROW row;
+  struct jpeg_decompress_struct cinfo;
+  jpeg_error_jump jerr;
+  unsigned char *volatile pixels = NULL;
+
+  if ((fp = fopen(fname, "rb")) == NULL) {
+    fprintf(stderr, "Error in mapped_image_jpeg_load() - can not open file `%s' !\n", fname);
+    return NULL;
+  }
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = jpeg_error_exit;
+  if (setjmp(jerr.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    free(pixels);
+    fclose(fp);
+    return NULL;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_stdio_src(&cinfo, fp);
+  jpeg_read_header(&cinfo, TRUE);
+
+  /* grayscale output keeps only Y, so chroma is never upsampled or converted */
+  cinfo.out_color_space = JCS_GRAYSCALE;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = (scale_denom == 2 || scale_denom == 4 || scale_denom == 8) ? scale_denom : 1;
+  cinfo.dct_method = JDCT_IFAST;
+  jpeg_start_decompress(&cinfo);
+
+  pixels = (unsigned char *)malloc((size_t)cinfo.output_width * cinfo.output_height);
+  if (pixels == NULL) {
+    jpeg_destroy_decompress(&cinfo);
+    fclose(fp);
+    return NULL;
+  }
+  while (cinfo.output_scanline < cinfo.output_height) {
+    row = pixels + (size_t)cinfo.output_scanline * cinfo.output_width;
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_decompress(&cinfo);
+  fclose(fp);
+
+  {
+    int width = (int)cinfo.output_width, height = (int)cinfo.output_height;
+    jpeg_destroy_decompress(&cinfo);
+    return mapped_image_wrap_pixels(pixels, width, height);
+  }
+}
+#else
+mapped_image *mapped_image_jpeg_load(const char *fname, int scale_denom) {
+  (void)scale_denom;
+  fprintf(stderr, "Error in mapped_image_jpeg_load() - built without libjpeg, can not read `%s'\n", fname);
+  return NULL;
+}
+#endif
+
+/* pick the loader from the magic bytes: P5/P6, PNG or JPEG */
+mapped_image *mapped_image_load(const char *fname, int scale_denom) {
+  FILE *fp;
+  unsigned char magic[2] = {0, 0};
+  if ((fp = fopen(fname, "rb")) == NULL) {
+    fprintf(stderr, "Error in mapped_image_load() - can not open file `%s' !\n", fname);
+    return NULL;
+  }
+  if (fread(magic, 1, 2, fp) != 2) {
+    magic[0] = 0;
+  }
+  fclose(fp);
+  if (magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6')) {
+    return mapped_image_pnm_load(fname);
+  } else if (magic[0] == 0x89 && magic[1] == 'P') {
+    return mapped_image_png_load(fname);
+  } else if (magic[0] == 0xff && magic[1] == 0xd8) {
+    return mapped_image_jpeg_load(fname, scale_denom);
+  }
+  fprintf(stderr, "Error in mapped_image_load(%s) - image format not supported\n", fname);
+  return NULL;
+}
+
+/* destroy the image and unmap the file or free the decoded pixels */
+void mapped_image_delete(mapped_image *mapped) {
+  if (mapped == NULL) {
+    return;
+  }
+  if (mapped->image != NULL) {
+    dmtxImageDestroy(&mapped->image);
+  }
+  if (mapped->map != NULL) {
+    munmap(mapped->map, mapped->map_size);
+  }
+  free(mapped->pixels);
+  free(mapped);
+}
+
+// Streamed PNM
+
+#define FRAME_SLOTS 2
+
+typedef enum { FRAME_EMPTY, FRAME_FILLED, FRAME_IN_USE } frame_state;
+
+/* one buffer of the ring, the DmtxImage is kept while frame sizes stay the same */
+typedef struct {
+  frame_state state;
+  unsigned char *pixels;
+  size_t capacity;
+  DmtxImage *image;
+} frame_slot;
+
+struct frame_stream_struct {
+  int fd;
+  unsigned char buf[65536]; /* read-ahead for headers, payload beyond it is read in place */
+  size_t buf_pos, buf_len;
+  frame_slot slots[FRAME_SLOTS];
+  int fill_idx;    /* next slot the reader fills */
+  int take_idx;    /* next slot the consumer takes */
+  int finished;    /* reader hit end of stream or an error */
+  int stopping;    /* consumer asked the reader to quit */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+};
+
+/* next byte of the stream, -1 at end */
+static int frame_stream_getc(frame_stream *stream) {
+  ssize_t n;
+  if (stream->buf_pos == stream->buf_len) {
+    do {
+      n = read(stream->fd, stream->buf, sizeof(stream->buf));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+      return -1;
+    }
+    stream->buf_pos = 0;
+    stream->buf_len = (size_t)n;
+  }
+  return stream->buf[stream->buf_pos++];
+}
+
+/* fill dst with exactly len bytes, draining the read-ahead first */
+static int frame_stream_read(frame_stream *stream, unsigned char *dst, size_t len) {
+  size_t avail = stream->buf_len - stream->buf_pos;
+  ssize_t n;
+  if (avail > len) {
+    avail = len;
+  }
+  memcpy(dst, stream->buf + stream->buf_pos, avail);
+  stream->buf_pos += avail;
+  dst += avail;
+  len -= avail;
+  while (len > 0) {
+    n = read(stream->fd, dst, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return 0;
+    }
+    dst += n;
+    len -= (size_t)n;
+  }
+  return 1;
+}
+
+/* skip whitespace and comments, then parse a positive decimal header field */
+static int frame_stream_header_int(frame_stream *stream, int *value) {
+  int c = frame_stream_getc(stream);
+  while (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '#') {
+    if (c == '#') {
+      while (c != '\n' && c != -1) c = frame_stream_getc(stream);
+    }
+    c = frame_stream_getc(stream);
+  }
+  if (c < '0' || c > '9') {
+    return 0;
+  }
+  *value = 0;
+  while (c >= '0' && c <= '9') {
+    if (*value > 100000) {
+      return 0;
+    }
+    *value = *value * 10 + (c - '0');
+    c = frame_stream_getc(stream);
+  }
+  /* the single whitespace byte after maxval is consumed here too */
+  return 1;
+}
+
+/* read one frame into slot, returns 1 on success, 0 at a clean end of stream, -1 on error */
+static int frame_stream_read_frame(frame_stream *stream, frame_slot *slot) {
+  int magic0, magic1, width, height, pixmax, bytes_per_pixel;
+  size_t size;
+
+  /* concatenated frames may be separated by whitespace */
+  do {
+    magic0 = frame_stream_getc(stream);
+  } while (magic0 == ' ' || magic0 == '\t' || magic0 == '\r' || magic0 == '\n');
+  if (magic0 == -1) {
+    return 0;
+  }
+  magic1 = frame_stream_getc(stream);
+  if (magic0 != 'P' || (magic1 != '5' && magic1 != '6')) {
+    fprintf(stderr, "Error in frame_stream_next() - only raw P5/P6 frames supported\n");
+    return -1;
+  }
+  if (!frame_stream_header_int(stream, &width) || !frame_stream_header_int(stream, &height) ||
+      !frame_stream_header_int(stream, &pixmax) || width < 1 || height < 1 || pixmax < 1 || pixmax > 255) {
+    fprintf(stderr, "Error in frame_stream_next() - frame header corrupted or not 8-bit\n");
+    return -1;
+  }
+  bytes_per_pixel = (magic1 == '5') ? 1 : 3;
+  size = (size_t)width * height * bytes_per_pixel;
+
+  if (size > slot->capacity) {
+    unsigned char *pixels = (unsigned char *)realloc(slot->pixels, size);
+    if (pixels == NULL) {
+      return -1;
+    }
+    slot->pixels = pixels;
+    slot->capacity = size;
+    if (slot->image != NULL) {
+      dmtxImageDestroy(&slot->image);
+    }
+  }
+  if (!frame_stream_read(stream, slot->pixels, size)) {
+    fprintf(stderr, "Error in frame_stream_next() - stream ended inside a frame\n");
+    return -1;
+  }
+
+  if (slot->image != NULL && (slot->image->width != width || slot->image->height != height ||
+                              slot->image->bytesPerPixel != bytes_per_pixel)) {
+    dmtxImageDestroy(&slot->image);
+  }
+  if (slot->image == NULL) {
+    slot->image = dmtxImageCreate(slot->pixels, width, height,
+                                  (bytes_per_pixel == 1) ? DmtxPack8bppK : DmtxPack24bppRGB);
+    if (slot->image == NULL) {
+      return -1;
+    }
+  }
+  return 1;
+}
+
+/* reader thread: fill slots in ring order while the consumer decodes the other one */
+static void *frame_stream_reader(void *arg) {
+  frame_stream *stream = (frame_stream *)arg;
+  frame_slot *slot;
+  int result;
+
+  for (;;) {
+    pthread_mutex_lock(&stream->lock);
+    slot = &stream->slots[stream->fill_idx];
+    while (slot->state != FRAME_EMPTY && !stream->stopping) {
+      pthread_cond_wait(&stream->changed, &stream->lock);
+    }
+    if (stream->stopping) {
+      pthread_mutex_unlock(&stream->lock);
+      break;
+    }
+    pthread_mutex_unlock(&stream->lock);
+
+    /* no lock held while blocked in read(), the consumer keeps its own slot */
+    result = frame_stream_read_frame(stream, slot);
+
+    pthread_mutex_lock(&stream->lock);
+    if (result == 1) {
+      slot->state = FRAME_FILLED;
+      stream->fill_idx = (stream->fill_idx + 1) % FRAME_SLOTS;
+    } else {
+      stream->finished = 1;
+    }
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+    if (result != 1) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+/* start reading frames from fd on a background thread */
+frame_stream *frame_stream_open(int fd) {
+  frame_stream *stream = (frame_stream *)calloc(1, sizeof(frame_stream));
+  if (stream == NULL) {
+    return NULL;
+  }
+  stream->fd = fd;
+  stream->take_idx = -1;
+  pthread_mutex_init(&stream->lock, NULL);
+  pthread_cond_init(&stream->changed, NULL);
+  if (pthread_create(&stream->thread, NULL, frame_stream_reader, stream) != 0) {
+    pthread_cond_destroy(&stream->changed);
+    pthread_mutex_destroy(&stream->lock);
+    free(stream);
+    return NULL;
+  }
+  return stream;
+}
+
+/* wait for the next frame, valid until the following call; NULL at end of stream or on error */
+DmtxImage *frame_stream_next(frame_stream *stream) {
+  frame_slot *slot;
+  DmtxImage *image = NULL;
+
+  pthread_mutex_lock(&stream->lock);
+  /* hand the previous frame back to the reader */
+  if (stream->take_idx >= 0) {
+    stream->slots[stream->take_idx].state = FRAME_EMPTY;
+    pthread_cond_broadcast(&stream->changed);
+  }
+  stream->take_idx = (stream->take_idx + 1) % FRAME_SLOTS;
+  slot = &stream->slots[stream->take_idx];
+  while (slot->state != FRAME_FILLED && !stream->finished) {
+    pthread_cond_wait(&stream->changed, &stream->lock);
+  }
+  if (slot->state == FRAME_FILLED) {
+    slot->state = FRAME_IN_USE;
+    image = slot->image;
+  } else {
+    stream->take_idx = -1;
+  }
+  pthread_mutex_unlock(&stream->lock);
+  return image;
+}
+
+/* stop the reader thread and free both buffers, fd is left open */
+void frame_stream_close(frame_stream *stream) {
+  int i;
+  if (stream == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&stream->lock);
+  stream->stopping = 1;
+  pthread_cond_broadcast(&stream->changed);
+  pthread_mutex_unlock(&stream->lock);
+  /* a reader blocked in read() returns once the writer closes its end */
+  pthread_join(stream->thread, NULL);
+
+  for (i = 0; i < FRAME_SLOTS; i++) {
+    if (stream->slots[i].image != NULL) {
+      dmtxImageDestroy(&stream->slots[i].image);
+    }
+    free(stream->slots[i].pixels);
+  }
+  pthread_cond_destroy(&stream->changed);
+  pthread_mutex_destroy(&stream->lock);
+  free(stream);
+}
+
 // JPG
 
 // color_image *color_image_jpeg_load(FILE *fp) {
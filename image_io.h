@@ -6,11 +6,47 @@
 #define __IMAGE_IO_H__
 
 #include <stdlib.h>
+#include "./dmtx.h"
 #include "./image.h"
 
+/* image file wrapped by a DmtxImage, either mapped (PNM) or decoded to 8-bit luma (PNG/JPEG) */
+typedef struct mapped_image_struct {
+  DmtxImage *image;      /* Image whose pixels point into the mapping or the decoded buffer */
+  void *map;             /* Start of the mapping, NULL for decoded formats */
+  size_t map_size;       /* Length of the mapping in bytes */
+  unsigned char *pixels; /* Decoded pixel buffer, NULL for mapped formats */
+} mapped_image;
+
 /* load a color image from a file in jpg or ppm*/
 color_image *color_image_load(const char *fname);
 
+/* map a raw P5 (8bppK) or P6 (24bppRGB) file without converting or copying pixels */
+mapped_image *mapped_image_pnm_load(const char *fname);
+
+/* decode a PNG file row by row to 8bppK (needs HAVE_LIBPNG) */
+mapped_image *mapped_image_png_load(const char *fname);
+
+/* decode a JPEG file to 8bppK, letting the DCT downscale by 1, 2, 4 or 8 (needs HAVE_LIBJPEG) */
+mapped_image *mapped_image_jpeg_load(const char *fname, int scale_denom);
+
+/* pick the loader from the magic bytes: P5/P6, PNG or JPEG */
+mapped_image *mapped_image_load(const char *fname, int scale_denom);
+
+/* destroy the image and unmap the file or free the decoded pixels */
+void mapped_image_delete(mapped_image *mapped);
+
+/* double-buffered reader of concatenated raw P5/P6 frames from a file descriptor */
+typedef struct frame_stream_struct frame_stream;
+
+/* start reading frames from fd on a background thread */
+frame_stream *frame_stream_open(int fd);
+
+/* wait for the next frame, valid until the following call; NULL at end of stream or on error */
+DmtxImage *frame_stream_next(frame_stream *stream);
+
+/* stop the reader thread and free both buffers, fd is left open */
+void frame_stream_close(frame_stream *stream);
+
 /* write the color image to a ppn file */
 void color_image_write(const char *fname, const color_image *img);
 
@@ -1,29 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "./dmtx.h"
 #include "./image.h"
 #include "./image_io.h"
 
-int main()
+/* 检测并解析图像中的第一个DM码 */
+static void decode_image(DmtxImage *img)
 {
-    const char *file_name = "/home/jia-baos/Project-CPP/libdmtx/res1.ppm";
-    color_image *src = color_image_load(file_name);
-    printf("src: %d, %d\n", src->width, src->height);
-
-    const int w = src->width;
-    const int h = src->height;
-    unsigned char *src_char = (unsigned char *)calloc(w * h, sizeof(unsigned char));
-
-    for (int i = 0; i < h; i++)
-    {
-        for (int j = 0; j < w; j++)
-        {
-            const int index = i * src->stride + j;
-            src_char[i * w + j] = (unsigned char)src->data1[index];
-        }
-    }
-
-    DmtxImage *img = dmtxImageCreate(src_char, w, h, DmtxPack8bppK);
     DmtxDecode *dec = dmtxDecodeCreate(img, 1);
     DmtxRegion *reg = dmtxRegionFindNext(dec, NULL);
     if (reg != NULL) // 如果检测到存在DM码区域
@@ -45,7 +30,43 @@ int main()
         printf("Search dm failed...\n");
     }
     dmtxDecodeDestroy(&dec);
-    dmtxImageDestroy(&img);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *file_name = (argc > 1) ? argv[1] : "/home/jia-baos/Project-CPP/libdmtx/res1.ppm";
+    const int scale_denom = (argc > 2) ? atoi(argv[2]) : 1; // JPEG在DCT域缩小1/2/4/8倍
+
+    // "-" 表示从标准输入连续读取拼接的P5/P6帧, 读取下一帧与解码当前帧并行
+    if (strcmp(file_name, "-") == 0)
+    {
+        frame_stream *stream = frame_stream_open(STDIN_FILENO);
+        if (stream == NULL)
+        {
+            return 1;
+        }
+        DmtxImage *frame;
+        int frame_idx = 0;
+        while ((frame = frame_stream_next(stream)) != NULL)
+        {
+            printf("frame %d: %d, %d\n", frame_idx++, dmtxImageGetProp(frame, DmtxPropWidth),
+                   dmtxImageGetProp(frame, DmtxPropHeight));
+            decode_image(frame);
+        }
+        frame_stream_close(stream);
+        return 0;
+    }
+
+    mapped_image *src = mapped_image_load(file_name, scale_denom); // PNM直接映射, PNG/JPEG直接解码为8位灰度
+    if (src == NULL)
+    {
+        return 1;
+    }
+
+    DmtxImage *img = src->image;
+    printf("src: %d, %d\n", dmtxImageGetProp(img, DmtxPropWidth), dmtxImageGetProp(img, DmtxPropHeight));
+    decode_image(img);
+    mapped_image_delete(src);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,474 @@
+/**
+ * libdmtx - Data Matrix Encoding/Decoding Library
+ *
+ * See LICENSE file in the main project directory for full
+ * terms of use and distribution.
+ *
+ * \file bench_test.c
+ * \brief End-to-end decode benchmark on synthetic symbols
+ *
+ * A symbol of every size is encoded with a random numeric message, degraded
+ * under one of several conditions using the image.c helpers and decoded
+ * again from the whole image. Throughput, median and 99th percentile
+ * latency and read rate are printed per condition and written to the
+ * results file as one JSON object per line, so that two runs can be
+ * compared by script. Random placement is seeded, so runs are repeatable.
+ *
+ * usage: bench_test [-r repeats] [-s seed] [-t timeout-ms] [-o results-file]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "../../dmtx.h"
+#include "../../image.h"
+
+#define BENCH_MODULE_SIZE   4
+#define BENCH_QUIET_ZONE   16
+#define BENCH_SIZE_COUNT   (DmtxSymbolSquareCount + DmtxSymbolRectCount)
+
+typedef struct {
+   char   *name;
+   double  rotate;      /* maximum rotation either way, degrees */
+   double  scaleMin;    /* range of the module size multiplier */
+   double  scaleMax;
+   double  perspective; /* maximum corner displacement, fraction of the symbol size */
+   int     contrast;    /* grey levels between dark and light modules */
+   double  blur;        /* gaussian sigma in pixels, 0 for none */
+   double  noise;       /* gaussian sigma in grey levels, 0 for none */
+} BenchCondition;
+
+static BenchCondition conditions[] = {
+   /* name           rotate  scale       persp  contrast blur noise */
+   { "clean",          0.0,  1.0, 1.0,   0.00,  255,     0.0,  0.0 },
+   { "rotate",       180.0,  1.0, 1.0,   0.00,  255,     0.0,  0.0 },
+   { "scale",          0.0,  0.6, 1.6,   0.00,  255,     0.0,  0.0 },
+   { "perspective",    0.0,  1.0, 1.0,   0.10,  255,     0.0,  0.0 },
+   { "blur",           0.0,  1.0, 1.0,   0.00,  255,     1.2,  0.0 },
+   { "noise",          0.0,  1.0, 1.0,   0.00,  255,     0.0, 20.0 },
+   { "contrast",       0.0,  1.0, 1.0,   0.00,   40,     0.0,  0.0 },
+   { "combined",      30.0,  0.8, 1.3,   0.04,  120,     0.8,  6.0 },
+   { NULL,             0.0,  0.0, 0.0,   0.00,    0,     0.0,  0.0 }
+};
+
+typedef struct {
+   int     samples;
+   int     reads;
+   double *latency;     /* seconds per sample */
+   double  totalSeconds;
+   int     failed[BENCH_SIZE_COUNT];
+} BenchResult;
+
+static unsigned int randState;
+
+static double RandUniform(void);
+static double RandGaussian(void);
+static unsigned char *EncodeSymbol(int sizeIdx, char *message, int *width, int *height);
+static unsigned char *DegradeSymbol(BenchCondition *cond, unsigned char *symbol, int width, int height,
+      int *canvasWidth, int *canvasHeight);
+static int DecodeCanvas(unsigned char *canvas, int width, int height, char *message, int timeoutMs);
+static void SquareToQuad(double quad[4][2], double m[9]);
+static int CompareLatency(const void *a, const void *b);
+static double Percentile(double *sorted, int count, double p);
+
+int
+main(int argc, char *argv[])
+{
+   int i, c, repeat, sizeIdx, length, dataWords;
+   int width, height, canvasWidth, canvasHeight;
+   int repeats, timeoutMs, failures;
+   unsigned int seed;
+   char *resultsFile, *sep;
+   char message[4096];
+   unsigned char *symbol, *canvas;
+   double p50, p99, seconds;
+   clock_t start;
+   BenchResult result;
+   FILE *fp;
+
+   repeats = 2;
+   timeoutMs = 1000;
+   seed = 1;
+   resultsFile = "bench_test.json";
+
+   for(i = 1; i < argc; i++) {
+      if(i + 1 < argc && strcmp(argv[i], "-r") == 0)
+         repeats = atoi(argv[++i]);
+      else if(i + 1 < argc && strcmp(argv[i], "-s") == 0)
+         seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+      else if(i + 1 < argc && strcmp(argv[i], "-t") == 0)
+         timeoutMs = atoi(argv[++i]);
+      else if(i + 1 < argc && strcmp(argv[i], "-o") == 0)
+         resultsFile = argv[++i];
+      else {
+         fprintf(stderr, "usage: %s [-r repeats] [-s seed] [-t timeout-ms] [-o results-file]\n", argv[0]);
+         exit(2);
+      }
+   }
+
+   if(repeats < 1) {
+      fprintf(stderr, "repeats must be at least 1\n");
+      exit(2);
+   }
+
+   fp = fopen(resultsFile, "w");
+   if(fp == NULL) {
+      fprintf(stderr, "cannot write \"%s\"\n", resultsFile);
+      exit(2);
+   }
+
+   result.latency = (double *)malloc(BENCH_SIZE_COUNT * repeats * sizeof(double));
+   if(result.latency == NULL) {
+      fclose(fp);
+      exit(2);
+   }
+
+   failures = 0;
+   randState = (seed != 0) ? seed : 1;
+
+   fprintf(stdout, "%-12s %7s %7s %9s %9s %9s %10s\n", "condition", "samples",
+         "reads", "rate", "p50(ms)", "p99(ms)", "decodes/s");
+
+   for(c = 0; conditions[c].name != NULL; c++) {
+
+      result.samples = result.reads = 0;
+      result.totalSeconds = 0.0;
+      memset(result.failed, 0, sizeof(result.failed));
+
+      for(sizeIdx = 0; sizeIdx < BENCH_SIZE_COUNT; sizeIdx++) {
+
+         /* Numeric data packs two digits per codeword, so this fills about half the symbol */
+         dataWords = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, sizeIdx);
+         length = (dataWords < (int)sizeof(message)) ? dataWords : (int)sizeof(message) - 1;
+
+         for(repeat = 0; repeat < repeats; repeat++) {
+
+            for(i = 0; i < length; i++)
+               message[i] = '0' + (int)(RandUniform() * 10.0) % 10;
+            message[length] = '\0';
+
+            symbol = EncodeSymbol(sizeIdx, message, &width, &height);
+            if(symbol == NULL) {
+               fprintf(stdout, "FAIL: could not encode size %d\n", sizeIdx);
+               failures++;
+               continue;
+            }
+
+            canvas = DegradeSymbol(&conditions[c], symbol, width, height, &canvasWidth, &canvasHeight);
+            free(symbol);
+
+            start = clock();
+            if(DecodeCanvas(canvas, canvasWidth, canvasHeight, message, timeoutMs) == DmtxPass)
+               result.reads++;
+            else
+               result.failed[sizeIdx]++;
+            seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+            free(canvas);
+
+            result.latency[result.samples++] = seconds;
+            result.totalSeconds += seconds;
+         }
+      }
+
+      qsort(result.latency, result.samples, sizeof(double), CompareLatency);
+      p50 = Percentile(result.latency, result.samples, 0.50);
+      p99 = Percentile(result.latency, result.samples, 0.99);
+
+      fprintf(stdout, "%-12s %7d %7d %9.3f %9.2f %9.2f %10.1f\n", conditions[c].name,
+            result.samples, result.reads, (double)result.reads / result.samples,
+            p50 * 1e3, p99 * 1e3, result.samples / result.totalSeconds);
+
+      fprintf(fp, "{\"condition\":\"%s\",\"samples\":%d,\"reads\":%d,\"read_rate\":%.4f,"
+            "\"throughput\":%.2f,\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"failed_sizes\":[",
+            conditions[c].name, result.samples, result.reads,
+            (double)result.reads / result.samples, result.samples / result.totalSeconds,
+            p50 * 1e3, p99 * 1e3);
+      for(sep = "", sizeIdx = 0; sizeIdx < BENCH_SIZE_COUNT; sizeIdx++) {
+         if(result.failed[sizeIdx] > 0) {
+            fprintf(fp, "%s%d", sep, sizeIdx);
+            sep = ",";
+         }
+      }
+      fprintf(fp, "]}\n");
+
+      /* An undistorted symbol that does not read back is a bug, not a benchmark result */
+      if(c == 0 && result.reads < result.samples) {
+         fprintf(stdout, "FAIL: %d clean symbol(s) not decoded\n", result.samples - result.reads);
+         failures++;
+      }
+   }
+
+   free(result.latency);
+   fclose(fp);
+
+   if(failures > 0) {
+      fprintf(stdout, "FAIL: %d failure(s)\n", failures);
+      exit(1);
+   }
+
+   exit(0);
+}
+
+/**
+ * xorshift32, so sequences do not depend on the platform rand()
+ *
+ */
+static double
+RandUniform(void)
+{
+   randState ^= randState << 13;
+   randState ^= randState >> 17;
+   randState ^= randState << 5;
+
+   return randState / 4294967296.0;
+}
+
+/**
+ * Box-Muller transform, unit variance
+ *
+ */
+static double
+RandGaussian(void)
+{
+   double u1, u2;
+
+   do {
+      u1 = RandUniform();
+   } while(u1 <= 0.0);
+   u2 = RandUniform();
+
+   return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/**
+ * Encode message into a symbol of size sizeIdx with no margin, returning
+ * a copy of its 8-bit plane that the caller frees
+ */
+static unsigned char *
+EncodeSymbol(int sizeIdx, char *message, int *width, int *height)
+{
+   size_t bytes;
+   unsigned char *symbol;
+   DmtxEncode *enc;
+
+   enc = dmtxEncodeCreate();
+   if(enc == NULL)
+      return NULL;
+
+   dmtxEncodeSetProp(enc, DmtxPropPixelPacking, DmtxPack8bppK);
+   dmtxEncodeSetProp(enc, DmtxPropModuleSize, BENCH_MODULE_SIZE);
+   dmtxEncodeSetProp(enc, DmtxPropMarginSize, 0);
+   dmtxEncodeSetProp(enc, DmtxPropSizeRequest, sizeIdx);
+
+   if(dmtxEncodeDataMatrix(enc, strlen(message), (unsigned char *)message) == DmtxFail) {
+      dmtxEncodeDestroy(&enc);
+      return NULL;
+   }
+
+   *width = dmtxImageGetProp(enc->image, DmtxPropWidth);
+   *height = dmtxImageGetProp(enc->image, DmtxPropHeight);
+   bytes = (size_t)dmtxImageGetProp(enc->image, DmtxPropRowSizeBytes) * *height;
+
+   symbol = (unsigned char *)malloc(bytes);
+   if(symbol != NULL)
+      memcpy(symbol, enc->image->pxl, bytes);
+
+   dmtxEncodeDestroy(&enc);
+
+   return symbol;
+}
+
+/**
+ * Place the symbol on a light canvas with a random pose drawn from cond,
+ * then apply contrast, blur and noise in the order a camera would
+ */
+static unsigned char *
+DegradeSymbol(BenchCondition *cond, unsigned char *symbol, int width, int height,
+      int *canvasWidth, int *canvasHeight)
+{
+   int i, order;
+   double angle, scale, jitter, c, s, x, y;
+   double minX, minY, maxX, maxY;
+   double quad[4][2], m[9];
+   float h[9], *halfCoeffs;
+   unsigned char *canvas, light, dark;
+   convolution *conv;
+   static const double corners[4][2] = { {0.0, 0.0}, {1.0, 0.0}, {1.0, 1.0}, {0.0, 1.0} };
+
+   angle = (2.0 * RandUniform() - 1.0) * cond->rotate * M_PI / 180.0;
+   scale = cond->scaleMin + RandUniform() * (cond->scaleMax - cond->scaleMin);
+   jitter = cond->perspective * ((width > height) ? width : height) * scale;
+   c = cos(angle);
+   s = sin(angle);
+
+   minX = minY = HUGE_VAL;
+   maxX = maxY = -HUGE_VAL;
+   for(i = 0; i < 4; i++) {
+      x = (corners[i][0] - 0.5) * width * scale;
+      y = (corners[i][1] - 0.5) * height * scale;
+      quad[i][0] = c * x - s * y + (2.0 * RandUniform() - 1.0) * jitter;
+      quad[i][1] = s * x + c * y + (2.0 * RandUniform() - 1.0) * jitter;
+      minX = (quad[i][0] < minX) ? quad[i][0] : minX;
+      minY = (quad[i][1] < minY) ? quad[i][1] : minY;
+      maxX = (quad[i][0] > maxX) ? quad[i][0] : maxX;
+      maxY = (quad[i][1] > maxY) ? quad[i][1] : maxY;
+   }
+
+   /* Whole-pixel offset keeps the clean condition an exact copy */
+   for(i = 0; i < 4; i++) {
+      quad[i][0] += BENCH_QUIET_ZONE - floor(minX);
+      quad[i][1] += BENCH_QUIET_ZONE - floor(minY);
+   }
+   *canvasWidth = (int)ceil(maxX - floor(minX)) + 2 * BENCH_QUIET_ZONE;
+   *canvasHeight = (int)ceil(maxY - floor(minY)) + 2 * BENCH_QUIET_ZONE;
+
+   /* Destination to source: unit square to quad inverted, then stretched to the symbol */
+   SquareToQuad(quad, m);
+   h[0] = (float)((m[4] * m[8] - m[5] * m[7]) * width);
+   h[1] = (float)((m[2] * m[7] - m[1] * m[8]) * width);
+   h[2] = (float)((m[1] * m[5] - m[2] * m[4]) * width);
+   h[3] = (float)((m[5] * m[6] - m[3] * m[8]) * height);
+   h[4] = (float)((m[0] * m[8] - m[2] * m[6]) * height);
+   h[5] = (float)((m[2] * m[3] - m[0] * m[5]) * height);
+   h[6] = (float)(m[3] * m[7] - m[4] * m[6]);
+   h[7] = (float)(m[1] * m[6] - m[0] * m[7]);
+   h[8] = (float)(m[0] * m[4] - m[1] * m[3]);
+
+   canvas = (unsigned char *)malloc((size_t)*canvasWidth * *canvasHeight);
+   if(canvas == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(2);
+   }
+   image_warp_u8(canvas, *canvasWidth, *canvasHeight, *canvasWidth, symbol, width, height,
+         width, h, 255);
+
+   if(cond->contrast < 255) {
+      dark = (unsigned char)((255 - cond->contrast) / 2);
+      light = (unsigned char)(dark + cond->contrast);
+      for(i = 0; i < *canvasWidth * *canvasHeight; i++)
+         canvas[i] = (unsigned char)(dark + (canvas[i] * (light - dark) + 127) / 255);
+   }
+
+   if(cond->blur > 0.0) {
+      halfCoeffs = gaussian_filter((float)cond->blur, &order);
+      conv = convolution_new(order, halfCoeffs, 1);
+      convolve_hv_u8(canvas, canvas, *canvasWidth, *canvasHeight, *canvasWidth, conv, conv);
+      convolution_delete(conv);
+      free(halfCoeffs);
+   }
+
+   if(cond->noise > 0.0) {
+      for(i = 0; i < *canvasWidth * *canvasHeight; i++) {
+         x = canvas[i] + RandGaussian() * cond->noise;
+         canvas[i] = (unsigned char)((x < 0.0) ? 0 : (x > 255.0) ? 255 : (int)(x + 0.5));
+      }
+   }
+
+   return canvas;
+}
+
+/**
+ * Find and decode the first symbol on the canvas, timing the full
+ * decoder lifetime as an application would see it
+ */
+static int
+DecodeCanvas(unsigned char *canvas, int width, int height, char *message, int timeoutMs)
+{
+   int passFail;
+   DmtxImage *img;
+   DmtxDecode *dec;
+   DmtxRegion *reg;
+   DmtxMessage *msg;
+   DmtxTime timeout;
+
+   passFail = DmtxFail;
+
+   img = dmtxImageCreate(canvas, width, height, DmtxPack8bppK);
+   if(img == NULL)
+      return DmtxFail;
+
+   dec = dmtxDecodeCreate(img, 1);
+   if(dec == NULL) {
+      dmtxImageDestroy(&img);
+      return DmtxFail;
+   }
+
+   timeout = dmtxTimeAdd(dmtxTimeNow(), timeoutMs);
+
+   reg = dmtxRegionFindNext(dec, &timeout);
+   if(reg != NULL) {
+      msg = dmtxDecodeMatrixRegion(dec, reg, DmtxUndefined);
+      if(msg != NULL) {
+         if((size_t)msg->outputIdx == strlen(message) &&
+               memcmp(msg->output, message, msg->outputIdx) == 0)
+            passFail = DmtxPass;
+         dmtxMessageDestroy(&msg);
+      }
+      dmtxRegionDestroy(&reg);
+   }
+
+   dmtxDecodeDestroy(&dec);
+   dmtxImageDestroy(&img);
+
+   return passFail;
+}
+
+/**
+ * Projective map of the unit square onto quad, corners in the order
+ * (0,0) (1,0) (1,1) (0,1), as a row-major 3x3 matrix
+ */
+static void
+SquareToQuad(double quad[4][2], double m[9])
+{
+   double dx1, dx2, dx3, dy1, dy2, dy3, det;
+
+   dx1 = quad[1][0] - quad[2][0];
+   dx2 = quad[3][0] - quad[2][0];
+   dx3 = quad[0][0] - quad[1][0] + quad[2][0] - quad[3][0];
+   dy1 = quad[1][1] - quad[2][1];
+   dy2 = quad[3][1] - quad[2][1];
+   dy3 = quad[0][1] - quad[1][1] + quad[2][1] - quad[3][1];
+
+   det = dx1 * dy2 - dx2 * dy1;
+   m[6] = (dx3 * dy2 - dx2 * dy3) / det;
+   m[7] = (dx1 * dy3 - dx3 * dy1) / det;
+   m[8] = 1.0;
+
+   m[0] = quad[1][0] - quad[0][0] + m[6] * quad[1][0];
+   m[1] = quad[3][0] - quad[0][0] + m[7] * quad[3][0];
+   m[2] = quad[0][0];
+   m[3] = quad[1][1] - quad[0][1] + m[6] * quad[1][1];
+   m[4] = quad[3][1] - quad[0][1] + m[7] * quad[3][1];
+   m[5] = quad[0][1];
+}
+
+/**
+ *
+ *
+ */
+static int
+CompareLatency(const void *a, const void *b)
+{
+   double da = *(const double *)a, db = *(const double *)b;
+
+   return (da > db) - (da < db);
+}
+
+/**
+ * Nearest-rank percentile of an ascending array
+ *
+ */
+static double
+Percentile(double *sorted, int count, double p)
+{
+   int rank;
+
+   if(count == 0)
+      return 0.0;
+
+   rank = (int)ceil(p * count) - 1;
+
+   return sorted[(rank < 0) ? 0 : rank];
+}
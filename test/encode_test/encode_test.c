@@ -0,0 +1,199 @@
+/**
+ * libdmtx - Data Matrix Encoding/Decoding Library
+ *
+ * See LICENSE file in the main project directory for full
+ * terms of use and distribution.
+ *
+ * \file encode_test.c
+ * \brief Compare DmtxSchemeAutoFast against DmtxSchemeAutoBest
+ *
+ * Every message is encoded with both schemes. The auto-fast result must decode
+ * back to the original input, and its symbol must never be more than one size
+ * step larger than the auto-best symbol. Run with -t to also report
+ * encoding time for both schemes, which CTest leaves out.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../../dmtx.h"
+
+#define ITERATIONS 2000
+
+typedef struct {
+   char *label;
+   char *message;
+} TestMessage;
+
+static TestMessage testMessages[] = {
+   { "serial",    "SN0004711" },
+   { "serial",    "30Q324343430794<OQQ" },
+   { "serial",    "A1B2C3D4E5F6G7H8" },
+   { "numeric",   "0123456789012345678901234567890123456789" },
+   { "upper",     "ABCDEFGHIJKLMNOPQRSTUVWXYZ ABCDEFGHIJKLMNOP" },
+   { "lower",     "the quick brown fox jumps over the lazy dog" },
+   { "x12",       "ABC*123>DEF*456>GHI*789>JKL\r" },
+   { "edifact",   "=:;<>=?@[\\]^=:;<>=?@[\\]^" },
+   { "url",       "http://www.libdmtx.org/docs/index.html?id=42" },
+   { "mixed",     "Part#: 4711-B, Lot: x93/2016, Qty: 250 pcs" },
+   { "extended",  "\xc4\xd6\xdc\xe4\xf6\xfc\xdf\xc4\xd6\xdc\xe4\xf6\xfc\xdf" },
+   { "single",    "A" },
+   { NULL, NULL }
+};
+
+static int EncodeMessage(DmtxEncode **enc, int scheme, char *message);
+static int VerifyRoundTrip(DmtxEncode *enc, char *message);
+static double TimeEncode(int scheme, char *message);
+
+int
+main(int argc, char *argv[])
+{
+   int i, failures, timing;
+   int dataWordsFast, dataWordsBest;
+   int totalFast, totalBest;
+   double secondsFast, secondsBest;
+   double totalSecondsFast, totalSecondsBest;
+   DmtxEncode *encFast, *encBest;
+
+   /* Timing repeats every encode ITERATIONS times, so only on request */
+   timing = (argc > 1 && strcmp(argv[1], "-t") == 0) ? 1 : 0;
+
+   failures = 0;
+   totalFast = totalBest = 0;
+   totalSecondsFast = totalSecondsBest = 0.0;
+
+   fprintf(stdout, "%-9s %5s %5s %10s %10s  message\n",
+         "label", "fast", "best", "fast(us)", "best(us)");
+
+   for(i = 0; testMessages[i].message != NULL; i++) {
+
+      if(EncodeMessage(&encFast, DmtxSchemeAutoFast, testMessages[i].message) == DmtxFail) {
+         fprintf(stdout, "FAIL: auto-fast could not encode \"%s\"\n", testMessages[i].message);
+         failures++;
+         continue;
+      }
+
+      if(EncodeMessage(&encBest, DmtxSchemeAutoBest, testMessages[i].message) == DmtxFail) {
+         fprintf(stdout, "FAIL: auto-best could not encode \"%s\"\n", testMessages[i].message);
+         dmtxEncodeDestroy(&encFast);
+         failures++;
+         continue;
+      }
+
+      if(VerifyRoundTrip(encFast, testMessages[i].message) == DmtxFail) {
+         fprintf(stdout, "FAIL: auto-fast output does not decode to \"%s\"\n", testMessages[i].message);
+         failures++;
+      }
+
+      dataWordsFast = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, encFast->region.sizeIdx);
+      dataWordsBest = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, encBest->region.sizeIdx);
+
+      /* Allow auto-fast to land one symbol size above auto-best, never more */
+      if(encFast->region.sizeIdx > encBest->region.sizeIdx + 1) {
+         fprintf(stdout, "FAIL: auto-fast symbol too large for \"%s\"\n", testMessages[i].message);
+         failures++;
+      }
+
+      secondsFast = secondsBest = 0.0;
+      if(timing) {
+         secondsFast = TimeEncode(DmtxSchemeAutoFast, testMessages[i].message);
+         secondsBest = TimeEncode(DmtxSchemeAutoBest, testMessages[i].message);
+      }
+
+      fprintf(stdout, "%-9s %5d %5d %10.2f %10.2f  \"%.32s\"\n", testMessages[i].label,
+            dataWordsFast, dataWordsBest, secondsFast * 1e6 / ITERATIONS,
+            secondsBest * 1e6 / ITERATIONS, testMessages[i].message);
+
+      totalFast += dataWordsFast;
+      totalBest += dataWordsBest;
+      totalSecondsFast += secondsFast;
+      totalSecondsBest += secondsBest;
+
+      dmtxEncodeDestroy(&encFast);
+      dmtxEncodeDestroy(&encBest);
+   }
+
+   fprintf(stdout, "%-9s %5d %5d %10.2f %10.2f\n", "total", totalFast, totalBest,
+         totalSecondsFast * 1e6 / ITERATIONS, totalSecondsBest * 1e6 / ITERATIONS);
+
+   if(failures > 0) {
+      fprintf(stdout, "FAIL: %d failure(s)\n", failures);
+      exit(1);
+   }
+
+   exit(0);
+}
+
+/**
+ *
+ *
+ */
+static int
+EncodeMessage(DmtxEncode **enc, int scheme, char *message)
+{
+   *enc = dmtxEncodeCreate();
+   if(*enc == NULL)
+      return DmtxFail;
+
+   dmtxEncodeSetProp(*enc, DmtxPropScheme, scheme);
+
+   if(dmtxEncodeDataMatrix(*enc, strlen(message), (unsigned char *)message) == DmtxFail) {
+      dmtxEncodeDestroy(enc);
+      return DmtxFail;
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * Decode the placed module array directly, which exercises error correction
+ * and scheme decoding without the cost of locating the symbol in an image.
+ * Modules stay marked as assigned so placement reads codewords back out.
+ */
+static int
+VerifyRoundTrip(DmtxEncode *enc, char *message)
+{
+   size_t i;
+   int passFail;
+   DmtxMessage *msg;
+
+   msg = dmtxMessageCreate(enc->region.sizeIdx, DmtxFormatMatrix);
+   if(msg == NULL)
+      return DmtxFail;
+
+   for(i = 0; i < msg->arraySize; i++)
+      msg->array[i] = enc->message->array[i] & ~DmtxModuleVisited;
+
+   msg = dmtxDecodePopulatedArray(enc->region.sizeIdx, msg, DmtxUndefined);
+   if(msg == NULL)
+      return DmtxFail;
+
+   passFail = ((size_t)msg->outputIdx == strlen(message) &&
+         memcmp(msg->output, message, msg->outputIdx) == 0) ? DmtxPass : DmtxFail;
+
+   dmtxMessageDestroy(&msg);
+
+   return passFail;
+}
+
+/**
+ *
+ *
+ */
+static double
+TimeEncode(int scheme, char *message)
+{
+   int i;
+   clock_t start;
+   DmtxEncode *enc;
+
+   start = clock();
+
+   for(i = 0; i < ITERATIONS; i++) {
+      if(EncodeMessage(&enc, scheme, message) == DmtxPass)
+         dmtxEncodeDestroy(&enc);
+   }
+
+   return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
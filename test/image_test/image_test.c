@@ -0,0 +1,353 @@
+/**
+ * libdmtx - Data Matrix Encoding/Decoding Library
+ *
+ * See LICENSE file in the main project directory for full
+ * terms of use and distribution.
+ *
+ * \file image_test.c
+ * \brief Correctness of the image.c convolution kernels
+ *
+ * The fixed-point 8-bit and 16-bit planes and the fused color pass are
+ * compared against convolve_horiz() and convolve_vert() on float images.
+ * Sizes include widths below the vector width, and every kernel is run
+ * both into a separate buffer and in place.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "../../image.h"
+
+#define IMAGE_TEST_PAD     3  /* Elements past the width of each fixed-point row */
+#define IMAGE_TEST_MARGIN  8  /* Replicated border around reference planes */
+
+#define min(X,Y) (((X) < (Y)) ? (X) : (Y))
+#define max(X,Y) (((X) > (Y)) ? (X) : (Y))
+
+typedef struct {
+   int width;
+   int height;
+} ImageSize;
+
+static void FatalError(int idx, char *msg);
+static int NextValue(int maxValue);
+static convolution *BinomialNew(int order);
+static convolution *GaussianNew(float sigma);
+static double QuantError(const convolution *conv);
+static gray_image *ReferenceNew(const float *plane, int width, int height, int stride,
+      const convolution *horizConv, const convolution *vertConv);
+static void fixedTest(int idx, int bytes, ImageSize size, const convolution *horizConv,
+      const convolution *vertConv);
+static void colorTest(int idx, ImageSize size, const convolution *horizConv,
+      const convolution *vertConv);
+
+static unsigned int seed = 12345;
+
+int
+main(void)
+{
+   int i, k;
+   convolution *convs[4];
+   ImageSize sizes[] = { { 1, 1 }, { 2, 5 }, { 3, 3 }, { 5, 2 }, { 7, 9 }, { 13, 11 }, { 37, 6 } };
+
+   convs[0] = BinomialNew(1);
+   convs[1] = BinomialNew(2);
+   convs[2] = GaussianNew(0.8f);
+   convs[3] = GaussianNew(1.3f);
+
+   for(i = 0; i < (int)(sizeof(sizes)/sizeof(sizes[0])); i++) {
+      for(k = 0; k < 4; k++) {
+         fixedTest(10, 1, sizes[i], convs[k], convs[3 - k]);
+         fixedTest(20, 2, sizes[i], convs[k], convs[3 - k]);
+         colorTest(30, sizes[i], convs[k], convs[3 - k]);
+      }
+
+      /* Either pass alone */
+      fixedTest(10, 1, sizes[i], convs[2], NULL);
+      fixedTest(20, 2, sizes[i], NULL, convs[1]);
+      colorTest(30, sizes[i], NULL, convs[2]);
+   }
+
+   for(k = 0; k < 4; k++)
+      convolution_delete(convs[k]);
+
+   exit(0);
+}
+
+/**
+ *
+ *
+ */
+static void
+FatalError(int idx, char *msg)
+{
+   fprintf(stdout, "FAIL: (%d) %s\n", idx, msg);
+   exit(1);
+}
+
+/**
+ * \brief  Next pseudo-random value from a fixed LCG
+ * \param  maxValue Largest value returned, at most 0xffff
+ * \return Value in 0..maxValue
+ */
+static int
+NextValue(int maxValue)
+{
+   seed = seed * 1103515245u + 12345u;
+
+   return (int)((seed >> 16) % (unsigned int)(maxValue + 1));
+}
+
+/**
+ * \brief  Binomial smoothing filter of the given order, which takes the
+ *         3 and 5 tap paths of convolve_horiz() and convolve_vert()
+ * \param  order 1 or 2
+ * \return New convolution
+ */
+static convolution *
+BinomialNew(int order)
+{
+   float half1[] = { 0.5f, 0.25f };
+   float half2[] = { 0.375f, 0.25f, 0.0625f };
+
+   return convolution_new(order, (order == 1) ? half1 : half2, 1);
+}
+
+/**
+ * \brief  Gaussian smoothing filter, of order 3 or more for the generic path
+ * \param  sigma
+ * \return New convolution
+ */
+static convolution *
+GaussianNew(float sigma)
+{
+   int order;
+   float *half;
+   convolution *conv;
+
+   half = gaussian_filter(sigma, &order);
+   conv = convolution_new(order, half, 1);
+   free(half);
+
+   return conv;
+}
+
+/**
+ * \brief  Worst case change in output per unit of input range caused by
+ *         quantizing the coefficients to CONV_FIXED_BITS
+ * \param  conv Convolution, or NULL for none
+ * \return Sum of absolute coefficient errors
+ */
+static double
+QuantError(const convolution *conv)
+{
+   int k;
+   double error;
+
+   if(conv == NULL)
+      return 0.0;
+
+   for(k = 0, error = 0.0; k < 2 * conv->order + 1; k++)
+      error += fabs((double)conv->coeffs_fixed[k] / (1 << CONV_FIXED_BITS) - conv->coeffs[k]);
+
+   return error;
+}
+
+/**
+ * \brief  Filter one plane with the float kernels
+ * \param  plane Source values
+ * \param  width
+ * \param  height
+ * \param  stride Row pitch of plane, in elements
+ * \param  horizConv Convolution, or NULL to skip the horizontal pass
+ * \param  vertConv Convolution, or NULL to skip the vertical pass
+ * \return New image holding the result
+ *
+ * The plane is filtered inside a copy grown by IMAGE_TEST_MARGIN replicated
+ * pixels on every side, which stands in for the border replication of the
+ * kernels under test and keeps the 3 and 5 tap float paths within the
+ * image sizes they handle.
+ */
+static gray_image *
+ReferenceNew(const float *plane, int width, int height, int stride,
+      const convolution *horizConv, const convolution *vertConv)
+{
+   int x, y, xSrc, ySrc;
+   gray_image *wide, *tmp, *ref;
+
+   wide = image_new(width + 2 * IMAGE_TEST_MARGIN, height + 2 * IMAGE_TEST_MARGIN);
+   tmp = image_new(wide->width, wide->height);
+   for(y = 0; y < wide->height; y++) {
+      ySrc = min(max(y - IMAGE_TEST_MARGIN, 0), height - 1);
+      for(x = 0; x < wide->width; x++) {
+         xSrc = min(max(x - IMAGE_TEST_MARGIN, 0), width - 1);
+         wide->data[y * wide->stride + x] = plane[ySrc * stride + xSrc];
+      }
+   }
+
+   if(horizConv != NULL) {
+      convolve_horiz(tmp, wide, horizConv);
+      memcpy(wide->data, tmp->data, wide->stride * wide->height * sizeof(float));
+   }
+
+   if(vertConv != NULL) {
+      convolve_vert(tmp, wide, vertConv);
+      memcpy(wide->data, tmp->data, wide->stride * wide->height * sizeof(float));
+   }
+
+   ref = image_new(width, height);
+   for(y = 0; y < height; y++)
+      memcpy(ref->data + y * ref->stride, wide->data + (y + IMAGE_TEST_MARGIN) * wide->stride +
+            IMAGE_TEST_MARGIN, width * sizeof(float));
+
+   image_delete(tmp);
+   image_delete(wide);
+
+   return ref;
+}
+
+/**
+ * \brief  Check convolve_hv_u8() or convolve_hv_u16() against the float path
+ * \param  idx Base error code
+ * \param  bytes 1 for 8-bit or 2 for 16-bit planes
+ * \param  size
+ * \param  horizConv
+ * \param  vertConv
+ * \return void
+ *
+ * Rows are IMAGE_TEST_PAD elements longer than the width, so the stride is
+ * also checked to count elements and the padding to be left alone.
+ */
+static void
+fixedTest(int idx, int bytes, ImageSize size, const convolution *horizConv,
+      const convolution *vertConv)
+{
+   int x, y, i, count, stride, maxValue;
+   double tolerance;
+   float *plane;
+   void *src, *dst, *inPlace;
+   gray_image *ref;
+
+   stride = size.width + IMAGE_TEST_PAD;
+   count = stride * size.height;
+   maxValue = (bytes == 1) ? 0xff : 0xffff;
+
+   plane = (float *)malloc(count * sizeof(float));
+   src = malloc(count * bytes);
+   dst = malloc(count * bytes);
+   inPlace = malloc(count * bytes);
+   if(plane == NULL || src == NULL || dst == NULL || inPlace == NULL)
+      FatalError(idx + 1, "fixedTest\n");
+
+   for(i = 0; i < count; i++) {
+      plane[i] = (float)NextValue(maxValue);
+      if(bytes == 1)
+         ((unsigned char *)src)[i] = (unsigned char)plane[i];
+      else
+         ((unsigned short *)src)[i] = (unsigned short)plane[i];
+   }
+   memcpy(dst, src, count * bytes);
+   memcpy(inPlace, src, count * bytes);
+
+   if(bytes == 1) {
+      convolve_hv_u8((unsigned char *)dst, (unsigned char *)src, size.width, size.height,
+            stride, horizConv, vertConv);
+      convolve_hv_u8((unsigned char *)inPlace, (unsigned char *)inPlace, size.width, size.height,
+            stride, horizConv, vertConv);
+   }
+   else {
+      convolve_hv_u16((unsigned short *)dst, (unsigned short *)src, size.width, size.height,
+            stride, horizConv, vertConv);
+      convolve_hv_u16((unsigned short *)inPlace, (unsigned short *)inPlace, size.width, size.height,
+            stride, horizConv, vertConv);
+   }
+
+   /* In place must match the separate buffer exactly, padding included */
+   if(memcmp(dst, inPlace, count * bytes) != 0)
+      FatalError(idx + 2, "fixedTest\n");
+
+   /* Half a level from each pass's rounding plus coefficient quantization */
+   tolerance = 1.0 + maxValue * (QuantError(horizConv) + QuantError(vertConv));
+
+   ref = ReferenceNew(plane, size.width, size.height, stride, horizConv, vertConv);
+   for(y = 0; y < size.height; y++) {
+      for(x = 0; x < stride; x++) {
+         i = y * stride + x;
+         if(x >= size.width) {
+            if((bytes == 1 && ((unsigned char *)dst)[i] != ((unsigned char *)src)[i]) ||
+                  (bytes == 2 && ((unsigned short *)dst)[i] != ((unsigned short *)src)[i]))
+               FatalError(idx + 3, "fixedTest\n");
+         }
+         else if(fabs(((bytes == 1) ? ((unsigned char *)dst)[i] : ((unsigned short *)dst)[i]) -
+               ref->data[y * ref->stride + x]) > tolerance) {
+            fprintf(stdout, "%dx%d at %d,%d\n", size.width, size.height, x, y);
+            FatalError(idx + 4, "fixedTest\n");
+         }
+      }
+   }
+
+   image_delete(ref);
+   free(inPlace);
+   free(dst);
+   free(src);
+   free(plane);
+}
+
+/**
+ * \brief  Check color_image_convolve_hv() against each plane on its own
+ * \param  idx Base error code
+ * \param  size
+ * \param  horizConv
+ * \param  vertConv
+ * \return void
+ */
+static void
+colorTest(int idx, ImageSize size, const convolution *horizConv, const convolution *vertConv)
+{
+   int x, y, c, i;
+   float *srcPlanes[3], *dstPlanes[3], *inPlacePlanes[3];
+   color_image *src, *dst, *inPlace;
+   gray_image *ref;
+
+   src = color_image_new(size.width, size.height);
+   dst = color_image_new(size.width, size.height);
+   for(i = 0; i < 3 * src->stride * src->height; i++)
+      src->data1[i] = (float)NextValue(0xff);
+   inPlace = color_image_cpy(src);
+
+   color_image_convolve_hv(dst, src, horizConv, vertConv);
+   color_image_convolve_hv(inPlace, inPlace, horizConv, vertConv);
+
+   srcPlanes[0] = src->data1;
+   srcPlanes[1] = src->data2;
+   srcPlanes[2] = src->data3;
+   dstPlanes[0] = dst->data1;
+   dstPlanes[1] = dst->data2;
+   dstPlanes[2] = dst->data3;
+   inPlacePlanes[0] = inPlace->data1;
+   inPlacePlanes[1] = inPlace->data2;
+   inPlacePlanes[2] = inPlace->data3;
+
+   for(c = 0; c < 3; c++) {
+      ref = ReferenceNew(srcPlanes[c], size.width, size.height, src->stride, horizConv, vertConv);
+      for(y = 0; y < size.height; y++) {
+         for(x = 0; x < size.width; x++) {
+            i = y * src->stride + x;
+            if(dstPlanes[c][i] != inPlacePlanes[c][i])
+               FatalError(idx + 1, "colorTest\n");
+
+            /* Sums in a different order only differ in float rounding */
+            if(fabs(dstPlanes[c][i] - ref->data[y * ref->stride + x]) > 0.01) {
+               fprintf(stdout, "%dx%d plane %d at %d,%d\n", size.width, size.height, c, x, y);
+               FatalError(idx + 2, "colorTest\n");
+            }
+         }
+      }
+      image_delete(ref);
+   }
+
+   color_image_delete(inPlace);
+   color_image_delete(dst);
+   color_image_delete(src);
+}
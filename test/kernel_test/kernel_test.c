@@ -0,0 +1,368 @@
+/**
+ * libdmtx - Data Matrix Encoding/Decoding Library
+ *
+ * See LICENSE file in the main project directory for full
+ * terms of use and distribution.
+ *
+ * \file kernel_test.c
+ * \brief Micro-benchmarks for individual decode and encode kernels
+ *
+ * The library is compiled into this program directly, as multi_test does,
+ * so its static functions can be called one at a time. Every kernel runs
+ * on fixed inputs built from one known symbol, and is repeated with a
+ * doubling iteration count until the run lasts long enough to time.
+ * Reported figures are nanoseconds and, on x86, TSC cycles per call.
+ *
+ * usage: kernel_test [-t min-ms] [kernel ...]
+ */
+
+#include "../../dmtx.c"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define KernelCycles() ((unsigned long long)__rdtsc())
+#else
+#define KernelCycles() 0ULL
+#endif
+
+#define KERNEL_MESSAGE     "Lot 4711-B/93, Qty 250, SN 0123456789 http://www.libdmtx.org/"
+#define KERNEL_SIZE_IDX    DmtxSymbol32x32
+#define KERNEL_MODULE_SIZE 6
+#define KERNEL_ERRORS      4
+
+typedef struct {
+   DmtxEncode *enc;
+   DmtxImage *img;
+   DmtxDecode *dec;         /* decoder that found region */
+   DmtxDecode *trailDec;    /* fresh decoder holding a single continuous trail */
+   DmtxRegion *region;      /* fully fitted region */
+   DmtxRegion trail;        /* region state after TrailBlazeContinuous() */
+   const DmtxSymbolInfo *symbolInfo;
+   unsigned char *code;     /* data and error codewords with KERNEL_ERRORS corrupted */
+   unsigned char *codeWork;
+   unsigned char *array;    /* module array ready to be read back into codewords */
+   unsigned char *arrayWork;
+   DmtxMessage *msg;        /* clean codewords for DecodeDataStream() */
+   int flowRow;
+} KernelContext;
+
+typedef struct {
+   char *name;
+   int (*run)(KernelContext *ctx, int iter);
+} KernelBench;
+
+static int BenchGetPointFlow(KernelContext *ctx, int iter);
+static int BenchTrailBlazeContinuous(KernelContext *ctx, int iter);
+static int BenchFindBestSolidLine(KernelContext *ctx, int iter);
+static int BenchReadModuleColor(KernelContext *ctx, int iter);
+static int BenchMatrixRegionFindSize(KernelContext *ctx, int iter);
+static int BenchRsDecode(KernelContext *ctx, int iter);
+static int BenchModulePlacementEcc200(KernelContext *ctx, int iter);
+static int BenchDecodeDataStream(KernelContext *ctx, int iter);
+static int BenchEncodeOptimizeBest(KernelContext *ctx, int iter);
+static DmtxPassFail KernelSetup(KernelContext *ctx);
+static void KernelTeardown(KernelContext *ctx);
+static void KernelTime(KernelBench *bench, KernelContext *ctx, double minSeconds);
+
+static KernelBench kernels[] = {
+   { "GetPointFlow",          BenchGetPointFlow },
+   { "TrailBlazeContinuous",  BenchTrailBlazeContinuous },
+   { "FindBestSolidLine",     BenchFindBestSolidLine },
+   { "ReadModuleColor",       BenchReadModuleColor },
+   { "MatrixRegionFindSize",  BenchMatrixRegionFindSize },
+   { "RsDecode",              BenchRsDecode },
+   { "ModulePlacementEcc200", BenchModulePlacementEcc200 },
+   { "DecodeDataStream",      BenchDecodeDataStream },
+   { "EncodeOptimizeBest",    BenchEncodeOptimizeBest },
+   { NULL, NULL }
+};
+
+/* Accumulates kernel results so calls cannot be optimized away */
+static volatile int kernelSink;
+
+int
+main(int argc, char *argv[])
+{
+   int i, k, first, selected;
+   double minSeconds;
+   KernelContext ctx;
+
+   minSeconds = 0.2;
+   for(first = 1; first + 1 < argc && strcmp(argv[first], "-t") == 0; first += 2)
+      minSeconds = atoi(argv[first + 1]) / 1000.0;
+
+   if(KernelSetup(&ctx) == DmtxFail) {
+      fprintf(stdout, "FAIL: could not prepare kernel inputs\n");
+      exit(1);
+   }
+
+   fprintf(stdout, "%-22s %12s %12s %12s\n", "kernel", "iterations", "ns/op", "cycles/op");
+
+   /* Run every kernel unless some are named on the command line */
+   for(k = 0; kernels[k].name != NULL; k++) {
+      selected = (first >= argc);
+      for(i = first; i < argc; i++) {
+         if(strcmp(argv[i], kernels[k].name) == 0)
+            selected = 1;
+      }
+      if(selected)
+         KernelTime(&kernels[k], &ctx, minSeconds);
+   }
+
+   KernelTeardown(&ctx);
+
+   exit(0);
+}
+
+/**
+ * Build every kernel input from one encoded symbol
+ *
+ */
+static DmtxPassFail
+KernelSetup(KernelContext *ctx)
+{
+   int i, step, mappingSize;
+   DmtxTime timeout;
+
+   memset(ctx, 0x00, sizeof(KernelContext));
+
+   ctx->enc = dmtxEncodeCreate();
+   if(ctx->enc == NULL)
+      return DmtxFail;
+
+   dmtxEncodeSetProp(ctx->enc, DmtxPropPixelPacking, DmtxPack8bppK);
+   dmtxEncodeSetProp(ctx->enc, DmtxPropModuleSize, KERNEL_MODULE_SIZE);
+   dmtxEncodeSetProp(ctx->enc, DmtxPropMarginSize, 2 * KERNEL_MODULE_SIZE);
+   dmtxEncodeSetProp(ctx->enc, DmtxPropSizeRequest, KERNEL_SIZE_IDX);
+   if(dmtxEncodeDataMatrix(ctx->enc, strlen(KERNEL_MESSAGE), (unsigned char *)KERNEL_MESSAGE) == DmtxFail)
+      return DmtxFail;
+
+   ctx->img = ctx->enc->image;
+   ctx->symbolInfo = dmtxGetSymbolInfo(KERNEL_SIZE_IDX);
+   ctx->flowRow = ctx->img->height / 2;
+
+   /* Region fitted by the full pipeline */
+   ctx->dec = dmtxDecodeCreate(ctx->img, 1);
+   if(ctx->dec == NULL)
+      return DmtxFail;
+   timeout = dmtxTimeAdd(dmtxTimeNow(), 5000);
+   ctx->region = dmtxRegionFindNext(ctx->dec, &timeout);
+   if(ctx->region == NULL)
+      return DmtxFail;
+
+   /* Trail from the same starting edge on an untouched cache */
+   ctx->trailDec = dmtxDecodeCreate(ctx->img, 1);
+   if(ctx->trailDec == NULL)
+      return DmtxFail;
+   if(TrailBlazeContinuous(ctx->trailDec, &ctx->trail, ctx->region->flowBegin, DmtxUndefined) == DmtxFail)
+      return DmtxFail;
+
+   /* Codewords with errors spread evenly over the symbol */
+   ctx->code = (unsigned char *)malloc(ctx->enc->message->codeSize);
+   ctx->codeWork = (unsigned char *)malloc(ctx->enc->message->codeSize);
+   if(ctx->code == NULL || ctx->codeWork == NULL)
+      return DmtxFail;
+   memcpy(ctx->code, ctx->enc->message->code, ctx->enc->message->codeSize);
+   step = (int)ctx->enc->message->codeSize / KERNEL_ERRORS;
+   for(i = 0; i < KERNEL_ERRORS; i++)
+      ctx->code[i * step] ^= 0x5a;
+
+   /* Placed modules stay assigned, so placement reads codewords back out */
+   mappingSize = ctx->symbolInfo->mappingRows * ctx->symbolInfo->mappingCols;
+   ctx->array = (unsigned char *)malloc(mappingSize);
+   ctx->arrayWork = (unsigned char *)malloc(mappingSize);
+   if(ctx->array == NULL || ctx->arrayWork == NULL)
+      return DmtxFail;
+   for(i = 0; i < mappingSize; i++)
+      ctx->array[i] = ctx->enc->message->array[i] & ~DmtxModuleVisited;
+
+   ctx->msg = dmtxMessageCreate(KERNEL_SIZE_IDX, DmtxFormatMatrix);
+   if(ctx->msg == NULL)
+      return DmtxFail;
+   memcpy(ctx->msg->code, ctx->enc->message->code, ctx->msg->codeSize);
+
+   return DmtxPass;
+}
+
+/**
+ *
+ *
+ */
+static void
+KernelTeardown(KernelContext *ctx)
+{
+   dmtxMessageDestroy(&ctx->msg);
+   free(ctx->arrayWork);
+   free(ctx->array);
+   free(ctx->codeWork);
+   free(ctx->code);
+   dmtxDecodeDestroy(&ctx->trailDec);
+   dmtxRegionDestroy(&ctx->region);
+   dmtxDecodeDestroy(&ctx->dec);
+   dmtxEncodeDestroy(&ctx->enc);
+}
+
+/**
+ * Double the iteration count until one run lasts at least minSeconds,
+ * then report that run
+ */
+static void
+KernelTime(KernelBench *bench, KernelContext *ctx, double minSeconds)
+{
+   int i, iterations;
+   unsigned long long cycles;
+   double seconds;
+   clock_t start;
+
+   for(iterations = 1; ; iterations *= 2) {
+      start = clock();
+      cycles = KernelCycles();
+      for(i = 0; i < iterations; i++)
+         kernelSink += bench->run(ctx, i);
+      cycles = KernelCycles() - cycles;
+      seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+      if(seconds >= minSeconds || iterations >= (1 << 30))
+         break;
+   }
+
+   if(cycles > 0)
+      fprintf(stdout, "%-22s %12d %12.1f %12.1f\n", bench->name, iterations,
+            seconds * 1e9 / iterations, (double)cycles / iterations);
+   else
+      fprintf(stdout, "%-22s %12d %12.1f %12s\n", bench->name, iterations,
+            seconds * 1e9 / iterations, "-");
+}
+
+/**
+ * One call per pixel, walking the middle row across the symbol edges
+ *
+ */
+static int
+BenchGetPointFlow(KernelContext *ctx, int iter)
+{
+   DmtxPixelLoc loc;
+
+   loc.X = 1 + iter % (ctx->img->width - 2);
+   loc.Y = ctx->flowRow;
+
+   return GetPointFlow(ctx->dec, 0, loc, dmtxNeighborNone).mag;
+}
+
+/**
+ * Blaze the trail again from the same edge, which leaves the cache as found
+ *
+ */
+static int
+BenchTrailBlazeContinuous(KernelContext *ctx, int iter)
+{
+   (void)iter;
+
+   return TrailBlazeContinuous(ctx->trailDec, &ctx->trail, ctx->trail.flowBegin, DmtxUndefined);
+}
+
+/**
+ * First line search of MatrixRegionOrientation()
+ *
+ */
+static int
+BenchFindBestSolidLine(KernelContext *ctx, int iter)
+{
+   (void)iter;
+
+   return FindBestSolidLine(ctx->trailDec, &ctx->trail, 0, 0, +1, DmtxUndefined).mag;
+}
+
+/**
+ * One call per module, in raster order
+ *
+ */
+static int
+BenchReadModuleColor(KernelContext *ctx, int iter)
+{
+   int moduleCount;
+
+   moduleCount = ctx->symbolInfo->symbolRows * ctx->symbolInfo->symbolCols;
+   iter %= moduleCount;
+
+   return ReadModuleColor(ctx->dec, ctx->region, iter / ctx->symbolInfo->symbolCols,
+         iter % ctx->symbolInfo->symbolCols, ctx->symbolInfo, 0);
+}
+
+/**
+ *
+ *
+ */
+static int
+BenchMatrixRegionFindSize(KernelContext *ctx, int iter)
+{
+   DmtxRegion reg;
+
+   (void)iter;
+
+   reg = *ctx->region;
+
+   return MatrixRegionFindSize(ctx->dec, &reg);
+}
+
+/**
+ * Corrects KERNEL_ERRORS codewords, restored from a copy each call
+ *
+ */
+static int
+BenchRsDecode(KernelContext *ctx, int iter)
+{
+   (void)iter;
+
+   memcpy(ctx->codeWork, ctx->code, ctx->enc->message->codeSize);
+
+   return RsDecode(ctx->codeWork, ctx->symbolInfo, DmtxUndefined, NULL);
+}
+
+/**
+ * Module array restored from a copy each call
+ *
+ */
+static int
+BenchModulePlacementEcc200(KernelContext *ctx, int iter)
+{
+   (void)iter;
+
+   memcpy(ctx->arrayWork, ctx->array, ctx->symbolInfo->mappingRows * ctx->symbolInfo->mappingCols);
+
+   return ModulePlacementEcc200(ctx->arrayWork, ctx->codeWork, ctx->symbolInfo,
+         DmtxModuleOnRed | DmtxModuleOnGreen | DmtxModuleOnBlue);
+}
+
+/**
+ *
+ *
+ */
+static int
+BenchDecodeDataStream(KernelContext *ctx, int iter)
+{
+   (void)iter;
+
+   DecodeDataStream(ctx->msg, KERNEL_SIZE_IDX, NULL);
+
+   return (int)ctx->msg->outputIdx;
+}
+
+/**
+ *
+ *
+ */
+static int
+BenchEncodeOptimizeBest(KernelContext *ctx, int iter)
+{
+   DmtxByte outputStorage[4096];
+   DmtxByteList input = dmtxByteListBuild((DmtxByte *)KERNEL_MESSAGE, strlen(KERNEL_MESSAGE));
+   DmtxByteList output = dmtxByteListBuild(outputStorage, sizeof(outputStorage));
+
+   (void)ctx;
+   (void)iter;
+
+   input.length = strlen(KERNEL_MESSAGE);
+
+   return EncodeOptimizeBest(&input, &output, DmtxSymbolSquareAuto, DmtxUndefined);
+}
@@ -17,6 +17,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
+#include <float.h>
 #include "../../dmtx.h"
 
 char *programName;
@@ -29,6 +31,20 @@ static void FatalError(int idx, char* msg)
 
 static void timeAddTest(void);
 static void timePrint(DmtxTime t);
+static void packingTest(int idx, int pack);
+static void packLittleEndianTest(void);
+static void viewTest(void);
+static void preprocessTest(void);
+static void packedPreprocessTest(void);
+static void colorReduceTest(void);
+static void statsTest(void);
+static void traceTest(void);
+static void transformTest(void);
+static void houghTest(void);
+static void timingTest(void);
+static void runsTest(void);
+static void samplingTest(void);
+static void corpusTest(char *dirName);
 
 int
 main(int argc, char *argv[])
@@ -36,6 +52,27 @@ main(int argc, char *argv[])
    programName = argv[0];
 
    timeAddTest();
+   packingTest(10, DmtxPack1bppK);
+   packingTest(20, DmtxPack16bppRGB565);
+   packingTest(30, DmtxPack16bppXRGB);
+   packingTest(40, DmtxPack32bppXRGB);
+   packingTest(150, DmtxPack16bppRGB565LE);
+   packLittleEndianTest();
+   viewTest();
+   preprocessTest();
+   packedPreprocessTest();
+   colorReduceTest();
+   statsTest();
+   traceTest();
+   transformTest();
+   houghTest();
+   timingTest();
+   runsTest();
+   samplingTest();
+
+   /* Optional: directory holding test/compare_test/input_messages */
+   if(argc > 1)
+      corpusTest(argv[1]);
 
    exit(0);
 }
@@ -98,6 +135,329 @@ timeAddTest(void)
    }
 }
 
+/**
+ * Encode to an image of the given packing and decode it back in place
+ *
+ */
+static void
+packingTest(int idx, int pack)
+{
+   int width, height, bitsPerPixel;
+   unsigned char str[] = "packed pixel rows";
+   DmtxEncode *enc;
+   DmtxImage *img;
+   DmtxDecode *dec;
+   DmtxRegion *reg;
+   DmtxMessage *msg;
+
+   enc = dmtxEncodeCreate();
+   if(enc == NULL)
+      FatalError(idx + 1, "packingTest\n");
+
+   dmtxEncodeSetProp(enc, DmtxPropPixelPacking, pack);
+   if(dmtxEncodeDataMatrix(enc, strlen((char *)str), str) == DmtxFail)
+      FatalError(idx + 2, "packingTest\n");
+
+   width = dmtxImageGetProp(enc->image, DmtxPropWidth);
+   height = dmtxImageGetProp(enc->image, DmtxPropHeight);
+   bitsPerPixel = dmtxImageGetProp(enc->image, DmtxPropBitsPerPixel);
+   if(dmtxImageGetProp(enc->image, DmtxPropRowSizeBytes) != (width * bitsPerPixel + 7) / 8)
+      FatalError(idx + 3, "packingTest\n");
+
+   img = dmtxImageCreate(enc->image->pxl, width, height, pack);
+   if(img == NULL)
+      FatalError(idx + 4, "packingTest\n");
+
+   dec = dmtxDecodeCreate(img, 1);
+   reg = dmtxRegionFindNext(dec, NULL);
+   if(reg == NULL)
+      FatalError(idx + 5, "packingTest\n");
+
+   msg = dmtxDecodeMatrixRegion(dec, reg, DmtxUndefined);
+   if(msg == NULL || msg->outputIdx != (int)strlen((char *)str) ||
+         memcmp(msg->output, str, msg->outputIdx) != 0)
+      FatalError(idx + 6, "packingTest\n");
+
+   dmtxMessageDestroy(&msg);
+   dmtxRegionDestroy(&reg);
+   dmtxDecodeDestroy(&dec);
+   dmtxImageDestroy(&img);
+   dmtxEncodeDestroy(&enc);
+}
+
+/**
+ * Read and write one little-endian RGB565 pixel and check its bytes
+ *
+ */
+static void
+packLittleEndianTest(void)
+{
+   int value;
+   unsigned char pxl[2] = { 0x1f, 0x00 };
+   DmtxImage *img;
+
+   /* Low byte first, so 0x001f is pure blue */
+   img = dmtxImageCreate(pxl, 1, 1, DmtxPack16bppRGB565LE);
+   if(img == NULL)
+      FatalError(157, "packLittleEndianTest\n");
+
+   dmtxImageGetPixelValue(img, 0, 0, 0, &value);
+   if(value != 0)
+      FatalError(157, "packLittleEndianTest\n");
+   dmtxImageGetPixelValue(img, 0, 0, 2, &value);
+   if(value != 255)
+      FatalError(157, "packLittleEndianTest\n");
+
+   /* Full red lands in the top bits of the high byte */
+   dmtxImageSetPixelValue(img, 0, 0, 0, 255);
+   if(pxl[0] != 0x1f || pxl[1] != 0xf8)
+      FatalError(158, "packLittleEndianTest\n");
+
+   dmtxImageDestroy(&img);
+}
+
+/**
+ * \brief  Decode the first region found and compare it with str
+ *
+ */
+static int
+decodeMatches(DmtxDecode *dec, unsigned char *str)
+{
+   int ok;
+   DmtxRegion *reg;
+   DmtxMessage *msg;
+
+   ok = 0;
+   reg = dmtxRegionFindNext(dec, NULL);
+   if(reg != NULL) {
+      msg = dmtxDecodeMatrixRegion(dec, reg, DmtxUndefined);
+      if(msg != NULL) {
+         ok = (msg->outputIdx == (int)strlen((char *)str) &&
+               memcmp(msg->output, str, msg->outputIdx) == 0);
+         dmtxMessageDestroy(&msg);
+      }
+      dmtxRegionDestroy(&reg);
+   }
+
+   return ok;
+}
+
+/**
+ * \brief  Decode a symbol from a strided buffer and from a view into it
+ *
+ */
+static int
+viewDecodes(DmtxImage *img, unsigned char *str)
+{
+   int ok;
+   DmtxDecode *dec;
+
+   dec = dmtxDecodeCreate(img, 1);
+   ok = decodeMatches(dec, str);
+   dmtxDecodeDestroy(&dec);
+
+   return ok;
+}
+
+static void
+viewTest(void)
+{
+   int row, width, height;
+   int canvasWidth, canvasHeight, canvasStride, left, top;
+   unsigned char str[] = "zero copy view";
+   unsigned char *canvas;
+   DmtxEncode *enc;
+   DmtxImage *img, *view;
+
+   enc = dmtxEncodeCreate();
+   dmtxEncodeSetProp(enc, DmtxPropPixelPacking, DmtxPack8bppK);
+   if(dmtxEncodeDataMatrix(enc, strlen((char *)str), str) == DmtxFail)
+      FatalError(51, "viewTest\n");
+
+   width = dmtxImageGetProp(enc->image, DmtxPropWidth);
+   height = dmtxImageGetProp(enc->image, DmtxPropHeight);
+
+   /* Paste symbol into a larger canvas whose pitch is not its width */
+   left = 17;
+   top = 9;
+   canvasWidth = width + 37;
+   canvasHeight = height + 21;
+   canvasStride = canvasWidth + 13;
+   canvas = (unsigned char *)malloc(canvasStride * canvasHeight);
+   memset(canvas, 0xff, canvasStride * canvasHeight);
+   for(row = 0; row < height; row++)
+      memcpy(canvas + (top + row) * canvasStride + left,
+            enc->image->pxl + row * enc->image->rowSizeBytes, width);
+
+   img = dmtxImageCreate(canvas, canvasWidth, canvasHeight, DmtxPack8bppK);
+   if(img == NULL || dmtxImageSetProp(img, DmtxPropRowSizeBytes, canvasStride) == DmtxFail)
+      FatalError(52, "viewTest\n");
+   if(dmtxImageSetProp(img, DmtxPropRowSizeBytes, canvasWidth - 1) != DmtxFail)
+      FatalError(53, "viewTest\n");
+   if(!viewDecodes(img, str))
+      FatalError(54, "viewTest\n");
+
+   /* View covers exactly the pasted symbol; y counts up from the bottom */
+   view = dmtxImageCreateView(img, left, canvasHeight - top - height, width, height);
+   if(view == NULL)
+      FatalError(55, "viewTest\n");
+   if(dmtxImageCreateView(img, left, 0, canvasWidth, 1) != NULL)
+      FatalError(56, "viewTest\n");
+   if(!viewDecodes(view, str))
+      FatalError(57, "viewTest\n");
+
+   dmtxImageDestroy(&view);
+   dmtxImageDestroy(&img);
+   dmtxEncodeDestroy(&enc);
+   free(canvas);
+}
+
+/**
+ * \brief  Decode a faint, noisy symbol with the preprocessing pipeline
+ *
+ */
+static void
+preprocessTest(void)
+{
+   int i, size;
+   unsigned int noise;
+   unsigned char str[] = "preprocess";
+   DmtxEncode *enc;
+   DmtxDecode *dec;
+
+   enc = dmtxEncodeCreate();
+   dmtxEncodeSetProp(enc, DmtxPropPixelPacking, DmtxPack8bppK);
+   dmtxEncodeSetProp(enc, DmtxPropModuleSize, 6);
+   if(dmtxEncodeDataMatrix(enc, strlen((char *)str), str) == DmtxFail)
+      FatalError(61, "preprocessTest\n");
+
+   /* Squeeze contrast into 8 levels and add +/-3 of pseudo-random noise */
+   size = enc->image->rowSizeBytes * enc->image->height;
+   for(i = 0, noise = 12345; i < size; i++) {
+      noise = noise * 1103515245 + 12345;
+      enc->image->pxl[i] = 120 + enc->image->pxl[i] * 8 / 255 + (int)((noise >> 16) % 7) - 3;
+   }
+
+   dec = dmtxDecodeCreate(enc->image, 1);
+   if(dmtxDecodeSetProp(dec, DmtxPropPreprocess, 0x80) != DmtxFail)
+      FatalError(62, "preprocessTest\n");
+   if(dmtxDecodeSetProp(dec, DmtxPropPreprocess, DmtxPreprocessAll) == DmtxFail ||
+         dmtxDecodeGetProp(dec, DmtxPropPreprocess) != DmtxPreprocessAll)
+      FatalError(63, "preprocessTest\n");
+   if(!decodeMatches(dec, str))
+      FatalError(64, "preprocessTest\n");
+   dmtxDecodeDestroy(&dec);
+   dmtxEncodeDestroy(&enc);
+}
+
+/**
+ * \brief  Check that preprocessing sees the same edges in a packed 1-bpp
+ *         image as in the same pixels stored at 8 bpp
+ *
+ * Scattered dots can leave the raw 3x3 neighborhood of a pixel flat while
+ * still reaching it once the tiles are smoothed and sharpened.
+ */
+static void
+packedPreprocessTest(void)
+{
+   int x, y, value;
+   int width = 64, height = 64;
+   unsigned int noise;
+   unsigned char *pxl1, *pxl8;
+   DmtxImage *img1, *img8;
+   DmtxDecode *dec1, *dec8;
+   DmtxRegion *reg1, *reg8;
+   DmtxDecodeStats stats1, stats8;
+
+   pxl1 = (unsigned char *)calloc((width + 7) / 8 * height, sizeof(unsigned char));
+   pxl8 = (unsigned char *)malloc(width * height);
+   img1 = dmtxImageCreate(pxl1, width, height, DmtxPack1bppK);
+   img8 = dmtxImageCreate(pxl8, width, height, DmtxPack8bppK);
+   if(img1 == NULL || img8 == NULL)
+      FatalError(171, "packedPreprocessTest\n");
+
+   /* Dark dots on about one pixel in fifty, stored both ways */
+   for(y = 0, noise = 12345; y < height; y++) {
+      for(x = 0; x < width; x++) {
+         noise = noise * 1103515245 + 12345;
+         value = ((noise >> 16) % 100 < 2) ? 0 : 255;
+         dmtxImageSetPixelValue(img1, x, y, 0, value);
+         dmtxImageSetPixelValue(img8, x, y, 0, value);
+      }
+   }
+
+   dec1 = dmtxDecodeCreate(img1, 1);
+   dec8 = dmtxDecodeCreate(img8, 1);
+   if(dmtxDecodeSetProp(dec1, DmtxPropPreprocess, DmtxPreprocessAll) == DmtxFail ||
+         dmtxDecodeSetProp(dec8, DmtxPropPreprocess, DmtxPreprocessAll) == DmtxFail)
+      FatalError(172, "packedPreprocessTest\n");
+
+   for(y = 0; y < height; y++) {
+      for(x = 0; x < width; x++) {
+         reg1 = dmtxRegionScanPixel(dec1, x, y);
+         reg8 = dmtxRegionScanPixel(dec8, x, y);
+         if((reg1 == NULL) != (reg8 == NULL))
+            FatalError(173, "packedPreprocessTest\n");
+         if(reg1 != NULL)
+            dmtxRegionDestroy(&reg1);
+         if(reg8 != NULL)
+            dmtxRegionDestroy(&reg8);
+      }
+   }
+
+   /* Statistics may be compiled out */
+   if(dmtxDecodeGetStats(dec1, &stats1) == DmtxPass &&
+         dmtxDecodeGetStats(dec8, &stats8) == DmtxPass &&
+         (stats1.edgeHits != stats8.edgeHits || stats1.edgeHits == 0))
+      FatalError(174, "packedPreprocessTest\n");
+
+   dmtxDecodeDestroy(&dec1);
+   dmtxDecodeDestroy(&dec8);
+   dmtxImageDestroy(&img1);
+   dmtxImageDestroy(&img8);
+   free(pxl1);
+   free(pxl8);
+}
+
+/**
+ * \brief  Decode a symbol printed in one color channel through color reduction
+ *
+ */
+static void
+colorReduceTest(void)
+{
+   int i, pixelCount, mode;
+   unsigned char *px;
+   unsigned char str[] = "color reduce";
+   DmtxEncode *enc;
+   DmtxDecode *dec;
+
+   enc = dmtxEncodeCreate();
+   dmtxEncodeSetProp(enc, DmtxPropPixelPacking, DmtxPack24bppRGB);
+   if(dmtxEncodeDataMatrix(enc, strlen((char *)str), str) == DmtxFail)
+      FatalError(71, "colorReduceTest\n");
+
+   /* Red carries nothing, green a faint copy, blue the full symbol */
+   pixelCount = enc->image->width * enc->image->height;
+   for(i = 0; i < pixelCount; i++) {
+      px = enc->image->pxl + i * 3;
+      px[1] = 100 + px[2] / 4;
+      px[0] = 200;
+   }
+
+   for(mode = DmtxColorReduceLuma; mode <= DmtxColorReduceMaxContrast; mode++) {
+      dec = dmtxDecodeCreate(enc->image, 1);
+      if(dmtxDecodeSetProp(dec, DmtxPropColorReduce, mode) == DmtxFail ||
+            dmtxDecodeGetProp(dec, DmtxPropChannelCount) != 1)
+         FatalError(72, "colorReduceTest\n");
+      if(!decodeMatches(dec, str))
+         FatalError(73, "colorReduceTest\n");
+      dmtxDecodeDestroy(&dec);
+   }
+
+   dmtxEncodeDestroy(&enc);
+}
+
 /**
  *
  *
@@ -121,3 +481,555 @@ TestRGB(void)
    dmtxImageCreate(ptr, 320, 240, DmtxPack24bppRGB);
 }
 */
+
+/**
+ * Decode a symbol with one damaged data module and check that every
+ * stage left its mark in the decoder statistics
+ */
+static void
+statsTest(void)
+{
+   int x, y, x0, y0, stage, reject;
+   long rejectSum;
+   unsigned char *px;
+   unsigned char str[] = "decoder statistics";
+   DmtxEncode *enc;
+   DmtxDecode *dec;
+   DmtxDecodeStats stats;
+
+   enc = dmtxEncodeCreate();
+   dmtxEncodeSetProp(enc, DmtxPropPixelPacking, DmtxPack8bppK);
+   if(dmtxEncodeDataMatrix(enc, strlen((char *)str), str) == DmtxFail)
+      FatalError(81, "statsTest\n");
+
+   /* Invert one module well inside the data area */
+   x0 = enc->marginSize + 4 * enc->moduleSize;
+   y0 = enc->marginSize + 4 * enc->moduleSize;
+   for(y = y0; y < y0 + enc->moduleSize; y++) {
+      for(x = x0; x < x0 + enc->moduleSize; x++) {
+         px = enc->image->pxl + y * enc->image->rowSizeBytes + x;
+         *px = 255 - *px;
+      }
+   }
+
+   /* Nothing to check when statistics are compiled out */
+   dec = dmtxDecodeCreate(enc->image, 1);
+   if(dmtxDecodeGetStats(dec, &stats) == DmtxFail) {
+      dmtxDecodeDestroy(&dec);
+      dmtxEncodeDestroy(&enc);
+      return;
+   }
+   if(stats.gridPopped != 0)
+      FatalError(82, "statsTest\n");
+
+   if(!decodeMatches(dec, str))
+      FatalError(83, "statsTest\n");
+
+   dmtxDecodeGetStats(dec, &stats);
+   if(stats.gridPopped < 1 || stats.gridPopped < stats.gridSkipped ||
+         stats.edgeHits < 1 || stats.trailSteps < 40 || stats.houghLines < 3 ||
+         stats.sizeCandidates < 1)
+      FatalError(84, "statsTest\n");
+
+   if(stats.rsBlocksCorrected != 1 || stats.rsWordsFixed < 1)
+      FatalError(85, "statsTest\n");
+
+   for(stage = 0; stage < DmtxStatsStageCount; stage++) {
+      if(stats.stageUsec[stage] < 0 || stats.stageUsec[stage] > stats.stageUsec[DmtxStatsStageFind] +
+            stats.stageUsec[DmtxStatsStageDecode])
+         FatalError(86, "statsTest\n");
+   }
+
+   /* Every edge hit but the one that found the symbol was dropped for a reason */
+   for(reject = 0, rejectSum = 0; reject < DmtxRejectCount; reject++) {
+      if(stats.rejects[reject] < 0)
+         FatalError(88, "statsTest\n");
+      rejectSum += stats.rejects[reject];
+   }
+   if(rejectSum + 1 != stats.edgeHits)
+      FatalError(89, "statsTest\n");
+
+   /* A new image starts a new count */
+   dmtxDecodeSetImage(dec, enc->image);
+   dmtxDecodeGetStats(dec, &stats);
+   if(stats.gridPopped != 0 || stats.rsWordsFixed != 0 || stats.rejects[DmtxRejectTrailLength] != 0)
+      FatalError(87, "statsTest\n");
+
+   dmtxDecodeDestroy(&dec);
+   dmtxEncodeDestroy(&enc);
+}
+
+/**
+ * Trace one decode and check that stage marks pair up, survive ring
+ * wraparound, and export as Chrome trace JSON
+ */
+static void
+traceTest(void)
+{
+   int i, depth, jsonBytes;
+   char *json, *ptr;
+   unsigned char str[] = "trace";
+   DmtxEncode *enc;
+   DmtxDecode *dec;
+   DmtxTrace *trace, *small;
+   DmtxTraceEvent *event;
+
+   enc = dmtxEncodeCreate();
+   dmtxEncodeSetProp(enc, DmtxPropPixelPacking, DmtxPack8bppK);
+   if(dmtxEncodeDataMatrix(enc, strlen((char *)str), str) == DmtxFail)
+      FatalError(91, "traceTest\n");
+
+   trace = dmtxTraceCreate(1 << 16, 7);
+   dec = dmtxDecodeCreate(enc->image, 1);
+   dmtxDecodeSetTrace(dec, trace);
+   if(!decodeMatches(dec, str))
+      FatalError(92, "traceTest\n");
+
+   /* Every begin has a matching end, and the decode stage names its region */
+   if(trace->count < 2 || trace->count % 2 != 0)
+      FatalError(93, "traceTest\n");
+   depth = 0;
+   for(i = 0; i < trace->count; i++) {
+      event = &trace->events[i];
+      depth += (event->phase == 'B') ? 1 : -1;
+      if(depth < 0 || (event->stage == DmtxStatsStageDecode && event->regionId == DmtxUndefined))
+         FatalError(94, "traceTest\n");
+   }
+   if(depth != 0)
+      FatalError(95, "traceTest\n");
+
+   json = dmtxTraceCreateJson(&trace, 1, &jsonBytes);
+   if(json == NULL || jsonBytes != (int)strlen(json) ||
+         strstr(json, "\"traceEvents\"") == NULL || strstr(json, "\"name\":\"Decode\"") == NULL ||
+         strstr(json, "\"tid\":7") == NULL)
+      FatalError(96, "traceTest\n");
+   free(json);
+
+   /* A full ring keeps only the most recent events */
+   small = dmtxTraceCreate(3, 1);
+   dmtxDecodeSetImage(dec, enc->image);
+   dmtxDecodeSetTrace(dec, small);
+   if(!decodeMatches(dec, str) || small->count != trace->count)
+      FatalError(97, "traceTest\n");
+   json = dmtxTraceCreateJson(&small, 1, NULL);
+   if(json == NULL || strstr(json, "\"ts\":0,") == NULL)
+      FatalError(98, "traceTest\n");
+   for(i = 0, ptr = json; (ptr = strstr(ptr, "\"ph\"")) != NULL; i++)
+      ptr++;
+   if(i != 3)
+      FatalError(99, "traceTest\n");
+   free(json);
+
+   dmtxTraceDestroy(&small);
+   dmtxTraceDestroy(&trace);
+   dmtxDecodeDestroy(&dec);
+   dmtxEncodeDestroy(&enc);
+}
+
+/**
+ * Batched transform must land on the same points as one at a time, through
+ * a perspective fit like the ones dmtxRegionUpdateXfrms() builds
+ */
+static void
+transformTest(void)
+{
+   int i, count;
+   double errX, errY;
+   DmtxMatrix3 m, mTmp;
+   DmtxVector2 vIn[64], vOut[64], v;
+
+   dmtxMatrix3LineSkewTop(m, 1.3, 0.7, 1.0);
+   dmtxMatrix3LineSkewSide(mTmp, 1.1, 0.8, 1.0);
+   dmtxMatrix3MultiplyBy(m, mTmp);
+   dmtxMatrix3Scale(mTmp, 412.0, 387.0);
+   dmtxMatrix3MultiplyBy(m, mTmp);
+   dmtxMatrix3Rotate(mTmp, 0.3);
+   dmtxMatrix3MultiplyBy(m, mTmp);
+   dmtxMatrix3Translate(mTmp, 120.0, 95.0);
+   dmtxMatrix3MultiplyBy(m, mTmp);
+
+   for(i = 0; i < 64; i++) {
+      vIn[i].X = (i % 8 + 0.4) / 8.0;
+      vIn[i].Y = (i / 8 + 0.6) / 8.0;
+   }
+
+   count = dmtxMatrix3VMultiplyN(vOut, vIn, 64, m);
+   if(count != 64)
+      FatalError(101, "transformTest\n");
+
+   for(i = 0; i < 64; i++) {
+      dmtxMatrix3VMultiply(&v, &vIn[i], m);
+      errX = fabs(vOut[i].X - v.X);
+      errY = fabs(vOut[i].Y - v.Y);
+      if(errX > 1e-9 || errY > 1e-9)
+         FatalError(102, "transformTest\n");
+   }
+
+   /* In place, and points where w vanishes are flagged */
+   m[0][2] = 1.0;
+   m[1][2] = 0.0;
+   m[2][2] = -0.5;
+   vIn[1].X = 0.5;
+   count = dmtxMatrix3VMultiplyN(vIn, vIn, 64, m);
+   if(count != 63 || vIn[1].X != FLT_MAX || vIn[1].Y != FLT_MAX || vIn[0].X == FLT_MAX)
+      FatalError(103, "transformTest\n");
+}
+
+/**
+ * A symbol seen in strong perspective must be found by the Hough detector,
+ * however many threads build its grid, and only known detectors may be
+ * selected
+ */
+static void
+houghTest(void)
+{
+   int x, y, xs, ys, width, height;
+   double xr, yr, w;
+   unsigned char *pxl;
+   unsigned char str[] = "Hough detector";
+   DmtxEncode *enc;
+   DmtxImage *img;
+   DmtxDecode *dec;
+
+   enc = dmtxEncodeCreate();
+   dmtxEncodeSetProp(enc, DmtxPropPixelPacking, DmtxPack8bppK);
+   dmtxEncodeSetProp(enc, DmtxPropModuleSize, 4);
+   if(dmtxEncodeDataMatrix(enc, strlen((char *)str), str) == DmtxFail)
+      FatalError(121, "houghTest\n");
+
+   width = dmtxImageGetProp(enc->image, DmtxPropWidth);
+   height = dmtxImageGetProp(enc->image, DmtxPropHeight);
+
+   /* Rotate about the canvas center, then tilt away so the far side shrinks */
+   pxl = (unsigned char *)malloc(240 * 240);
+   if(pxl == NULL)
+      FatalError(122, "houghTest\n");
+   for(y = 0; y < 240; y++) {
+      for(x = 0; x < 240; x++) {
+         xr = (x - 120) * cos(0.4) - (y - 120) * sin(0.4);
+         yr = (x - 120) * sin(0.4) + (y - 120) * cos(0.4);
+         w = 1.0 + yr * 0.003;
+         xs = (int)floor(xr * 0.8 / w + width/2.0);
+         ys = (int)floor(yr * 0.8 / w + height/2.0);
+         pxl[y * 240 + x] = (xs >= 0 && xs < width && ys >= 0 && ys < height) ?
+               enc->image->pxl[ys * enc->image->rowSizeBytes + xs] : 255;
+      }
+   }
+
+   img = dmtxImageCreate(pxl, 240, 240, DmtxPack8bppK);
+   dec = dmtxDecodeCreate(img, 1);
+   if(dmtxDecodeSetProp(dec, DmtxPropDetector, DmtxDetectorRuns + 1) != DmtxFail ||
+         dmtxDecodeGetProp(dec, DmtxPropDetector) != DmtxDetectorTrail)
+      FatalError(123, "houghTest\n");
+
+   dmtxDecodeSetProp(dec, DmtxPropDetector, DmtxDetectorHough);
+   if(!decodeMatches(dec, str))
+      FatalError(124, "houghTest\n");
+
+   /* A new image is searched from scratch */
+   dmtxDecodeSetImage(dec, img);
+   if(!decodeMatches(dec, str))
+      FatalError(125, "houghTest\n");
+
+   if(dmtxDecodeSetProp(dec, DmtxPropHoughThreads, 0) != DmtxFail ||
+         dmtxDecodeSetProp(dec, DmtxPropHoughThreads, 4) != DmtxPass ||
+         dmtxDecodeGetProp(dec, DmtxPropHoughThreads) != 4)
+      FatalError(126, "houghTest\n");
+
+   dmtxDecodeSetImage(dec, img);
+   if(!decodeMatches(dec, str))
+      FatalError(127, "houghTest\n");
+
+   dmtxDecodeDestroy(&dec);
+   dmtxImageDestroy(&img);
+   dmtxEncodeDestroy(&enc);
+   free(pxl);
+}
+
+/**
+ * The calibration bar probe must pass every square and rectangular size,
+ * each decoding to its own size
+ */
+static void
+timingTest(void)
+{
+   int sizeIdx;
+   unsigned char str[] = "ab";
+   DmtxEncode *enc;
+   DmtxDecode *dec;
+   DmtxRegion *reg;
+   DmtxMessage *msg;
+
+   for(sizeIdx = 0; sizeIdx < DmtxSymbolSquareCount + DmtxSymbolRectCount; sizeIdx++) {
+      enc = dmtxEncodeCreate();
+      dmtxEncodeSetProp(enc, DmtxPropPixelPacking, DmtxPack8bppK);
+      dmtxEncodeSetProp(enc, DmtxPropModuleSize, 3);
+      dmtxEncodeSetProp(enc, DmtxPropSizeRequest, sizeIdx);
+      if(dmtxEncodeDataMatrix(enc, strlen((char *)str), str) == DmtxFail)
+         FatalError(131, "timingTest\n");
+
+      dec = dmtxDecodeCreate(enc->image, 1);
+      reg = dmtxRegionFindNext(dec, NULL);
+      if(reg == NULL || reg->sizeIdx != sizeIdx)
+         FatalError(132, "timingTest\n");
+
+      msg = dmtxDecodeMatrixRegion(dec, reg, DmtxUndefined);
+      if(msg == NULL || msg->outputIdx != (int)strlen((char *)str) ||
+            memcmp(msg->output, str, msg->outputIdx) != 0)
+         FatalError(133, "timingTest\n");
+
+      dmtxMessageDestroy(&msg);
+      dmtxRegionDestroy(&reg);
+      dmtxDecodeDestroy(&dec);
+      dmtxEncodeDestroy(&enc);
+   }
+}
+
+/**
+ * Each symbol on a light page must be found by the run-length detector,
+ * whether it sits square, turned or skewed, and a decoded symbol must not
+ * be returned again
+ */
+static void
+runsTest(void)
+{
+   int i, k, x, y, xs, ys, width, height, found;
+   double xr, yr;
+   double affine[2][4] = { { 1.0, 0.0, 0.0, 1.0 }, { 0.85, -0.55, 0.25, 0.9 } };
+   unsigned char *pxl;
+   unsigned char *str[2] = { (unsigned char *)"upright", (unsigned char *)"skewed" };
+   DmtxEncode *enc;
+   DmtxImage *img;
+   DmtxDecode *dec;
+   DmtxRegion *reg;
+   DmtxMessage *msg;
+
+   pxl = (unsigned char *)malloc(360 * 200);
+   if(pxl == NULL)
+      FatalError(141, "runsTest\n");
+   memset(pxl, 230, 360 * 200);
+
+   /* Left symbol as encoded, right one turned and sheared about its center */
+   for(i = 0; i < 2; i++) {
+      enc = dmtxEncodeCreate();
+      dmtxEncodeSetProp(enc, DmtxPropPixelPacking, DmtxPack8bppK);
+      dmtxEncodeSetProp(enc, DmtxPropModuleSize, 4);
+      if(dmtxEncodeDataMatrix(enc, strlen((char *)str[i]), str[i]) == DmtxFail)
+         FatalError(142, "runsTest\n");
+
+      width = dmtxImageGetProp(enc->image, DmtxPropWidth);
+      height = dmtxImageGetProp(enc->image, DmtxPropHeight);
+      for(y = 0; y < 200; y++) {
+         for(x = i * 180; x < i * 180 + 180; x++) {
+            xr = x - i * 180 - 90;
+            yr = y - 100;
+            xs = (int)floor(affine[i][0] * xr + affine[i][1] * yr + width/2.0);
+            ys = (int)floor(affine[i][2] * xr + affine[i][3] * yr + height/2.0);
+            if(xs >= 0 && xs < width && ys >= 0 && ys < height &&
+                  enc->image->pxl[ys * enc->image->rowSizeBytes + xs] < 128)
+               pxl[y * 360 + x] = 30;
+         }
+      }
+      dmtxEncodeDestroy(&enc);
+   }
+
+   img = dmtxImageCreate(pxl, 360, 200, DmtxPack8bppK);
+   dec = dmtxDecodeCreate(img, 1);
+   if(dmtxDecodeSetProp(dec, DmtxPropDetector, DmtxDetectorRuns) != DmtxPass)
+      FatalError(143, "runsTest\n");
+
+   found = 0;
+   while((reg = dmtxRegionFindNext(dec, NULL)) != NULL) {
+      msg = dmtxDecodeMatrixRegion(dec, reg, DmtxUndefined);
+      if(msg == NULL)
+         FatalError(144, "runsTest\n");
+      for(k = 0; k < 2; k++) {
+         if(msg->outputIdx == (int)strlen((char *)str[k]) &&
+               memcmp(msg->output, str[k], msg->outputIdx) == 0) {
+            if(found & (1 << k))
+               FatalError(145, "runsTest\n");
+            found |= 1 << k;
+         }
+      }
+      dmtxMessageDestroy(&msg);
+      dmtxRegionDestroy(&reg);
+   }
+   if(found != 0x03)
+      FatalError(146, "runsTest\n");
+
+   dmtxDecodeDestroy(&dec);
+   dmtxImageDestroy(&img);
+   free(pxl);
+}
+
+/**
+ * Decode rotated, sheared, perspective and noisy renders and compare the
+ * sampled module arrays with those of the decoder before module sampling
+ * went through dmtxMatrix3VMultiplyN()
+ */
+static void
+samplingTest(void)
+{
+   int i, k, x, y, xs, ys, width, height, v;
+   unsigned int seed, hash;
+   size_t j;
+   double xr, yr, w, sx, sy, fx, fy, acc, p;
+   unsigned char *pxl;
+   DmtxEncode *enc;
+   DmtxImage *img;
+   DmtxDecode *dec;
+   DmtxRegion *reg;
+   DmtxMessage *msg;
+   struct {
+      double xfrm[6];      /* Canvas to symbol: a, b, c, d and perspective g, h */
+      int noise;
+      int moduleSize;
+      char *str;
+      int sizeIdx;         /* Expected results */
+      int onColor;
+      int offColor;
+      unsigned int hash;   /* Of the sampled module array */
+   } cases[] = {
+      { { 0.8, -0.6, 0.6, 0.8, 0.0, 0.0 }, 0, 4, "rotated", 2, 0, 255, 0x6c3bd16a },
+      { { 0.28, 0.96, -0.96, 0.28, 0.0, 0.0 }, 24, 3, "rotated with noise 0123", 5, 12, 249, 0xfb9b466d },
+      { { -0.6, -0.8, 0.8, -0.6, 0.0, 0.0 }, 40, 5, "upside down", 3, 12, 247, 0x27b9cd67 },
+      { { 1.0, 0.3, -0.1, 0.9, 0.0, 0.0 }, 12, 4, "sheared", 2, 2, 252, 0xead1f640 },
+      { { 0.9, -0.2, 0.25, 0.95, 0.0012, -0.0008 }, 0, 4, "mild perspective", 4, 0, 255, 0xb50a0c5c },
+      { { 0.7, -0.7, 0.7, 0.7, -0.0020, 0.0015 }, 20, 4, "perspective 45 degrees", 5, 7, 245, 0x9f054367 },
+      { { 0.96, 0.28, -0.28, 0.96, 0.0018, 0.0016 }, 32, 4, "strong perspective noisy", 6, 6, 246, 0x49ba48b5 },
+      { { 1.1, 0.0, 0.0, 1.1, 0.0, 0.0 }, 48, 3, "scaled down, heavy noise, longer message 42", 8, 11, 238, 0x4bbeefc0 },
+      { { 0.5, -0.866, 0.866, 0.5, 0.0010, 0.0 }, 16, 3, "sixty", 1, 2, 248, 0x06185832 },
+      { { 0.866, 0.5, -0.5, 0.866, 0.0, -0.0018 }, 28, 4, "thirty", 2, 6, 248, 0x5ed1aec7 },
+      { { 0.8, 0.6, -0.6, 0.8, 0.0, 0.0 }, 90, 5, "very noisy", 3, 32, 228, 0x77bc0406 },
+      { { 0.6, 0.8, -0.8, 0.6, 0.0015, 0.0 }, 70, 4, "noisy perspective", 4, 13, 237, 0x2417c9fc }
+   };
+
+   pxl = (unsigned char *)malloc(240 * 240);
+   if(pxl == NULL)
+      FatalError(161, "samplingTest\n");
+
+   seed = 12345;
+   for(i = 0; i < (int)(sizeof(cases)/sizeof(cases[0])); i++) {
+      enc = dmtxEncodeCreate();
+      dmtxEncodeSetProp(enc, DmtxPropPixelPacking, DmtxPack8bppK);
+      dmtxEncodeSetProp(enc, DmtxPropModuleSize, cases[i].moduleSize);
+      if(dmtxEncodeDataMatrix(enc, strlen(cases[i].str), (unsigned char *)cases[i].str) == DmtxFail)
+         FatalError(161, "samplingTest\n");
+
+      /* Bilinear resample about the canvas center, then add LCG noise */
+      width = dmtxImageGetProp(enc->image, DmtxPropWidth);
+      height = dmtxImageGetProp(enc->image, DmtxPropHeight);
+      for(y = 0; y < 240; y++) {
+         for(x = 0; x < 240; x++) {
+            xr = x - 120;
+            yr = y - 120;
+            w = 1.0 + cases[i].xfrm[4] * xr + cases[i].xfrm[5] * yr;
+            sx = (cases[i].xfrm[0] * xr + cases[i].xfrm[1] * yr) / w + width/2.0 - 0.5;
+            sy = (cases[i].xfrm[2] * xr + cases[i].xfrm[3] * yr) / w + height/2.0 - 0.5;
+            xs = (int)floor(sx);
+            ys = (int)floor(sy);
+            fx = sx - xs;
+            fy = sy - ys;
+            for(k = 0, acc = 0.0; k < 4; k++) {
+               p = 255.0;
+               if(xs + (k & 1) >= 0 && xs + (k & 1) < width && ys + (k >> 1) >= 0 && ys + (k >> 1) < height)
+                  p = enc->image->pxl[(ys + (k >> 1)) * enc->image->rowSizeBytes + xs + (k & 1)];
+               acc += p * ((k & 1) ? fx : 1.0 - fx) * ((k >> 1) ? fy : 1.0 - fy);
+            }
+            v = (int)(acc + 0.5);
+            if(cases[i].noise > 0) {
+               seed = seed * 1103515245u + 12345u;
+               v += (int)((seed >> 16) % (2 * cases[i].noise + 1)) - cases[i].noise;
+            }
+            pxl[y * 240 + x] = (unsigned char)((v < 0) ? 0 : (v > 255) ? 255 : v);
+         }
+      }
+
+      img = dmtxImageCreate(pxl, 240, 240, DmtxPack8bppK);
+      dec = dmtxDecodeCreate(img, 1);
+      reg = dmtxRegionFindNext(dec, NULL);
+      if(reg == NULL)
+         FatalError(162, "samplingTest\n");
+
+      msg = dmtxDecodeMatrixRegion(dec, reg, DmtxUndefined);
+      if(msg == NULL || msg->outputIdx != (int)strlen(cases[i].str) ||
+            memcmp(msg->output, cases[i].str, msg->outputIdx) != 0)
+         FatalError(162, "samplingTest\n");
+
+      for(j = 0, hash = 0; j < msg->arraySize; j++)
+         hash = hash * 31u + msg->array[j];
+
+      if(reg->sizeIdx != cases[i].sizeIdx || reg->onColor != cases[i].onColor ||
+            reg->offColor != cases[i].offColor || hash != cases[i].hash) {
+         fprintf(stdout, "case %d: size %d on %d off %d hash %08x\n", i, reg->sizeIdx,
+               reg->onColor, reg->offColor, hash);
+         FatalError(163, "samplingTest\n");
+      }
+
+      dmtxMessageDestroy(&msg);
+      dmtxRegionDestroy(&reg);
+      dmtxDecodeDestroy(&dec);
+      dmtxImageDestroy(&img);
+      dmtxEncodeDestroy(&enc);
+   }
+
+   free(pxl);
+}
+
+/**
+ * Every compare_test input message, encoded in each scheme that accepts it,
+ * must decode back to its exact bytes
+ */
+static void
+corpusTest(char *dirName)
+{
+   int i, s, bytes, decoded;
+   char fileName[1024];
+   unsigned char buf[4096];
+   int schemes[] = { DmtxSchemeAutoBest, DmtxSchemeAscii, DmtxSchemeC40, DmtxSchemeText,
+         DmtxSchemeX12, DmtxSchemeEdifact, DmtxSchemeBase256 };
+   FILE *fp;
+   DmtxEncode *enc;
+   DmtxDecode *dec;
+   DmtxRegion *reg;
+   DmtxMessage *msg;
+
+   decoded = 0;
+   for(i = 0; ; i++) {
+      snprintf(fileName, sizeof(fileName), "%s/message_%03d.dat", dirName, i);
+      fp = fopen(fileName, "rb");
+      if(fp == NULL)
+         break;
+      bytes = (int)fread(buf, 1, sizeof(buf) - 1, fp);
+      fclose(fp);
+      buf[bytes] = '\0';
+
+      for(s = 0; s < (int)(sizeof(schemes)/sizeof(schemes[0])); s++) {
+         enc = dmtxEncodeCreate();
+         dmtxEncodeSetProp(enc, DmtxPropScheme, schemes[s]);
+         if(dmtxEncodeDataMatrix(enc, bytes, buf) == DmtxFail) {
+            /* Scheme can't represent this message */
+            dmtxEncodeDestroy(&enc);
+            continue;
+         }
+
+         /* Messages may hold NUL bytes, so compare by length */
+         dec = dmtxDecodeCreate(enc->image, 1);
+         reg = dmtxRegionFindNext(dec, NULL);
+         msg = (reg == NULL) ? NULL : dmtxDecodeMatrixRegion(dec, reg, DmtxUndefined);
+         if(msg == NULL || msg->outputIdx != bytes || memcmp(msg->output, buf, bytes) != 0) {
+            fprintf(stdout, "%s scheme %d\n", fileName, schemes[s]);
+            FatalError(111, "corpusTest\n");
+         }
+         decoded++;
+
+         dmtxMessageDestroy(&msg);
+         dmtxRegionDestroy(&reg);
+         dmtxDecodeDestroy(&dec);
+         dmtxEncodeDestroy(&enc);
+      }
+   }
+
+   if(i == 0 || decoded == 0)
+      FatalError(112, "corpusTest\n");
+}